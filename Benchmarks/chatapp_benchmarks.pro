@@ -0,0 +1,62 @@
+QT -= gui
+QT += core network testlib
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+# the server is linked without its main.cpp, results are written with
+# the usual QTest options, e.g. -o results.xml,xml or -o results.csv,csv
+INCLUDEPATH += ../Server
+
+SOURCES += \
+        ../Server/accountedfile.cpp \
+        ../Server/adminserver.cpp \
+        ../Server/apimethods.cpp \
+        ../Server/chatactivity.cpp \
+        ../Server/consistenthashring.cpp \
+        ../Server/jsonwriter.cpp \
+        ../Server/latencyhistogram.cpp \
+        ../Server/messagebus.cpp \
+        ../Server/messagecache.cpp \
+        ../Server/metrics.cpp \
+        ../Server/passwordhasher.cpp \
+        ../Server/peerauth.cpp \
+        ../Server/ratelimiter.cpp \
+        ../Server/replicationfollower.cpp \
+        ../Server/replicationleader.cpp \
+        ../Server/replicationlog.cpp \
+        ../Server/requestdecoder.cpp \
+        ../Server/requestprofile.cpp \
+        ../Server/serverconfig.cpp \
+        ../Server/sessionregistry.cpp \
+        ../Server/tcpserver.cpp \
+        ../Server/timerwheel.cpp \
+        ../Server/tracer.cpp \
+        ../Server/trafficcapture.cpp \
+        storagebenchmark.cpp
+
+HEADERS += \
+    ../Server/accountedfile.h \
+    ../Server/adminserver.h \
+    ../Server/chatactivity.h \
+    ../Server/consistenthashring.h \
+    ../Server/exceptions.h \
+    ../Server/jsonwriter.h \
+    ../Server/latencyhistogram.h \
+    ../Server/messagebus.h \
+    ../Server/messagecache.h \
+    ../Server/metrics.h \
+    ../Server/passwordhasher.h \
+    ../Server/peerauth.h \
+    ../Server/ratelimiter.h \
+    ../Server/replicationfollower.h \
+    ../Server/replicationleader.h \
+    ../Server/replicationlog.h \
+    ../Server/requestdecoder.h \
+    ../Server/requestprofile.h \
+    ../Server/serverconfig.h \
+    ../Server/sessionregistry.h \
+    ../Server/tcpserver.h \
+    ../Server/timerwheel.h \
+    ../Server/tracer.h \
+    ../Server/trafficcapture.h
@@ -0,0 +1,348 @@
+#include <QtTest>
+#include "tcpserver.h"
+#include "passwordhasher.h"
+
+//benchmarks of the storage paths of the server against generated
+//datasets of several sizes. every dataset is generated once in its
+//own directory and the static maps of the server are reloaded when
+//a benchmark row switches to another one
+class StorageBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void sendMessage_data();
+    void sendMessage();
+    void getLastBlockOfMessages_data();
+    void getLastBlockOfMessages();
+    void getMessageByID_data();
+    void getMessageByID();
+    void writeNewestMessages_data();
+    void writeNewestMessages();
+    void getChatInfo_data();
+    void getChatInfo();
+    void getChatMembership_data();
+    void getChatMembership();
+    void getIDFromUsername_data();
+    void getIDFromUsername();
+    void getIDFromAccessToken_data();
+    void getIDFromAccessToken();
+    void validateUser_data();
+    void validateUser();
+    void createChat_data();
+    void createChat();
+    void addAndKickMember_data();
+    void addAndKickMember();
+
+private:
+    struct Dataset
+    {
+        int             usersNum;
+        QVector<size_t> chatAdmins;
+        int             messagesPerChat;
+    };
+
+    static const int membersPerChat = 5;
+    static const QString password;
+
+    QTemporaryDir *dataDir = nullptr;
+    QString previousDir;
+    Server *server = nullptr;
+    QString passwordHash;
+
+    QMap<QString, Dataset> datasets;
+    QString currentDataset;
+
+    void addDatasets();
+    const Dataset &useDataset();
+    static void generateDataset(Dataset &dataset, const int &chats, const QString &passwordHash);
+    static void reloadStorage();
+    static QString username(const int &userID);
+};
+
+const QString StorageBenchmark::password = "benchmark";
+
+QString StorageBenchmark::username(const int &userID)
+{
+    return QStringLiteral("user%1").arg(userID);
+}
+
+void StorageBenchmark::initTestCase()
+{
+    this->previousDir = QDir::currentPath();
+    this->dataDir = new QTemporaryDir;
+    QVERIFY(this->dataDir->isValid());
+
+    ServerConfig config;
+    config.host = "127.0.0.1";
+    config.port = 0;
+    config.adminPort = 0;
+    config.dataDir = this->dataDir->path();
+    this->server = new Server(config);
+
+    //users share one hash, hashing each of them would dominate the setup
+    this->passwordHash = PasswordHasher::hash(StorageBenchmark::password, config.passwordHashIterations);
+}
+
+void StorageBenchmark::cleanupTestCase()
+{
+    delete this->server;
+    QDir::setCurrent(this->previousDir);
+    delete this->dataDir;
+}
+
+void StorageBenchmark::addDatasets()
+{
+    QTest::addColumn<int>("users");
+    QTest::addColumn<int>("chats");
+    QTest::addColumn<int>("messages");
+
+    QTest::newRow("small")  << 100  << 10  << 500;
+    QTest::newRow("medium") << 1000 << 50  << 2000;
+    QTest::newRow("large")  << 5000 << 100 << 5000;
+}
+
+const StorageBenchmark::Dataset &StorageBenchmark::useDataset()
+{
+    QFETCH(int, users);
+    QFETCH(int, chats);
+    QFETCH(int, messages);
+
+    const QString name = QTest::currentDataTag();
+    if (name == this->currentDataset)
+        return this->datasets[name];
+
+    QDir(this->dataDir->path()).mkdir(name);
+    QDir::setCurrent(this->dataDir->filePath(name));
+    this->currentDataset = name;
+
+    if (!this->datasets.contains(name))
+    {
+        Dataset dataset = {users, {}, messages};
+        StorageBenchmark::reloadStorage();
+        StorageBenchmark::generateDataset(dataset, chats, this->passwordHash);
+        this->datasets.insert(name, dataset);
+        qDebug() << "Generated dataset" << name << users << "users" << chats << "chats" << messages << "messages per chat";
+    }
+    StorageBenchmark::reloadStorage();
+    return this->datasets[name];
+}
+
+void StorageBenchmark::reloadStorage()
+{
+    Server::tokens.clear();
+    Server::userTokens.clear();
+    Server::usernames.clear();
+    Server::messageCache.clear();
+    delete Server::tokenExpiry;
+    Server::tokenExpiry = new TimerWheel(Server::config.tokenExpiryTick, 64, 4, QDateTime::currentMSecsSinceEpoch());
+    Server::loadTokensMap();
+    Server::loadUsernamesMap();
+}
+
+void StorageBenchmark::generateDataset(Dataset &dataset, const int &chats, const QString &passwordHash)
+{
+    for (int i = 0; i < dataset.usersNum; ++i)
+        Server::createUser(StorageBenchmark::username(i), passwordHash, false);
+
+    for (int chatID = 0; chatID < chats; ++chatID)
+    {
+        const size_t adminID = chatID % dataset.usersNum;
+        QJsonArray members;
+        for (int i = 1; i < StorageBenchmark::membersPerChat; ++i)
+            members.append(StorageBenchmark::username((adminID + i) % dataset.usersNum));
+        Server::createChat(QStringLiteral("chat%1").arg(chatID), members, adminID, true);
+        dataset.chatAdmins.append(adminID);
+
+        for (int i = 0; i < dataset.messagesPerChat; ++i)
+            Server::sendMessage(chatID, QStringLiteral("message %1").arg(i), adminID);
+    }
+}
+
+void StorageBenchmark::sendMessage_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::sendMessage()
+{
+    const Dataset &dataset = this->useDataset();
+    int i = 0;
+    QBENCHMARK
+    {
+        const size_t chatID = i++ % dataset.chatAdmins.size();
+        Server::sendMessage(chatID, "benchmark message", dataset.chatAdmins[chatID]);
+    }
+}
+
+void StorageBenchmark::getLastBlockOfMessages_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::getLastBlockOfMessages()
+{
+    const Dataset &dataset = this->useDataset();
+    int i = 0;
+    QBENCHMARK
+    {
+        const size_t chatID = i++ % dataset.chatAdmins.size();
+        Server::getLastBlockOfMessages(chatID, dataset.chatAdmins[chatID]);
+    }
+}
+
+void StorageBenchmark::getMessageByID_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::getMessageByID()
+{
+    const Dataset &dataset = this->useDataset();
+    //a fixed stride walks the history instead of hitting one block
+    size_t i = 0;
+    QBENCHMARK
+    {
+        const size_t chatID = i % dataset.chatAdmins.size();
+        Server::getMessageByID(chatID, (i * 7919) % dataset.messagesPerChat, dataset.chatAdmins[chatID]);
+        ++i;
+    }
+}
+
+void StorageBenchmark::writeNewestMessages_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::writeNewestMessages()
+{
+    const Dataset &dataset = this->useDataset();
+    int i = 0;
+    QByteArray out;
+    QBENCHMARK
+    {
+        const size_t chatID = i++ % dataset.chatAdmins.size();
+        out.clear();
+        Server::writeNewestMessages(out, chatID, dataset.chatAdmins[chatID], 50);
+    }
+}
+
+void StorageBenchmark::getChatInfo_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::getChatInfo()
+{
+    const Dataset &dataset = this->useDataset();
+    int i = 0;
+    QBENCHMARK
+    {
+        const size_t chatID = i++ % dataset.chatAdmins.size();
+        Server::getChatInfo(chatID, dataset.chatAdmins[chatID]);
+    }
+}
+
+void StorageBenchmark::getChatMembership_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::getChatMembership()
+{
+    const Dataset &dataset = this->useDataset();
+    int i = 0;
+    QBENCHMARK
+    {
+        Server::getChatMembership(i++ % dataset.usersNum);
+    }
+}
+
+void StorageBenchmark::getIDFromUsername_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::getIDFromUsername()
+{
+    const Dataset &dataset = this->useDataset();
+    const QString username = StorageBenchmark::username(dataset.usersNum - 1);
+    QBENCHMARK
+    {
+        Server::getIDFromUsername(username);
+    }
+}
+
+void StorageBenchmark::getIDFromAccessToken_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::getIDFromAccessToken()
+{
+    const Dataset &dataset = this->useDataset();
+    const QString token = Server::updAccessToken(dataset.usersNum - 1)["new_token"].toString();
+    QVERIFY(!token.isEmpty());
+    QBENCHMARK
+    {
+        Server::getIDFromAccessToken(token);
+    }
+}
+
+void StorageBenchmark::validateUser_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::validateUser()
+{
+    const Dataset &dataset = this->useDataset();
+    const size_t userID = dataset.usersNum - 1;
+    QBENCHMARK
+    {
+        Server::validateUser(userID, StorageBenchmark::password);
+    }
+}
+
+void StorageBenchmark::createChat_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::createChat()
+{
+    const Dataset &dataset = this->useDataset();
+    QJsonArray members;
+    for (int i = 1; i < StorageBenchmark::membersPerChat; ++i)
+        members.append(StorageBenchmark::username(i));
+    //the chats created here get ids after the ones of the dataset
+    QBENCHMARK
+    {
+        Server::createChat("benchmark chat", members, 0, true);
+    }
+}
+
+void StorageBenchmark::addAndKickMember_data()
+{
+    this->addDatasets();
+}
+
+void StorageBenchmark::addAndKickMember()
+{
+    const Dataset &dataset = this->useDataset();
+    const size_t chatID = 0,
+                 adminID = dataset.chatAdmins[chatID],
+                 userID = (adminID + StorageBenchmark::membersPerChat) % dataset.usersNum;
+    QBENCHMARK
+    {
+        Server::addMemberInChatByUser(chatID, adminID, userID);
+        Server::kickMember(chatID, adminID, userID);
+    }
+}
+
+QTEST_GUILESS_MAIN(StorageBenchmark)
+
+#include "storagebenchmark.moc"
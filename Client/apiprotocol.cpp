@@ -0,0 +1,123 @@
+#include "apiprotocol.h"
+
+QByteArray ApiProtocol::query(const QString &method, const QJsonObject &params)
+{
+    QJsonObject query;
+    query.insert("method", method);
+    query.insert("params", params);
+    return QJsonDocument(query).toJson(QJsonDocument::Compact);
+}
+
+QByteArray ApiProtocol::createUser(const QString &username, const QString &password)
+{
+    QJsonObject params;
+    params.insert("username", username);
+    params.insert("password", password);
+    return ApiProtocol::query("user.create", params);
+}
+
+QByteArray ApiProtocol::changeAccessToken(const QString &username, const QString &password)
+{
+    QJsonObject params;
+    params.insert("username", username);
+    params.insert("password", password);
+    return ApiProtocol::query("access_token.change", params);
+}
+
+QByteArray ApiProtocol::getMyInfo(const QString  &accessToken,
+                                  const int      &currentChatID,
+                                  const int      &messagesNum,
+                                  const int      &afterMessageID)
+{
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    params.insert("current_chat_id", currentChatID);
+    params.insert("messages_num", messagesNum);
+    if (afterMessageID >= 0)
+        params.insert("after_id", afterMessageID);
+    return ApiProtocol::query("user.getmyinfo", params);
+}
+
+QByteArray ApiProtocol::getMyInfo(const QString  &accessToken,
+                                  const int      &currentChatID,
+                                  const int      &messagesNum,
+                                  const int      &messageChatID,
+                                  const QString  &messageText,
+                                  const int      &afterMessageID)
+{
+    QJsonObject messageToSend;
+    messageToSend.insert("text", messageText);
+    messageToSend.insert("chat_id", messageChatID);
+
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    params.insert("current_chat_id", currentChatID);
+    params.insert("messages_num", messagesNum);
+    params.insert("message_to_send", messageToSend);
+    if (afterMessageID >= 0)
+        params.insert("after_id", afterMessageID);
+    return ApiProtocol::query("user.getmyinfo", params);
+}
+
+QByteArray ApiProtocol::createChat(const QString      &accessToken,
+                                   const QString      &chatName,
+                                   const QJsonArray   &membersUsernames,
+                                   const bool         &isVisible)
+{
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    params.insert("name", chatName);
+    params.insert("members", membersUsernames);
+    params.insert("is_visible", isVisible);
+    return ApiProtocol::query("chat.create", params);
+}
+
+QByteArray ApiProtocol::sendMessage(const QString &accessToken, const int &chatID, const QString &messageText)
+{
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    params.insert("chat_id", chatID);
+    params.insert("text", messageText);
+    return ApiProtocol::query("chat.sendmessage", params);
+}
+
+QByteArray ApiProtocol::getLastMessages(const QString &accessToken, const int &chatID, const int &messagesNum)
+{
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    params.insert("chat_id", chatID);
+    params.insert("num", messagesNum);
+    return ApiProtocol::query("chat.getlastmessages", params);
+}
+
+QByteArray ApiProtocol::getHistory(const QString  &accessToken,
+                                   const int      &chatID,
+                                   const int      &beforeMessageID,
+                                   const int      &messagesNum)
+{
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    params.insert("chat_id", chatID);
+    params.insert("before_id", beforeMessageID);
+    params.insert("num", messagesNum);
+    return ApiProtocol::query("chat.gethistory", params);
+}
+
+QByteArray ApiProtocol::subscribeEvents(const QString &accessToken)
+{
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    return ApiProtocol::query("events.subscribe", params);
+}
+
+QByteArray ApiProtocol::resumeSession(const QString &accessToken, const QHash<int, int> &watermarks)
+{
+    QJsonObject encodedWatermarks;
+    for (auto i = watermarks.constBegin(); i != watermarks.constEnd(); ++i)
+        encodedWatermarks.insert(QString::number(i.key()), i.value());
+
+    QJsonObject params;
+    params.insert("access_token", accessToken);
+    params.insert("watermarks", encodedWatermarks);
+    return ApiProtocol::query("session.resume", params);
+}
@@ -0,0 +1,61 @@
+#ifndef APIPROTOCOL_H
+#define APIPROTOCOL_H
+
+#include <QtCore>
+
+//builds the queries of the server api, shared by the
+//gui client and the load generator
+class ApiProtocol
+{
+public:
+    static QByteArray query(const QString &method, const QJsonObject &params);
+
+    static QByteArray createUser(const QString &username,
+                                 const QString &password);
+
+    static QByteArray changeAccessToken(const QString &username,
+                                        const QString &password);
+
+    //with afterMessageID set only the newer messages are returned
+    static QByteArray getMyInfo(const QString  &accessToken,
+                                const int      &currentChatID,
+                                const int      &messagesNum,
+                                const int      &afterMessageID = -1);
+
+    //the message is sent in the same query as the polling
+    static QByteArray getMyInfo(const QString  &accessToken,
+                                const int      &currentChatID,
+                                const int      &messagesNum,
+                                const int      &messageChatID,
+                                const QString  &messageText,
+                                const int      &afterMessageID = -1);
+
+    static QByteArray createChat(const QString      &accessToken,
+                                 const QString      &chatName,
+                                 const QJsonArray   &membersUsernames,
+                                 const bool         &isVisible);
+
+    static QByteArray sendMessage(const QString  &accessToken,
+                                  const int      &chatID,
+                                  const QString  &messageText);
+
+    static QByteArray getLastMessages(const QString  &accessToken,
+                                      const int      &chatID,
+                                      const int      &messagesNum);
+
+    //messagesNum messages older than beforeMessageID
+    static QByteArray getHistory(const QString  &accessToken,
+                                 const int      &chatID,
+                                 const int      &beforeMessageID,
+                                 const int      &messagesNum);
+
+    //new messages of the user chats are pushed into the connection
+    static QByteArray subscribeEvents(const QString &accessToken);
+
+    //subscribes a new connection and fetches the messages sent after
+    //the watermarks, the last message id the client has in every chat
+    static QByteArray resumeSession(const QString          &accessToken,
+                                    const QHash<int, int>  &watermarks);
+};
+
+#endif // APIPROTOCOL_H
@@ -3,7 +3,8 @@
 
 AsyncClient::AsyncClient(const quint16 &hostPort)
 {
-    this->socket = new QTcpSocket();
+    //the socket is a child, so it follows the client to its thread
+    this->socket = new QTcpSocket(this);
     this->hostPort = hostPort;
 
     connect(this->socket, SIGNAL(readyRead()),
@@ -18,7 +19,7 @@ AsyncClient::AsyncClient(const quint16 &hostPort)
 
 AsyncClient::~AsyncClient()
 {
-    this->socket->deleteLater();
+
 }
 
 void AsyncClient::setManager(AsyncClientManager *manager)
@@ -26,6 +27,31 @@ void AsyncClient::setManager(AsyncClientManager *manager)
     this->manager = manager;
 }
 
+QHash<int, int> AsyncClient::watermarks() const
+{
+    QHash<int, int> watermarks;
+    for (auto i = this->lastMessageIDs.constBegin(); i != this->lastMessageIDs.constEnd(); ++i)
+        watermarks.insert(i.key(), i.value());
+    return watermarks;
+}
+
+int AsyncClient::watermark(int chatID) const
+{
+    return this->lastMessageIDs.value(chatID, -1);
+}
+
+void AsyncClient::setWatermarks(const QHash<int, int> &watermarks)
+{
+    this->lastMessageIDs.clear();
+    for (auto i = watermarks.constBegin(); i != watermarks.constEnd(); ++i)
+        this->lastMessageIDs.insert(i.key(), i.value());
+}
+
+void AsyncClient::expectHistory(int chatID)
+{
+    this->historyChatID = chatID;
+}
+
 void AsyncClient::slotConnected()
 {
     //qDebug() << "Connection established";
@@ -43,29 +69,93 @@ void AsyncClient::slotError(QAbstractSocket::SocketError err)
         error += "connection refused.";
 
     qDebug() << err;
-    this->socket->close();
+    this->in.clear();
+    this->historyChatID = -1;
+    this->socket->abort();
+    emit connectionLost();
 }
 
 void AsyncClient::sendData(QByteArray data)
 {
-    this->socket->connectToHost(QHostAddress("192.168.50.19"), this->hostPort);
-    this->socket->waitForConnected();
+    //written data is buffered until the connection is established
+    if (this->socket->state() == QAbstractSocket::UnconnectedState)
+        this->socket->connectToHost(QHostAddress("192.168.50.19"), this->hostPort);
     this->socket->write(data);
 }
 
 void AsyncClient::slotReadyRead()
 {
-    QByteArray data = this->socket->readAll();
-    this->socket->close();
-    if (this->socket->state() != QAbstractSocket::UnconnectedState)
-        this->socket->waitForDisconnected();
-    QJsonObject response = QJsonDocument::fromJson(data).object();
+    //every response and event is one line
+    this->in += this->socket->readAll();
+    int lineEnd;
+    while ((lineEnd = this->in.indexOf('\n')) >= 0)
+    {
+        QJsonObject response = QJsonDocument::fromJson(this->in.left(lineEnd)).object();
+        this->in.remove(0, lineEnd + 1);
+        if (response.contains("event"))
+            emit gotEvent(response);
+        else
+            this->handleResponse(response);
+    }
+}
+
+void AsyncClient::handleResponse(const QJsonObject &response)
+{
+    int errorCode = response["error_code"].toInt();
+    if (errorCode == RATE_LIMIT_EXCEEDED || errorCode == SERVER_IS_BUSY)
+        emit throttled(response["retry_after"].toVariant().toLongLong());
+
+    bool changed = false;
     if (response.contains("username"))
-        emit updUsername("You're logged in as "+response["username"].toString());
+        emit updUsername(response["username"].toString());
     if (response.contains("chat_membership"))
-        emit updChatList(response["chat_membership"].toArray());
+    {
+        QJsonArray chatList = response["chat_membership"].toArray();
+        changed = changed || chatList != this->lastChatList;
+        this->lastChatList = chatList;
+        emit updChatList(chatList);
+    }
     if (response.contains("newest_messages"))
-        emit updNewestMessages(response["newest_messages"].toObject()["chat_id"].toInt(),
-                               response["newest_messages"].toObject()["messages"].toArray());
-    emit gotReply();
+    {
+        QJsonObject newestMessages = response["newest_messages"].toObject();
+        size_t chatID = newestMessages["chat_id"].toInt();
+        QJsonArray messages = newestMessages["messages"].toArray();
+
+        //only the messages after the watermark are asked for,
+        //so an empty array means nothing new
+        if (!messages.isEmpty())
+        {
+            changed = true;
+            this->lastMessageIDs[chatID] = messages.last().toObject()["id"].toInt();
+            emit updNewestMessages(chatID, messages);
+        }
+        else if (!this->lastMessageIDs.contains(chatID))
+        {
+            changed = true;
+            this->lastMessageIDs[chatID] = -1;
+        }
+    }
+    if (this->historyChatID >= 0)
+    {
+        //older messages dont move the watermark. an error reply
+        //doesnt say its chat, but it ends the page all the same
+        const int chatID = this->historyChatID;
+        this->historyChatID = -1;
+        emit updHistory(chatID, errorCode, response["history"].toArray());
+    }
+    if (response.contains("resumed"))
+    {
+        //only the messages after the watermarks, chats without them are left out
+        for (QJsonValue i: response["resumed"].toArray())
+        {
+            size_t chatID = i["chat_id"].toInt();
+            QJsonArray messages = i["messages"].toArray();
+            if (messages.isEmpty())
+                continue;
+            changed = true;
+            this->lastMessageIDs[chatID] = messages.last().toObject()["id"].toInt();
+            emit updNewestMessages(chatID, messages);
+        }
+    }
+    emit gotReply(errorCode, changed);
 }
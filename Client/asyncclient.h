@@ -7,6 +7,9 @@
 
 class AsyncClientManager;
 
+//keeps one connection to the server open, queries are written
+//as soon as it is up and every line received is a response or
+//an event pushed by the server
 class AsyncClient: public QObject
 {
     Q_OBJECT
@@ -15,6 +18,17 @@ public:
     void setManager(AsyncClientManager*);
     virtual ~AsyncClient();
 
+    //id of the last message received in every chat, -1 for empty chats
+    QHash<int, int> watermarks() const;
+    int watermark(int chatID) const;
+
+    //the client starts from the messages the window has cached,
+    //it is called before the client is moved to its thread
+    void setWatermarks(const QHash<int, int> &watermarks);
+
+    //the next response is the history page of the chat, an error included
+    void expectHistory(int chatID);
+
 public slots:
     void sendData(QByteArray);
 
@@ -28,12 +42,27 @@ signals:
     void updChatList(QJsonArray);
     void updNewestMessages(size_t chatID,
                            QJsonArray messages);
-    void gotReply();
+    void updHistory(size_t chatID,
+                    int errorCode,
+                    QJsonArray messages);
+    void gotEvent(QJsonObject);
+    void throttled(qint64 retryAfterMs);
+    void connectionLost();
+
+    //changed is false if the response brought nothing new
+    void gotReply(int errorCode, bool changed);
 
 private:
     QTcpSocket *socket;
     AsyncClientManager *manager;
     quint16 hostPort;
+    QByteArray in;
+    QJsonArray lastChatList;
+    QHash<size_t, int> lastMessageIDs;
+    int historyChatID = -1;
+
+    void handleResponse(const QJsonObject &response);
+
     enum apiErrorCode
     {
         NULL_ERROR, // no errors
@@ -60,7 +89,12 @@ private:
         NO_CHAT_VISIBILITY,
         NO_CHAT_NAME,
         NO_CHAT_MEMBERS,
-        UNKNOWN_ERROR
+        UNKNOWN_ERROR,
+        RATE_LIMIT_EXCEEDED,
+        QUERY_IS_TOO_BIG,
+        SERVER_IS_BUSY,
+        READ_ONLY_REPLICA,
+        ACCESS_DENIED
     };
 };
 
@@ -1,14 +1,34 @@
 #include "asyncclientmanager.h"
 #include "asyncclient.h"
+#include "apiprotocol.h"
 
-AsyncClientManager::AsyncClientManager(AsyncClient *client)
+AsyncClientManager::AsyncClientManager(AsyncClient *client):
+    reconnectBackoff(AsyncClientManager::minReconnectDelay,
+                     AsyncClientManager::maxReconnectDelay)
 {
     this->client = client;
+    this->pollInterval = AsyncClientManager::minPollInterval;
+
+    //a child timer moves to the io thread together with the manager
+    this->pollTimer = new QTimer(this);
+    this->pollTimer->setSingleShot(true);
+    connect(this->pollTimer, SIGNAL(timeout()),
+            this,            SLOT(slotPoll()));
+
     connect(this,         SIGNAL(sendDataFromClient(QByteArray)),
             this->client, SLOT(sendData(QByteArray)));
 
-    connect(this->client, SIGNAL(gotReply()),
-            this,         SLOT(slotStart()));
+    connect(this->client, SIGNAL(gotReply(int, bool)),
+            this,         SLOT(slotGotReply(int, bool)));
+
+    connect(this->client, SIGNAL(gotEvent(QJsonObject)),
+            this,         SLOT(slotGotEvent(QJsonObject)));
+
+    connect(this->client, SIGNAL(throttled(qint64)),
+            this,         SLOT(slotThrottled(qint64)));
+
+    connect(this->client, SIGNAL(connectionLost()),
+            this,         SLOT(slotConnectionLost()));
 }
 
 AsyncClientManager::~AsyncClientManager()
@@ -16,64 +36,232 @@ AsyncClientManager::~AsyncClientManager()
 
 }
 
+bool AsyncClientManager::loadToken()
+{
+    //the token is read once per start instead of before every query
+    QFile tokenFile("token");
+    if (!tokenFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "Unable to open file with tokens";
+        return false;
+    }
+    this->token = tokenFile.readAll();
+    tokenFile.close();
+    return !this->token.isEmpty();
+}
+
 void AsyncClientManager::start()
 {
     this->isWorking = true;
-    this->slotStart();
+    this->loadToken();
+    this->pollInterval = AsyncClientManager::minPollInterval;
+    this->pollNow();
+}
+
+void AsyncClientManager::pause()
+{
+    this->isWorking = false;
+    this->pollTimer->stop();
+}
+
+void AsyncClientManager::stop()
+{
+    this->pause();
+    emit stopped();
 }
 
 void AsyncClientManager::slotSetCurrentChatID(int chatID)
 {
     this->currentChatID = chatID;
+    this->pollInterval = AsyncClientManager::minPollInterval;
+    this->pollNow();
 }
 
-void AsyncClientManager::slotStart()
+void AsyncClientManager::addPendingMessage(QString messageText)
+{
+    qDebug() << "Message added";
+    this->pendingMessages[this->currentChatID].enqueue(messageText);
+    this->pollNow();
+}
+
+void AsyncClientManager::requestHistory(int chatID, int beforeMessageID, int messagesNum)
+{
+    this->hasPendingHistory = true;
+    this->historyChatID = chatID;
+    this->historyBeforeID = beforeMessageID;
+    this->historyMessagesNum = messagesNum;
+    this->pollNow();
+}
+
+void AsyncClientManager::pollNow()
+{
+    //one query at a time, the poll follows the reply in flight.
+    //a pending reconnect is not hurried, the queries wait for it
+    if (this->isReconnecting && this->pollTimer->isActive())
+        return;
+    if (this->isWaitingReply)
+    {
+        this->isPollRequested = true;
+        return;
+    }
+    this->pollTimer->stop();
+    this->slotPoll();
+}
+
+void AsyncClientManager::schedulePoll()
 {
     if (!this->isWorking)
         return;
-    //getting user info & verifying token
-    //add feature if token is incorrect then
-    //open dialog with error and send to auth screen
-    QFile tokenFile("token");
-    if (!tokenFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    this->pollTimer->start(qMax<qint64>(this->pollInterval, this->retryAfterMs));
+    this->retryAfterMs = 0;
+}
+
+void AsyncClientManager::slotPoll()
+{
+    if (!this->isWorking || this->isWaitingReply)
+        return;
+    if (this->token.isEmpty() && !this->loadToken())
+        return;
+
+    this->isWaitingReply = true;
+    if (!this->isSubscribed && !this->isSubscriptionRejected)
     {
-        qDebug() << "Unable to open file with tokens";
+        QHash<int, int> watermarks = this->client->watermarks();
+        if (this->currentChatID >= 0 && !watermarks.contains(this->currentChatID))
+            watermarks.insert(this->currentChatID, -1);
+
+        this->isSubscribing = true;
+        emit sendDataFromClient(ApiProtocol::resumeSession(this->token, watermarks));
         return;
     }
-    QString token = tokenFile.readAll();
-    tokenFile.close();
-    QJsonObject query;
-    query.insert("method", "user.getmyinfo");
-    QJsonObject params;
-    params.insert("access_token", QJsonValue::fromVariant(token));
-    params.insert("current_chat_id", QJsonValue::fromVariant(this->currentChatID));
-    params.insert("messages_num", QJsonValue::fromVariant(AsyncClientManager::latestMessagesNum));
+
+    //the page the user scrolls to goes before the regular poll
+    if (this->hasPendingHistory)
+    {
+        this->hasPendingHistory = false;
+        this->isHistoryInFlight = true;
+        this->client->expectHistory(this->historyChatID);
+        emit sendDataFromClient(ApiProtocol::getHistory(this->token, this->historyChatID,
+                                                        this->historyBeforeID, this->historyMessagesNum));
+        return;
+    }
+
+    QByteArray query;
     if (!this->pendingMessages.empty())
     {
-        size_t chatID = this->pendingMessages.keys().first();
+        int chatID = this->pendingMessages.keys().first();
         QString messageText = this->pendingMessages[chatID].dequeue();
 
         if (this->pendingMessages[chatID].empty())
             this->pendingMessages.remove(chatID);
 
-        QJsonObject messageToSend;
-        messageToSend.insert("text", QJsonValue::fromVariant(messageText));
-        messageToSend.insert("chat_id", QJsonValue::fromVariant(chatID));
-        params.insert("message_to_send", QJsonValue::fromVariant(messageToSend));
+        this->hasMessageInFlight = true;
+        this->messageInFlight = qMakePair(chatID, messageText);
+        query = ApiProtocol::getMyInfo(this->token, this->currentChatID, AsyncClientManager::latestMessagesNum,
+                                       chatID, messageText, this->client->watermark(this->currentChatID));
     }
-    query.insert("params", QJsonValue::fromVariant(params));
+    else
+        query = ApiProtocol::getMyInfo(this->token, this->currentChatID, AsyncClientManager::latestMessagesNum,
+                                       this->client->watermark(this->currentChatID));
     //qDebug() << query;
-    emit sendDataFromClient(QJsonDocument(query).toJson());
-    QThread::msleep(100);
+    emit sendDataFromClient(query);
 }
 
-void AsyncClientManager::stop()
+void AsyncClientManager::slotGotReply(int errorCode, bool changed)
 {
-    this->isWorking = false;
+    this->isWaitingReply = false;
+    if (this->isSubscribing)
+    {
+        //a throttled subscription is retried, a rejected one is not
+        this->isSubscribing = false;
+        this->isSubscribed = errorCode == 0;
+        this->isSubscriptionRejected = errorCode != 0 && this->retryAfterMs == 0;
+
+        //the server answered, the next loss starts the backoff over
+        this->isReconnecting = false;
+        this->reconnectBackoff.reset();
+
+        //the resumed session brought the chat list and the missed
+        //messages, so only the messages written meanwhile are sent
+        //right away. without it everything is fetched by a poll
+        this->isPollRequested = !this->isSubscribed || !this->pendingMessages.empty();
+    }
+    else if (this->isHistoryInFlight)
+    {
+        //the regular polling goes on as it was
+        this->isHistoryInFlight = false;
+    }
+    else
+    {
+        this->hasMessageInFlight = false;
+        const int maxInterval = this->isSubscribed ? AsyncClientManager::maxPollInterval
+                                                   : AsyncClientManager::maxPollIntervalWithoutEvents;
+        if (changed || !this->pendingMessages.empty())
+            this->pollInterval = AsyncClientManager::minPollInterval;
+        else
+            this->pollInterval = qMin(this->pollInterval * 2, maxInterval);
+    }
+
+    if ((this->isPollRequested || this->hasPendingHistory) && this->retryAfterMs == 0)
+    {
+        this->isPollRequested = false;
+        this->slotPoll();
+    }
+    else
+        this->schedulePoll();
 }
 
-void AsyncClientManager::addPendingMessage(QString messageText)
+void AsyncClientManager::slotGotEvent(QJsonObject event)
 {
-    qDebug() << "Message added";
-    this->pendingMessages[this->currentChatID].enqueue(messageText);
+    //the event only says something changed, the poll fetches it
+    if (event["event"].toString() == "message.new")
+    {
+        this->pollInterval = AsyncClientManager::minPollInterval;
+        this->pollNow();
+    }
+}
+
+void AsyncClientManager::requeueMessageInFlight()
+{
+    if (!this->hasMessageInFlight)
+        return;
+    this->hasMessageInFlight = false;
+    this->pendingMessages[this->messageInFlight.first].prepend(this->messageInFlight.second);
+}
+
+void AsyncClientManager::requeueHistoryInFlight()
+{
+    //the flag is cleared by the reply, or by the loss of the connection
+    if (this->isHistoryInFlight)
+        this->hasPendingHistory = true;
+}
+
+void AsyncClientManager::slotThrottled(qint64 retryAfterMs)
+{
+    //the server didnt handle the query, its message is sent again
+    this->requeueMessageInFlight();
+    this->requeueHistoryInFlight();
+    this->retryAfterMs = retryAfterMs > 0 ? retryAfterMs : qMin(this->pollInterval * 2, AsyncClientManager::maxPollInterval);
+    this->isPollRequested = false;
+}
+
+void AsyncClientManager::slotConnectionLost()
+{
+    //the subscription belonged to the lost connection, the next
+    //poll reconnects and resumes it after a randomized delay, so
+    //the clients of a restarted server dont come back all at once
+    this->requeueMessageInFlight();
+    this->requeueHistoryInFlight();
+    this->isHistoryInFlight = false;
+    this->isWaitingReply = false;
+    this->isSubscribing = false;
+    this->isSubscribed = false;
+    this->isSubscriptionRejected = false;
+    this->isPollRequested = false;
+    this->isReconnecting = true;
+    this->pollTimer->stop();
+    if (!this->isWorking)
+        return;
+    this->pollTimer->start(qMax<qint64>(this->reconnectBackoff.nextDelay(), this->retryAfterMs));
+    this->retryAfterMs = 0;
 }
@@ -4,9 +4,16 @@
 #include <QtCore>
 #include <QTcpSocket>
 #include <QTcpServer>
+#include "reconnectbackoff.h"
 
 class AsyncClient;
 
+//keeps the chat window up to date from the io thread: the connection
+//is subscribed to the events of the server, which trigger a refresh,
+//and polling backs off while nothing changes, so an idle client
+//sends a query every few seconds at most. a lost connection is
+//reestablished after a randomized backoff and resumed from the
+//last messages the client has, instead of refetching everything
 class AsyncClientManager: public QObject
 {
     Q_OBJECT
@@ -16,12 +23,19 @@ public:
 
 public slots:
     void start();
+    //pause keeps the connection for a later start, stop is final
+    void pause();
     void stop();
     void slotSetCurrentChatID(int);
     void addPendingMessage(QString);
+    void requestHistory(int chatID, int beforeMessageID, int messagesNum);
 
 private slots:
-    void slotStart();
+    void slotPoll();
+    void slotGotReply(int errorCode, bool changed);
+    void slotGotEvent(QJsonObject);
+    void slotThrottled(qint64 retryAfterMs);
+    void slotConnectionLost();
 
 signals:
     void stopped();
@@ -29,10 +43,50 @@ signals:
 
 private:
     AsyncClient *client;
+    QTimer *pollTimer;
     bool isWorking = false;
+    bool isWaitingReply = false;
+    bool isPollRequested = false;
+    bool isSubscribing = false;
+    bool isSubscribed = false;
+    bool isSubscriptionRejected = false;
+    bool isReconnecting = false;
     int currentChatID = -1;
-    static const unsigned latestMessagesNum = 200;
+    int pollInterval;
+    qint64 retryAfterMs = 0;
+    QString token;
     QMap<int, QQueue<QString>> pendingMessages;
+    bool hasMessageInFlight = false;
+    QPair<int, QString> messageInFlight;
+
+    //one page of the history at a time, a newer request replaces
+    //the one not sent yet
+    bool hasPendingHistory = false;
+    bool isHistoryInFlight = false;
+    int historyChatID;
+    int historyBeforeID;
+    int historyMessagesNum;
+    ReconnectBackoff reconnectBackoff;
+
+    static const unsigned latestMessagesNum = 200;
+
+    //milliseconds between polls, doubled after every poll which
+    //brought nothing new. without events the chat window relies on
+    //polling only, so the interval is kept shorter
+    static const int minPollInterval = 250;
+    static const int maxPollInterval = 30000;
+    static const int maxPollIntervalWithoutEvents = 4000;
+
+    //bounds of the delay before a reconnect, the first one is below
+    //a second and the window doubles with every failed attempt
+    static const int minReconnectDelay = 1000;
+    static const int maxReconnectDelay = 60000;
+
+    void pollNow();
+    void schedulePoll();
+    void requeueMessageInFlight();
+    void requeueHistoryInFlight();
+    bool loadToken();
 };
 
 #endif // ASYNCCLIENTMANAGER_H
@@ -9,21 +9,33 @@ CONFIG += c++11
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    apiprotocol.cpp \
     asyncclient.cpp \
     asyncclientmanager.cpp \
     chatcreationdialog.cpp \
+    chatlistmodel.cpp \
     chatwindow.cpp \
     client.cpp \
+    localcache.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    messagedelegate.cpp \
+    messagelistmodel.cpp \
+    reconnectbackoff.cpp
 
 HEADERS += \
+    apiprotocol.h \
     asyncclient.h \
     asyncclientmanager.h \
     chatcreationdialog.h \
+    chatlistmodel.h \
     chatwindow.h \
     client.h \
-    mainwindow.h
+    localcache.h \
+    mainwindow.h \
+    messagedelegate.h \
+    messagelistmodel.h \
+    reconnectbackoff.h
 
 FORMS += \
     chatcreationdialog.ui \
@@ -2,6 +2,7 @@
 #include "ui_chatcreationdialog.h"
 #include "chatwindow.h"
 #include "ui_chatwindow.h"
+#include "apiprotocol.h"
 
 ChatCreationDialog::ChatCreationDialog(QWidget *parent) :
     QDialog(parent),
@@ -98,15 +99,8 @@ void ChatCreationDialog::on_pushButtonOK_released()
     accessToken = tokenFile.readAll();
     tokenFile.close();
 
-    QJsonObject query, params;
-    query.insert("method", "chat.create");
-    params.insert("name", QJsonValue::fromVariant(chatName));
-    params.insert("members", QJsonValue::fromVariant(chatMembers));
-    params.insert("is_visible", QJsonValue::fromVariant(true)); //add visibility specifying later
-    params.insert("access_token", QJsonValue::fromVariant(accessToken));
-    query.insert("params", params);
-
-    emit sendDataFromClient(QJsonDocument(query).toJson());
+    //add visibility specifying later
+    emit sendDataFromClient(ApiProtocol::createChat(accessToken, chatName, chatMembers, true));
 }
 
 void ChatCreationDialog::slotSetErrorLabelText(QString text)
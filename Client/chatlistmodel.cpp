@@ -0,0 +1,112 @@
+#include "chatlistmodel.h"
+
+ChatListModel::ChatListModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+
+}
+
+void ChatListModel::updateRows(const int &from)
+{
+    for (int i = from; i < this->chats.size(); ++i)
+        this->rows[this->chats[i].id] = i;
+}
+
+void ChatListModel::setChats(const QJsonArray &chats)
+{
+    QVector<Chat> newChats;
+    QSet<int> newIDs;
+    newChats.reserve(chats.size());
+    for (QJsonValue i: chats)
+    {
+        Chat chat = {i["id"].toInt(), i["name"].toString()};
+        //a chat listed twice is shown once
+        if (newIDs.contains(chat.id))
+            continue;
+        newIDs.insert(chat.id);
+        newChats.append(chat);
+    }
+
+    //the chats the user left, from the end so the rows stay valid
+    for (int i = this->chats.size() - 1; i >= 0; --i)
+    {
+        if (newIDs.contains(this->chats[i].id))
+            continue;
+        this->beginRemoveRows(QModelIndex(), i, i);
+        this->rows.remove(this->chats[i].id);
+        this->chats.remove(i);
+        this->endRemoveRows();
+        this->updateRows(i);
+    }
+
+    //now every chat left is in the new list, they are put in its order
+    for (int i = 0; i < newChats.size(); ++i)
+    {
+        const Chat &chat = newChats[i];
+        const int currentRow = this->row(chat.id);
+        if (currentRow == -1)
+        {
+            this->beginInsertRows(QModelIndex(), i, i);
+            this->chats.insert(i, chat);
+            this->endInsertRows();
+            this->updateRows(i);
+            continue;
+        }
+
+        if (currentRow != i)
+        {
+            //the rows before i are already in place, so the chat comes from below
+            this->beginMoveRows(QModelIndex(), currentRow, currentRow, QModelIndex(), i);
+            this->chats.move(currentRow, i);
+            this->endMoveRows();
+            this->updateRows(i);
+        }
+
+        if (this->chats[i].name != chat.name)
+        {
+            this->chats[i].name = chat.name;
+            emit dataChanged(this->index(i), this->index(i));
+        }
+    }
+}
+
+int ChatListModel::row(const int &chatID) const
+{
+    return this->rows.value(chatID, -1);
+}
+
+int ChatListModel::chatID(const int &row) const
+{
+    return row >= 0 && row < this->chats.size() ? this->chats[row].id : -1;
+}
+
+QString ChatListModel::name(const int &chatID) const
+{
+    const int row = this->row(chatID);
+    return row == -1 ? QString() : this->chats[row].name;
+}
+
+int ChatListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : this->chats.size();
+}
+
+QVariant ChatListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= this->chats.size())
+        return QVariant();
+
+    const Chat &chat = this->chats[index.row()];
+    switch (role)
+    {
+    case Qt::DisplayRole:
+    case Qt::ToolTipRole:
+        return chat.name;
+
+    case ChatIDRole:
+        return chat.id;
+
+    default:
+        return QVariant();
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef CHATLISTMODEL_H
+#define CHATLISTMODEL_H
+
+#include <QtCore>
+
+//chats of the user keyed by their ids. a new list from the server is
+//applied as removes, moves, inserts and renames of single rows, so
+//the view keeps its selection and redraws only what changed
+class ChatListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Role
+    {
+        ChatIDRole = Qt::UserRole + 1
+    };
+
+    explicit ChatListModel(QObject *parent = nullptr);
+
+    //the chat list as the server sends it, [{"id": .., "name": ..}, ...]
+    void setChats(const QJsonArray &chats);
+
+    //-1 if the user is not in the chat
+    int row(const int &chatID) const;
+    int chatID(const int &row) const;
+    QString name(const int &chatID) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    struct Chat
+    {
+        int     id;
+        QString name;
+    };
+
+    QVector<Chat> chats;
+    QHash<int, int> rows;
+
+    //rows of the chats from the given one to the end are renumbered
+    void updateRows(const int &from);
+};
+
+#endif // CHATLISTMODEL_H
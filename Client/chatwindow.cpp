@@ -1,20 +1,39 @@
 #include "chatwindow.h"
 #include "ui_chatwindow.h"
 #include "chatcreationdialog.h"
+#include "messagedelegate.h"
 
 ChatWindow::ChatWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::ChatWindow)
+    ui(new Ui::ChatWindow),
+    cache("cache")
 {
     ui->setupUi(this);
-    connect(this->ui->listWidgetChats, SIGNAL(itemActivated(QListWidgetItem*)),
-            this,                      SLOT(openChat(QListWidgetItem*)));
+    this->chatsModel = new ChatListModel(this);
+    this->ui->listViewChats->setModel(this->chatsModel);
+    connect(this->ui->listViewChats, SIGNAL(activated(QModelIndex)),
+            this,                    SLOT(openChat(QModelIndex)));
 
-    //setting up tcp client manager
-    //in a seperate thread
+    this->messagesModel = new MessageListModel(this);
+    this->messagesModel->setOwner(this->cache.owner());
+    this->ui->listViewMessages->setModel(this->messagesModel);
+    this->ui->listViewMessages->setItemDelegate(new MessageDelegate(this->ui->listViewMessages));
+    connect(this->ui->listViewMessages->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this,                                            SLOT(slotMessagesScrolled()));
+
+    //setting up tcp client and its manager
+    //in a seperate io thread
     //in order not to freeze main thread
     client = new AsyncClient(9999);
 
+    //the cached chats are drawn before the server answers,
+    //which is then only asked for the newer messages
+    client->setWatermarks(this->cache.watermarks());
+    this->slotUpdChatList(this->cache.chatList());
+
+    //the updates cross threads, so their argument types are queued
+    qRegisterMetaType<size_t>("size_t");
+
     connect(client, SIGNAL(updUsername(QString)),
             this,   SLOT(slotUpdUsername(QString)));
 
@@ -24,123 +43,207 @@ ChatWindow::ChatWindow(QWidget *parent) :
     connect(client, SIGNAL(updNewestMessages(size_t, QJsonArray)),
             this,   SLOT(slotUpdNewestMessages(size_t, QJsonArray)));
 
+    connect(client, SIGNAL(updHistory(size_t, int, QJsonArray)),
+            this,   SLOT(slotUpdHistory(size_t, int, QJsonArray)));
+
     clientManager = new AsyncClientManager(client);
-    QThread *thread = new QThread;
+    thread = new QThread;
+    client->moveToThread(thread);
     clientManager->moveToThread(thread);
 
+    //the manager lives on the io thread,
+    //so it is only driven through queued signals
     connect(thread,        SIGNAL(started()),
             clientManager, SLOT(start()));
 
-    connect(clientManager, SIGNAL(stopped()),
-            thread,        SLOT(quit()));
+    connect(this,          SIGNAL(startClientManager()),
+            clientManager, SLOT(start()));
+
+    connect(this,          SIGNAL(sendMessage(QString)),
+            clientManager, SLOT(addPendingMessage(QString)));
 
+    connect(this,          SIGNAL(pauseClientManager()),
+            clientManager, SLOT(pause()));
+
+    //waits until the manager has stopped, the destructor
+    //then stops the thread with nothing running on it
     connect(this,          SIGNAL(stopClientManager()),
-            clientManager, SLOT(stop()));
+            clientManager, SLOT(stop()),
+            Qt::BlockingQueuedConnection);
 
     connect(this,          SIGNAL(setCurrentChatID(int)),
             clientManager, SLOT(slotSetCurrentChatID(int)));
 
+    connect(this,          SIGNAL(requestHistory(int, int, int)),
+            clientManager, SLOT(requestHistory(int, int, int)));
+
+    //deleted on the io thread when it finishes, the socket with them
     connect(clientManager, SIGNAL(stopped()),
             clientManager, SLOT(deleteLater()));
 
-    connect(thread,        SIGNAL(finished()),
-            thread,        SLOT(deleteLater()));
+    connect(clientManager, SIGNAL(stopped()),
+            client,        SLOT(deleteLater()));
 
     thread->start();
 }
 
 ChatWindow::~ChatWindow()
 {
+    emit stopClientManager();
+    this->thread->quit();
+    this->thread->wait();
+    delete this->thread;
     delete ui;
-    client->deleteLater();
 }
 
 void ChatWindow::slotUpdUsername(QString username)
 {
-    this->ui->labelUsername->setText(username);
+    this->ui->labelUsername->setText("You're logged in as " + username);
+
+    //a cache written before its owner was known
+    if (this->cache.owner().isEmpty())
+        this->cache.setOwner(username);
+    this->messagesModel->setOwner(this->cache.owner());
 }
 
 void ChatWindow::slotUpdChatList(QJsonArray arr)
 {
-    if (arr == this->chats)
-        return;
-
-    qDebug() << "ChatList updated";
-
-    this->chats = arr;
-    this->ui->listWidgetChats->blockSignals(true);
-    this->ui->listWidgetChats->clear();
-    this->ui->listWidgetChats->blockSignals(false);
-    for (QJsonValue i: this->chats)
-        this->ui->listWidgetChats->addItem(i["name"].toString());
-}
+    //only the chats that changed are touched, the selection stays
+    this->chatsModel->setChats(arr);
+    this->cache.setChatList(arr);
 
-int ChatWindow::getChatIDByName(const QString &name)
-{
-    for (QJsonValue i: this->chats)
-        if (i["name"].toString() == name)
-            return i["id"].toInt();
-    return -1;
+    if (this->currentChatID != -1 && this->chatsModel->row(this->currentChatID) != -1)
+        this->ui->labelChatName->setText(this->chatsModel->name(this->currentChatID));
 }
 
-void ChatWindow::openChat(QListWidgetItem *current)
+void ChatWindow::openChat(QModelIndex current)
 {
-    int chatID = this->getChatIDByName(current->text());
+    int chatID = this->chatsModel->chatID(current.row());
 
     if (chatID == -1)
         return;
-    this->ui->listWidgetMessages->blockSignals(true);
-    this->ui->listWidgetMessages->clear();
-    this->ui->listWidgetMessages->blockSignals(false);
     this->ui->lineEditMessage->setEnabled(true);
-    this->ui->labelChatName->setText(current->text());
+    this->ui->labelChatName->setText(this->chatsModel->name(chatID));
 
-    this->messagesInChats[chatID] = QJsonArray();
+    //only the newest page is loaded, older ones follow as the user scrolls up
+    this->messagesModel->setMessages(this->cache.messages(chatID, -1, ChatWindow::historyPageSize));
+    this->ui->listViewMessages->scrollToBottom();
+
+    this->currentChatID = chatID;
+    this->isLoadingHistory = false;
+    this->isHistoryComplete = false;
     emit setCurrentChatID(chatID);
+    this->prefetchHistory();
 }
 
 void ChatWindow::slotUpdNewestMessages(size_t chatID, QJsonArray latestMessages)
 {
-    //getting actual info to data
-    int rightOffset = latestMessages.size();
-    if (this->messagesInChats[chatID].size() != 0)
+    //every chat is cached, only the open one is drawn
+    bool isRestarted;
+    QJsonArray appended = this->cache.appendMessages(chatID, latestMessages, isRestarted);
+    if (static_cast<int>(chatID) != this->currentChatID || appended.isEmpty())
+        return;
+
+    QScrollBar *scrollbar = this->ui->listViewMessages->verticalScrollBar();
+    bool scrollDown = scrollbar->value() == scrollbar->maximum(); //the slider is at the end
+
+    //a restarted log holds only the new messages
+    if (isRestarted)
     {
-        int serverLastMessageID = latestMessages.last().toObject()["id"].toInt();
-        int localLastMessageID  = this->messagesInChats[chatID].last().toObject()["id"].toInt();
+        this->messagesModel->setMessages(appended);
+        this->isHistoryComplete = false;
+    }
+    else
+        this->messagesModel->appendMessages(appended);
 
-        rightOffset = serverLastMessageID - localLastMessageID;
+    if (scrollDown)
+        this->ui->listViewMessages->scrollToBottom();
+    this->prefetchHistory();
+}
+
+void ChatWindow::prefetchHistory()
+{
+    if (this->currentChatID == -1 || this->isLoadingHistory || this->isHistoryComplete)
+        return;
+
+    //the newest messages are not here yet, the history follows them
+    const int firstMessageID = this->messagesModel->firstMessageID();
+    if (firstMessageID <= 0)
+    {
+        this->isHistoryComplete = firstMessageID == 0;
+        return;
     }
-    bool scrollDown = false;
-    if (rightOffset != 0) //got any elements to add
+
+    QModelIndex top = this->ui->listViewMessages->indexAt(QPoint(0, 0));
+    if (top.isValid() && top.row() >= ChatWindow::historyPageSize)
+        return;
+
+    //the cache is read first, the server is asked once it runs out
+    QJsonArray cachedMessages = this->cache.messages(this->currentChatID, firstMessageID, ChatWindow::historyPageSize);
+    if (!cachedMessages.isEmpty() && cachedMessages.last().toObject()["id"].toInt() == firstMessageID - 1)
     {
-        QScrollBar *scrollbar = this->ui->listWidgetMessages->verticalScrollBar();
-        if (scrollbar->value() == scrollbar->maximum()) //the slider is at the end
-            scrollDown = true;
+        this->prependHistory(cachedMessages);
+        this->prefetchHistory();
+        return;
     }
-    for (int i = latestMessages.size() - rightOffset; i < latestMessages.size(); ++i)
+
+    this->isLoadingHistory = true;
+    emit requestHistory(this->currentChatID, firstMessageID, ChatWindow::historyPageSize);
+}
+
+void ChatWindow::prependHistory(const QJsonArray &olderMessages)
+{
+    //the rows are inserted above, the ones in sight stay where they are
+    QScrollBar *scrollbar = this->ui->listViewMessages->verticalScrollBar();
+    const int maximum = scrollbar->maximum(),
+              value = scrollbar->value();
+    this->messagesModel->prependMessages(olderMessages);
+    this->ui->listViewMessages->doItemsLayout();
+    scrollbar->setValue(value + scrollbar->maximum() - maximum);
+
+    this->isHistoryComplete = olderMessages.first().toObject()["id"].toInt() == 0;
+}
+
+void ChatWindow::slotMessagesScrolled()
+{
+    this->prefetchHistory();
+}
+
+void ChatWindow::slotUpdHistory(size_t chatID, int errorCode, QJsonArray olderMessages)
+{
+    //a page of a chat which is not open anymore
+    if (static_cast<int>(chatID) != this->currentChatID)
+        return;
+    this->isLoadingHistory = false;
+
+    //a page refused, e.g. after the user was kicked from the chat,
+    //is asked for again when the user scrolls
+    if (errorCode != 0)
+        return;
+
+    if (olderMessages.isEmpty())
     {
-        this->messagesInChats[chatID].append(latestMessages[i]);
-
-        QString messageSender = latestMessages[i].toObject()["sender_username"].toString();
-        if (latestMessages[i].toObject()["type"] != QJsonValue::Null)
-            messageSender = "SystemBot";
-
-        if (this->ui->labelUsername->text().endsWith(messageSender))
-            messageSender = "You";
-        this->ui->listWidgetMessages->addItem(QStringLiteral("<%1> %2: %3")
-                                              .arg(latestMessages[i].toObject()["date"].toString())
-                                              .arg(messageSender)
-                                              .arg(latestMessages[i].toObject()["text"].toString()));
+        this->isHistoryComplete = true;
+        return;
     }
-    if (scrollDown)
-        this->ui->listWidgetMessages->scrollToBottom();
+
+    //a page which doesnt end right above the loaded messages is a stale one,
+    //the right one is asked for instead
+    if (olderMessages.last().toObject()["id"].toInt() != this->messagesModel->firstMessageID() - 1)
+    {
+        this->prefetchHistory();
+        return;
+    }
+
+    this->prependHistory(olderMessages);
+    this->prefetchHistory();
 }
 
 void ChatWindow::on_pushButtonSendMessage_released()
 {
     QString messageText = this->ui->lineEditMessage->text();
     this->ui->lineEditMessage->clear();
-    this->clientManager->addPendingMessage(messageText);
+    emit sendMessage(messageText);
 }
 
 void ChatWindow::on_lineEditMessage_textChanged(const QString &arg1)
@@ -150,9 +253,9 @@ void ChatWindow::on_lineEditMessage_textChanged(const QString &arg1)
 
 void ChatWindow::on_actionCreate_triggered()
 {
-    this->clientManager->stop();
+    emit pauseClientManager();
     ChatCreationDialog ccdialog(this);
     ccdialog.setModal(true);
     ccdialog.exec();
-    this->clientManager->start();
+    emit startClientManager();
 }
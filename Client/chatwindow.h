@@ -3,6 +3,9 @@
 
 #include "asyncclient.h"
 #include "asyncclientmanager.h"
+#include "localcache.h"
+#include "messagelistmodel.h"
+#include "chatlistmodel.h"
 #include <QMainWindow>
 #include <QtWidgets>
 
@@ -25,16 +28,28 @@ private:
     Ui::ChatWindow *ui;
     AsyncClient *client;
     AsyncClientManager *clientManager;
-    QJsonArray chats;
-    QMap<size_t, QJsonArray> messagesInChats;
+    QThread *thread;
+    ChatListModel *chatsModel;
+    LocalCache cache;
+    MessageListModel *messagesModel;
+    int currentChatID = -1;
 
-    int getChatIDByName(const QString&);
+    //the history older than the loaded messages is fetched page by page
+    //while the user scrolls up, a page ahead of the rows in sight
+    bool isLoadingHistory = false;
+    bool isHistoryComplete = false;
+    static const int historyPageSize = 100;
+
+    void prefetchHistory();
+    void prependHistory(const QJsonArray &olderMessages);
 
 private slots:
     void slotUpdUsername(QString);
     void slotUpdChatList(QJsonArray);
-    void openChat(QListWidgetItem*);
+    void openChat(QModelIndex);
     void slotUpdNewestMessages(size_t, QJsonArray);
+    void slotUpdHistory(size_t, int, QJsonArray);
+    void slotMessagesScrolled();
 
     void on_pushButtonSendMessage_released();
 
@@ -44,9 +59,11 @@ private slots:
 
 signals:
     void stopClientManager();
+    void pauseClientManager();
     void startClientManager();
     void sendMessage(QString);
     void setCurrentChatID(int);
+    void requestHistory(int chatID, int beforeMessageID, int messagesNum);
 };
 
 #endif // CHATWINDOW_H
@@ -57,7 +57,12 @@ private:
         NO_CHAT_VISIBILITY,
         NO_CHAT_NAME,
         NO_CHAT_MEMBERS,
-        UNKNOWN_ERROR
+        UNKNOWN_ERROR,
+        RATE_LIMIT_EXCEEDED,
+        QUERY_IS_TOO_BIG,
+        SERVER_IS_BUSY,
+        READ_ONLY_REPLICA,
+        ACCESS_DENIED
     };
 };
 
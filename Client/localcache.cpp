@@ -0,0 +1,215 @@
+#include "localcache.h"
+
+LocalCache::LocalCache(const QString &path)
+{
+    this->dir = QDir(path);
+    this->dir.mkpath("chats");
+
+    QFile indexFile(this->dir.filePath("chats.json"));
+    if (!indexFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        return;
+    QJsonObject index = QJsonDocument::fromJson(indexFile.readAll()).object();
+    indexFile.close();
+
+    this->username = index["owner"].toString();
+    this->chats = index["chats"].toArray();
+    QJsonObject watermarks = index["watermarks"].toObject();
+    for (auto i = watermarks.constBegin(); i != watermarks.constEnd(); ++i)
+        this->lastMessageIDs.insert(i.key().toInt(), i.value().toInt());
+}
+
+QString LocalCache::owner() const
+{
+    return this->username;
+}
+
+void LocalCache::setOwner(const QString &username)
+{
+    if (username == this->username)
+        return;
+    this->clear();
+    this->username = username;
+    this->saveIndex();
+}
+
+QJsonArray LocalCache::chatList() const
+{
+    return this->chats;
+}
+
+void LocalCache::setChatList(const QJsonArray &chatList)
+{
+    if (chatList == this->chats)
+        return;
+    this->chats = chatList;
+    this->saveIndex();
+}
+
+QString LocalCache::logPath(const size_t &chatID) const
+{
+    return this->dir.filePath(QStringLiteral("chats/%1.log").arg(chatID));
+}
+
+QJsonArray LocalCache::messages(const size_t &chatID, const int &beforeMessageID, const int &messagesNum)
+{
+    QFile logFile(this->logPath(chatID));
+    if (!logFile.open(QIODevice::ReadOnly))
+        return QJsonArray();
+
+    qint64 pos = logFile.size();
+    auto pageStart = this->pageStarts.constFind(chatID);
+    if (beforeMessageID >= 0 && pageStart != this->pageStarts.constEnd() && pageStart->first == beforeMessageID)
+        pos = pageStart->second;
+
+    //lines are taken from the end of the buffer, which is filled
+    //backwards by chunks until it holds the start of the last line
+    QByteArray buffer;
+    QVector<QJsonObject> newestFirst;
+    qint64 firstLineStart = pos;
+    while (newestFirst.size() < messagesNum)
+    {
+        const int lineStart = buffer.size() > 1 ? buffer.lastIndexOf('\n', buffer.size() - 2) + 1 : 0;
+        if (lineStart == 0 && pos > 0)
+        {
+            const qint64 chunkSize = qMin(pos, LocalCache::readChunkSize);
+            pos -= chunkSize;
+            logFile.seek(pos);
+            buffer.prepend(logFile.read(chunkSize));
+            continue;
+        }
+        if (buffer.isEmpty())
+            break;
+
+        //a line cut by a crash in the middle of a write is skipped
+        QJsonObject message = QJsonDocument::fromJson(buffer.mid(lineStart)).object();
+        buffer.truncate(lineStart);
+        if (!message.isEmpty() && (beforeMessageID < 0 || message["id"].toInt() < beforeMessageID))
+        {
+            newestFirst.append(message);
+            firstLineStart = pos + lineStart;
+        }
+    }
+    logFile.close();
+
+    QJsonArray messages;
+    for (int i = newestFirst.size() - 1; i >= 0; --i)
+        messages.append(newestFirst[i]);
+    if (!messages.isEmpty())
+        this->pageStarts.insert(chatID, qMakePair(messages.first().toObject()["id"].toInt(), firstLineStart));
+    return messages;
+}
+
+QJsonArray LocalCache::appendMessages(const size_t &chatID, const QJsonArray &messages, bool &isRestarted)
+{
+    isRestarted = false;
+    const int lastMessageID = this->lastMessageIDs.value(chatID, -1);
+
+    QJsonArray appended;
+    for (QJsonValue i: messages)
+        if (i.toObject()["id"].toInt() > lastMessageID)
+            appended.append(i);
+    if (appended.isEmpty())
+        return appended;
+
+    //the messages between are not known, the older ones are dropped
+    //instead of keeping a hole in the history
+    if (lastMessageID >= 0 && appended.first().toObject()["id"].toInt() != lastMessageID + 1)
+    {
+        isRestarted = true;
+        this->rewriteLog(chatID, appended);
+    }
+    else
+    {
+        QFile logFile(this->logPath(chatID));
+        if (!logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        {
+            qDebug() << "Unable to open the cache of chat" << chatID << "for writing";
+            return appended;
+        }
+        for (QJsonValue i: appended)
+            logFile.write(QJsonDocument(i.toObject()).toJson(QJsonDocument::Compact) + '\n');
+        const qint64 logSize = logFile.size();
+        logFile.close();
+
+        if (logSize > LocalCache::maxLogSize)
+            this->compactLog(chatID);
+    }
+
+    this->lastMessageIDs[chatID] = appended.last().toObject()["id"].toInt();
+    this->saveIndex();
+    return appended;
+}
+
+void LocalCache::rewriteLog(const size_t &chatID, const QJsonArray &messages)
+{
+    this->pageStarts.remove(chatID);
+    QSaveFile logFile(this->logPath(chatID));
+    if (!logFile.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qDebug() << "Unable to open the cache of chat" << chatID << "for writing";
+        return;
+    }
+    for (QJsonValue i: messages)
+        logFile.write(QJsonDocument(i.toObject()).toJson(QJsonDocument::Compact) + '\n');
+    logFile.commit();
+}
+
+void LocalCache::compactLog(const size_t &chatID)
+{
+    QFile logFile(this->logPath(chatID));
+    if (!logFile.open(QIODevice::ReadOnly))
+        return;
+    logFile.seek(qMax<qint64>(0, logFile.size() - LocalCache::compactedLogSize));
+    QByteArray newest = logFile.readAll();
+    logFile.close();
+
+    //the lines are copied as they are, only the first one is cut
+    newest.remove(0, newest.indexOf('\n') + 1);
+
+    this->pageStarts.remove(chatID);
+    QSaveFile compactedFile(this->logPath(chatID));
+    if (!compactedFile.open(QIODevice::WriteOnly))
+    {
+        qDebug() << "Unable to open the cache of chat" << chatID << "for writing";
+        return;
+    }
+    compactedFile.write(newest);
+    compactedFile.commit();
+}
+
+QHash<int, int> LocalCache::watermarks() const
+{
+    return this->lastMessageIDs;
+}
+
+void LocalCache::saveIndex()
+{
+    QJsonObject watermarks;
+    for (auto i = this->lastMessageIDs.constBegin(); i != this->lastMessageIDs.constEnd(); ++i)
+        watermarks.insert(QString::number(i.key()), i.value());
+
+    QJsonObject index;
+    index.insert("owner", this->username);
+    index.insert("chats", this->chats);
+    index.insert("watermarks", watermarks);
+
+    //written aside and renamed, a crash never leaves half of the index
+    QSaveFile indexFile(this->dir.filePath("chats.json"));
+    if (!indexFile.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qDebug() << "Unable to open the cache index for writing";
+        return;
+    }
+    indexFile.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+    indexFile.commit();
+}
+
+void LocalCache::clear()
+{
+    QDir(this->dir.filePath("chats")).removeRecursively();
+    this->dir.mkpath("chats");
+    this->chats = QJsonArray();
+    this->lastMessageIDs.clear();
+    this->pageStarts.clear();
+    this->saveIndex();
+}
@@ -0,0 +1,63 @@
+#ifndef LOCALCACHE_H
+#define LOCALCACHE_H
+
+#include <QtCore>
+
+//chats and messages of the user kept on disk between the runs, so the
+//window is drawn at once and only newer messages are asked for.
+//chats.json holds the chat list and the id of the last cached message
+//of every chat, the messages of a chat are appended to its own log
+class LocalCache
+{
+public:
+    explicit LocalCache(const QString &path);
+
+    //the cache belongs to one user, another one starts it over
+    QString owner() const;
+    void setOwner(const QString &username);
+
+    QJsonArray chatList() const;
+    void setChatList(const QJsonArray &chatList);
+
+    //up to messagesNum of the newest messages older than beforeMessageID,
+    //all the newest ones if it is -1. the log is read from its end, so a
+    //page costs the same however long the log is
+    QJsonArray messages(const size_t    &chatID,
+                        const int       &beforeMessageID,
+                        const int       &messagesNum);
+
+    //appends the messages newer than the cached ones and returns them.
+    //if they dont follow the cached ones the log is started over from
+    //them and isRestarted is set, the chat has to be drawn again
+    QJsonArray appendMessages(const size_t      &chatID,
+                              const QJsonArray  &messages,
+                              bool              &isRestarted);
+
+    //id of the last cached message of every chat
+    QHash<int, int> watermarks() const;
+
+    void clear();
+
+private:
+    QDir dir;
+    QString username;
+    QJsonArray chats;
+    QHash<int, int> lastMessageIDs;
+
+    //first message of the last page read from a log and where its line
+    //starts, the next older page is read from there
+    QHash<int, QPair<int, qint64>> pageStarts;
+
+    //a log which grows past the size is cut to the newest messages
+    //of half of it, so it takes as long again to be compacted again
+    static const qint64 maxLogSize = 64 * 1024 * 1024;
+    static const qint64 compactedLogSize = maxLogSize / 2;
+    static const qint64 readChunkSize = 64 * 1024;
+
+    QString logPath(const size_t &chatID) const;
+    void saveIndex();
+    void rewriteLog(const size_t &chatID, const QJsonArray &messages);
+    void compactLog(const size_t &chatID);
+};
+
+#endif // LOCALCACHE_H
@@ -1,6 +1,8 @@
 #include "mainwindow.h"
 #include "chatwindow.h"
 #include "ui_mainwindow.h"
+#include "apiprotocol.h"
+#include "localcache.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
@@ -29,6 +31,10 @@ void MainWindow::slotSetErrorLabelText(QString str)
 
 void MainWindow::slotSwitchToChatWindow()
 {
+    //the cache of another user is not shown to the one who logged in
+    if (!this->loginUsername.isEmpty())
+        LocalCache("cache").setOwner(this->loginUsername);
+
     this->hide();
     ChatWindow *cw = new ChatWindow(this);
     cw->show();
@@ -49,13 +55,9 @@ void MainWindow::on_pushButtonSubmit_released()
         return;
     }
 
-    QJsonObject query, params;
-    query.insert("method", "access_token.change");
-    params.insert("username", this->ui->lineEditUsername->text());
-    params.insert("password", this->ui->lineEditPassword->text());
-    query.insert("params", QJsonValue::fromVariant(params));
-    QByteArray data = QJsonDocument(query).toJson();
-    this->client->sendData(data);
+    this->loginUsername = this->ui->lineEditUsername->text();
+    this->client->sendData(ApiProtocol::changeAccessToken(this->ui->lineEditUsername->text(),
+                                                          this->ui->lineEditPassword->text()));
 }
 
 void MainWindow::on_pushButtonCreateAccount_released()
@@ -71,11 +73,7 @@ void MainWindow::on_pushButtonCreateAccount_released()
         return;
     }
 
-    QJsonObject query, params;
-    query.insert("method", "user.create");
-    params.insert("username", this->ui->lineEditUsername->text());
-    params.insert("password", this->ui->lineEditPassword->text());
-    query.insert("params", QJsonValue::fromVariant(params));
-    QByteArray data = QJsonDocument(query).toJson();
-    this->client->sendData(data);
+    this->loginUsername = this->ui->lineEditUsername->text();
+    this->client->sendData(ApiProtocol::createUser(this->ui->lineEditUsername->text(),
+                                                   this->ui->lineEditPassword->text()));
 }
@@ -30,6 +30,9 @@ public slots:
 
 private:
     Ui::MainWindow *ui;
+
+    //user of the last login attempt, the local cache is handed to them
+    QString loginUsername;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,54 @@
+#include "messagedelegate.h"
+#include "messagelistmodel.h"
+#include <QtWidgets>
+
+MessageDelegate::MessageDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+
+}
+
+void MessageDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    //the background and the selection come from the style, the text is drawn here
+    QStyleOptionViewItem background = option;
+    this->initStyleOption(&background, index);
+    background.text.clear();
+    const QWidget *widget = option.widget;
+    QStyle *style = widget != nullptr ? widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &background, painter, widget);
+
+    const bool isSelected = option.state & QStyle::State_Selected;
+    const QColor textColor = option.palette.color(isSelected ? QPalette::HighlightedText : QPalette::Text);
+    QRect rect = option.rect.adjusted(MessageDelegate::margin, 0, -MessageDelegate::margin, 0);
+    QRect used;
+
+    painter->save();
+
+    painter->setPen(isSelected ? textColor : option.palette.color(QPalette::Disabled, QPalette::Text));
+    painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter, index.data(MessageListModel::DateRole).toString(), &used);
+    rect.setLeft(used.right() + 2 * MessageDelegate::margin);
+
+    QFont senderFont = option.font;
+    senderFont.setBold(true);
+    painter->setFont(senderFont);
+    painter->setPen(textColor);
+    painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter, index.data(MessageListModel::SenderRole).toString() + ':', &used);
+    rect.setLeft(used.right() + 2 * MessageDelegate::margin);
+
+    //the line breaks of the text would not fit in a row
+    QString text = index.data(MessageListModel::TextRole).toString();
+    text.replace('\n', ' ');
+    painter->setFont(option.font);
+    painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter,
+                      option.fontMetrics.elidedText(text, Qt::ElideRight, rect.width()));
+
+    painter->restore();
+}
+
+QSize MessageDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(index);
+    //no width, the rows take the width of the view and dont scroll sideways
+    return QSize(0, option.fontMetrics.height() + 2 * MessageDelegate::margin);
+}
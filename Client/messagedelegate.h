@@ -0,0 +1,23 @@
+#ifndef MESSAGEDELEGATE_H
+#define MESSAGEDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+//draws a message of MessageListModel on one line: the date, the
+//sender in bold and the text elided to the width of the view.
+//every row has the same height, so the view lays out only the
+//rows it shows instead of measuring the whole history
+class MessageDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+public:
+    explicit MessageDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    static const int margin = 4;
+};
+
+#endif // MESSAGEDELEGATE_H
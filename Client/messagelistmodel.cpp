@@ -0,0 +1,125 @@
+#include "messagelistmodel.h"
+
+MessageListModel::MessageListModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+
+}
+
+void MessageListModel::setOwner(const QString &username)
+{
+    if (username == this->owner)
+        return;
+    this->owner = username;
+    if (!this->messages.isEmpty())
+        emit dataChanged(this->index(0), this->index(this->messages.size() - 1));
+}
+
+MessageListModel::Message MessageListModel::fromJson(const QJsonObject &message)
+{
+    Message result;
+    result.id       = message["id"].toInt();
+    result.isSystem = message.contains("type") && !message["type"].isNull();
+    result.date     = message["date"].toString();
+    result.sender   = message["sender_username"].toString();
+    result.text     = message["text"].toString();
+    return result;
+}
+
+void MessageListModel::setMessages(const QJsonArray &messages)
+{
+    this->beginResetModel();
+    this->messages.clear();
+    this->messages.reserve(messages.size());
+    for (QJsonValue i: messages)
+        this->messages.append(MessageListModel::fromJson(i.toObject()));
+    this->endResetModel();
+}
+
+void MessageListModel::appendMessages(const QJsonArray &messages)
+{
+    if (messages.isEmpty())
+        return;
+    this->beginInsertRows(QModelIndex(), this->messages.size(), this->messages.size() + messages.size() - 1);
+    for (QJsonValue i: messages)
+        this->messages.append(MessageListModel::fromJson(i.toObject()));
+    this->endInsertRows();
+}
+
+void MessageListModel::prependMessages(const QJsonArray &messages)
+{
+    if (messages.isEmpty())
+        return;
+
+    QVector<Message> olderMessages;
+    olderMessages.reserve(messages.size() + this->messages.size());
+    for (QJsonValue i: messages)
+        olderMessages.append(MessageListModel::fromJson(i.toObject()));
+
+    this->beginInsertRows(QModelIndex(), 0, messages.size() - 1);
+    this->messages = olderMessages + this->messages;
+    this->endInsertRows();
+}
+
+int MessageListModel::firstMessageID() const
+{
+    return this->messages.isEmpty() ? -1 : this->messages.first().id;
+}
+
+void MessageListModel::clear()
+{
+    this->beginResetModel();
+    this->messages.clear();
+    this->endResetModel();
+}
+
+int MessageListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : this->messages.size();
+}
+
+QString MessageListModel::senderName(const Message &message) const
+{
+    if (message.isSystem)
+        return "SystemBot";
+    if (message.sender == this->owner)
+        return "You";
+    return message.sender;
+}
+
+QVariant MessageListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= this->messages.size())
+        return QVariant();
+
+    const Message &message = this->messages[index.row()];
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return QStringLiteral("<%1> %2: %3").arg(message.date)
+                                            .arg(this->senderName(message))
+                                            .arg(message.text);
+
+    case Qt::ToolTipRole:
+    case TextRole:
+        return message.text;
+
+    case IdRole:
+        return message.id;
+
+    case DateRole:
+        return message.date;
+
+    case SenderRole:
+        return this->senderName(message);
+
+    case IsSystemRole:
+        return message.isSystem;
+
+    case IsOwnRole:
+        return !message.isSystem && message.sender == this->owner;
+
+    default:
+        return QVariant();
+    }
+}
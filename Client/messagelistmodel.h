@@ -0,0 +1,58 @@
+#ifndef MESSAGELISTMODEL_H
+#define MESSAGELISTMODEL_H
+
+#include <QtCore>
+
+//messages of the open chat for the list view. they are kept as plain
+//fields instead of json objects and a row is formatted only when the
+//view asks for it, so the cost of a long history is its memory only
+class MessageListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Role
+    {
+        IdRole = Qt::UserRole + 1,
+        DateRole,
+        SenderRole,
+        TextRole,
+        IsSystemRole,
+        IsOwnRole
+    };
+
+    explicit MessageListModel(QObject *parent = nullptr);
+
+    //messages of this user are shown as sent by "You"
+    void setOwner(const QString &username);
+
+    void setMessages(const QJsonArray &messages);
+    void appendMessages(const QJsonArray &messages);
+
+    //older messages of the history go above the loaded ones
+    void prependMessages(const QJsonArray &messages);
+    void clear();
+
+    //-1 if there are no messages
+    int firstMessageID() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    struct Message
+    {
+        int     id;
+        bool    isSystem;
+        QString date;
+        QString sender;
+        QString text;
+    };
+
+    QVector<Message> messages;
+    QString owner;
+
+    static Message fromJson(const QJsonObject &message);
+    QString senderName(const Message &message) const;
+};
+
+#endif // MESSAGELISTMODEL_H
@@ -0,0 +1,26 @@
+#include "reconnectbackoff.h"
+
+ReconnectBackoff::ReconnectBackoff(int baseMs, int capMs)
+{
+    this->baseMs = qMax(baseMs, 1);
+    this->capMs = qMax(capMs, this->baseMs);
+}
+
+int ReconnectBackoff::nextDelay()
+{
+    //the shift is bounded, past it the bound is at the cap anyway
+    const qint64 bound = qMin<qint64>(static_cast<qint64>(this->baseMs) << qMin(this->failedAttempts, 30),
+                                      this->capMs);
+    ++this->failedAttempts;
+    return QRandomGenerator::global()->bounded(static_cast<int>(bound) + 1);
+}
+
+void ReconnectBackoff::reset()
+{
+    this->failedAttempts = 0;
+}
+
+int ReconnectBackoff::attempts() const
+{
+    return this->failedAttempts;
+}
@@ -0,0 +1,27 @@
+#ifndef RECONNECTBACKOFF_H
+#define RECONNECTBACKOFF_H
+
+#include <QtCore>
+
+//delays between the attempts to reconnect to the server: the bound
+//doubles with every failed attempt up to the cap and the delay is
+//drawn uniformly below it, so the clients dropped together by
+//a restart of the server come back spread over the whole window
+class ReconnectBackoff
+{
+public:
+    ReconnectBackoff(int baseMs, int capMs);
+
+    //delay before the next attempt, counts the attempt as failed
+    //until reset() is called
+    int nextDelay();
+    void reset();
+    int attempts() const;
+
+private:
+    int baseMs;
+    int capMs;
+    int failedAttempts = 0;
+};
+
+#endif // RECONNECTBACKOFF_H
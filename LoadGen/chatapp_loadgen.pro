@@ -0,0 +1,29 @@
+QT -= gui
+QT += core network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+# the queries are built by the client protocol code and the
+# latencies are kept in the histograms the server exports
+INCLUDEPATH += \
+    ../Client \
+    ../Server
+
+SOURCES += \
+        ../Client/apiprotocol.cpp \
+        ../Server/latencyhistogram.cpp \
+        loadgenerator.cpp \
+        main.cpp \
+        simulateduser.cpp
+
+HEADERS += \
+    ../Client/apiprotocol.h \
+    ../Server/latencyhistogram.h \
+    loadgenerator.h \
+    simulateduser.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
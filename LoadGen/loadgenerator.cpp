@@ -0,0 +1,228 @@
+#include "loadgenerator.h"
+#include "apiprotocol.h"
+
+LoadGenerator::LoadGenerator(const Options &options, QObject *parent)
+    : QObject(parent)
+{
+    this->options = options;
+    if (this->options.prefix.isEmpty())
+        this->options.prefix = QStringLiteral("lg%1").arg(QDateTime::currentSecsSinceEpoch());
+    this->options.membersPerChat = qBound(1, this->options.membersPerChat, this->options.users);
+
+    for (int i = 0; i < this->options.users; ++i)
+    {
+        SimulatedUser *user = new SimulatedUser(i, this->options.host, this->options.port, this);
+        user->username = QStringLiteral("%1_%2").arg(this->options.prefix).arg(i);
+        connect(user, SIGNAL(replied(SimulatedUser*, QString, QJsonObject, qint64)),
+                this, SLOT(slotReplied(SimulatedUser*, QString, QJsonObject, qint64)));
+        this->users.append(user);
+    }
+}
+
+void LoadGenerator::start()
+{
+    this->clock.start();
+    qInfo() << "Creating" << this->options.users << "users";
+    this->continueSetup();
+}
+
+QJsonArray LoadGenerator::chatMembers(const int &chat) const
+{
+    //the creator is added by the server, the others follow it
+    QJsonArray members;
+    const int creator = chat % this->users.size();
+    for (int i = 1; i < this->options.membersPerChat; ++i)
+        members.append(this->users[(creator + i) % this->users.size()]->username);
+    return members;
+}
+
+void LoadGenerator::continueSetup()
+{
+    //setup queries run with a bounded concurrency, user.create
+    //is throttled by the password hashing pool of the server
+    const int items = this->phase == CREATING_USERS ? this->users.size() : this->options.chats;
+    while (this->setupInFlight < this->options.setupConcurrency && this->nextSetupItem < items)
+    {
+        const int item = this->nextSetupItem++;
+        ++this->setupInFlight;
+        if (this->phase == CREATING_USERS)
+        {
+            SimulatedUser *user = this->users[item];
+            user->request("user.create", ApiProtocol::createUser(user->username, "loadgen"));
+        }
+        else
+        {
+            SimulatedUser *creator = this->users[item % this->users.size()];
+            if (creator->isBusy())
+            {
+                //one query per connection, the chat waits for its creator
+                --this->nextSetupItem;
+                --this->setupInFlight;
+                return;
+            }
+            creator->request("chat.create", ApiProtocol::createChat(creator->accessToken,
+                                                                    QStringLiteral("%1 chat %2").arg(this->options.prefix).arg(item),
+                                                                    this->chatMembers(item),
+                                                                    true));
+        }
+    }
+
+    if (this->setupInFlight > 0 || this->nextSetupItem < items)
+        return;
+
+    if (this->phase == CREATING_USERS)
+    {
+        qInfo() << "Users created in" << this->clock.elapsed() << "ms," << this->setupFailures << "failed";
+        qInfo() << "Creating" << this->options.chats << "chats of" << this->options.membersPerChat << "members";
+        this->phase = CREATING_CHATS;
+        this->nextSetupItem = 0;
+        this->setupFailures = 0;
+        this->continueSetup();
+    }
+    else
+    {
+        qInfo() << "Chats created," << this->setupFailures << "failed";
+        this->startRun();
+    }
+}
+
+void LoadGenerator::startRun()
+{
+    this->phase = RUNNING;
+    this->stats.clear();
+    this->runStartMs = this->clock.elapsed();
+    qInfo() << "Running for" << this->options.durationMs << "ms";
+
+    //users start spread over one think time, not all at once
+    for (SimulatedUser *user: this->users)
+        this->scheduleNext(user);
+    QTimer::singleShot(this->options.durationMs, this, SLOT(slotFinishRun()));
+}
+
+void LoadGenerator::scheduleNext(SimulatedUser *user)
+{
+    const qint64 delay = QRandomGenerator::global()->bounded(this->options.thinkTimeMs + 1) +
+                         this->options.thinkTimeMs / 2;
+    QTimer::singleShot(delay, user, [this, user]()
+    {
+        this->act(user);
+    });
+}
+
+void LoadGenerator::act(SimulatedUser *user)
+{
+    if (this->phase != RUNNING)
+        return;
+    if (user->accessToken.isEmpty())
+        return;
+
+    if (user->currentChatID < 0 && !user->chats.isEmpty())
+        user->currentChatID = user->chats[QRandomGenerator::global()->bounded(user->chats.size())];
+
+    const int totalWeight = qMax(this->options.pollWeight + this->options.sendWeight + this->options.createWeight, 1);
+    const int roll = QRandomGenerator::global()->bounded(totalWeight);
+    if (roll < this->options.pollWeight || user->currentChatID < 0)
+        user->request("user.getmyinfo", ApiProtocol::getMyInfo(user->accessToken,
+                                                               user->currentChatID,
+                                                               this->options.messagesNum));
+    else if (roll < this->options.pollWeight + this->options.sendWeight)
+        user->request("chat.sendmessage", ApiProtocol::sendMessage(user->accessToken,
+                                                                   user->currentChatID,
+                                                                   QStringLiteral("message %1 from %2")
+                                                                   .arg(++this->sentMessages).arg(user->username)));
+    else
+        user->request("chat.create", ApiProtocol::createChat(user->accessToken,
+                                                             QStringLiteral("%1 extra chat").arg(user->username),
+                                                             this->chatMembers(user->index),
+                                                             true));
+}
+
+void LoadGenerator::record(const QString &method, const QJsonObject &response, qint64 latencyUs)
+{
+    MethodStats &methodStats = this->stats[method];
+    methodStats.latency.record(latencyUs);
+    if (response.contains("error_code") && response["error_code"].toInt() != 0)
+        ++methodStats.errors;
+}
+
+void LoadGenerator::slotReplied(SimulatedUser *user, const QString &method,
+                                const QJsonObject &response, qint64 latencyUs)
+{
+    this->record(method, response, latencyUs);
+
+    if (this->phase == RUNNING)
+    {
+        if (method == "chat.create" && response.contains("chat_id"))
+            user->chats.append(response["chat_id"].toInt());
+        return this->scheduleNext(user);
+    }
+
+    if (this->phase == CREATING_USERS || this->phase == CREATING_CHATS)
+    {
+        --this->setupInFlight;
+        if (response.contains("new_token"))
+            user->accessToken = response["new_token"].toString();
+        else if (response.contains("chat_id"))
+        {
+            const int chatID = response["chat_id"].toInt();
+            user->chats.append(chatID);
+            for (int i = 1; i < this->options.membersPerChat; ++i)
+                this->users[(user->index + i) % this->users.size()]->chats.append(chatID);
+        }
+        else
+        {
+            ++this->setupFailures;
+            if (this->setupFailures <= 5)
+                qWarning() << method << "failed during setup:" << response;
+        }
+        this->continueSetup();
+    }
+}
+
+void LoadGenerator::slotFinishRun()
+{
+    this->phase = DONE;
+    this->report();
+    emit this->finished();
+}
+
+void LoadGenerator::report()
+{
+    const double seconds = qMax<qint64>(this->clock.elapsed() - this->runStartMs, 1) / 1000.0;
+    QTextStream out(stdout);
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+           .arg("method", -22).arg("count", 9).arg("errors", 8).arg("rps", 10)
+           .arg("p50 ms", 9).arg("p99 ms", 9).arg("p999 ms", 9).arg("max ms", 9);
+
+    QStringList csv;
+    csv << "method,count,errors,rps,p50_ms,p99_ms,p999_ms,max_ms";
+    for (auto i = this->stats.constBegin(); i != this->stats.constEnd(); ++i)
+    {
+        const LatencyHistogram &latency = i->latency;
+        QStringList row;
+        row << i.key()
+            << QString::number(latency.count())
+            << QString::number(i->errors)
+            << QString::number(latency.count() / seconds, 'f', 1)
+            << QString::number(latency.percentile(0.5) / 1000.0, 'f', 2)
+            << QString::number(latency.percentile(0.99) / 1000.0, 'f', 2)
+            << QString::number(latency.percentile(0.999) / 1000.0, 'f', 2)
+            << QString::number(latency.max() / 1000.0, 'f', 2);
+        csv << row.join(',');
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+               .arg(row[0], -22).arg(row[1], 9).arg(row[2], 8).arg(row[3], 10)
+               .arg(row[4], 9).arg(row[5], 9).arg(row[6], 9).arg(row[7], 9);
+    }
+    out.flush();
+
+    if (this->options.csvPath.isEmpty())
+        return;
+    QFile csvFile(this->options.csvPath);
+    if (!csvFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        qWarning() << "Unable to open" << this->options.csvPath << "for writing";
+        return;
+    }
+    csvFile.write(csv.join('\n').toUtf8() + '\n');
+    csvFile.close();
+}
@@ -0,0 +1,83 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QtCore>
+#include "simulateduser.h"
+#include "latencyhistogram.h"
+
+//creates the users and chats of the run, then lets every user
+//poll, send messages and create chats with a think time between
+//its queries, and reports throughput and latency per method
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        QString host = "127.0.0.1";
+        quint16 port = 9999;
+        int     users = 100;
+        int     chats = 20;
+        int     membersPerChat = 5;
+        int     setupConcurrency = 16;
+        qint64  durationMs = 60000;
+        qint64  thinkTimeMs = 1000;
+        int     messagesNum = 50;
+
+        //relative weights of the simulated actions
+        int     pollWeight = 80;
+        int     sendWeight = 18;
+        int     createWeight = 2;
+
+        QString prefix;
+        QString csvPath;
+    };
+
+    explicit LoadGenerator(const Options &options, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void slotReplied(SimulatedUser *user, const QString &method,
+                     const QJsonObject &response, qint64 latencyUs);
+    void slotFinishRun();
+
+private:
+    enum Phase
+    {
+        CREATING_USERS,
+        CREATING_CHATS,
+        RUNNING,
+        DONE
+    };
+
+    struct MethodStats
+    {
+        LatencyHistogram    latency;
+        quint64             errors = 0;
+    };
+
+    Options options;
+    Phase phase = CREATING_USERS;
+    QVector<SimulatedUser*> users;
+    QMap<QString, MethodStats> stats;
+    QElapsedTimer clock;
+    qint64 runStartMs = 0;
+    int nextSetupItem = 0;
+    int setupInFlight = 0;
+    int setupFailures = 0;
+    quint64 sentMessages = 0;
+
+    void record(const QString &method, const QJsonObject &response, qint64 latencyUs);
+    void continueSetup();
+    void startRun();
+    void scheduleNext(SimulatedUser *user);
+    void act(SimulatedUser *user);
+    void report();
+    QJsonArray chatMembers(const int &chat) const;
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,58 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "loadgenerator.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("chatapp_loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulates chat users against a running server and reports "
+                                     "throughput and latency percentiles per method.\n"
+                                     "All the users connect from one address, so disable the rate "
+                                     "limits of the server for the run (ip_rate=0, token_rate=0 and "
+                                     "0,0 for every entry of method_limits).");
+    parser.addHelpOption();
+    const QCommandLineOption hostOption("host", "Server address.", "host", "127.0.0.1"),
+                             portOption("port", "Server port.", "port", "9999"),
+                             usersOption("users", "Number of simulated users.", "n", "100"),
+                             chatsOption("chats", "Number of chats created before the run.", "n", "20"),
+                             membersOption("members", "Members per chat, creator included.", "n", "5"),
+                             durationOption("duration", "Duration of the run in seconds.", "s", "60"),
+                             thinkOption("think", "Mean think time of a user in milliseconds.", "ms", "1000"),
+                             mixOption("mix", "Weights of poll:send:create actions.", "mix", "80:18:2"),
+                             concurrencyOption("setup-concurrency", "Queries in flight while creating users and chats.", "n", "16"),
+                             prefixOption("prefix", "Prefix of the created usernames.", "prefix"),
+                             csvOption("csv", "Also write the report to this csv file.", "file");
+    parser.addOptions({hostOption, portOption, usersOption, chatsOption, membersOption,
+                       durationOption, thinkOption, mixOption, concurrencyOption, prefixOption, csvOption});
+    parser.process(a);
+
+    LoadGenerator::Options options;
+    options.host = parser.value(hostOption);
+    options.port = parser.value(portOption).toUShort();
+    options.users = qMax(parser.value(usersOption).toInt(), 1);
+    options.chats = qMax(parser.value(chatsOption).toInt(), 0);
+    options.membersPerChat = parser.value(membersOption).toInt();
+    options.durationMs = parser.value(durationOption).toLongLong() * 1000;
+    options.thinkTimeMs = qMax(parser.value(thinkOption).toLongLong(), 0LL);
+    options.setupConcurrency = qMax(parser.value(concurrencyOption).toInt(), 1);
+    options.prefix = parser.value(prefixOption);
+    options.csvPath = parser.value(csvOption);
+
+    const QStringList mix = parser.value(mixOption).split(':');
+    if (mix.size() != 3)
+    {
+        qCritical() << "Mix must be three weights separated by colons";
+        return 1;
+    }
+    options.pollWeight = qMax(mix[0].toInt(), 0);
+    options.sendWeight = qMax(mix[1].toInt(), 0);
+    options.createWeight = qMax(mix[2].toInt(), 0);
+
+    LoadGenerator generator(options);
+    QObject::connect(&generator, SIGNAL(finished()), &a, SLOT(quit()));
+    generator.start();
+    return a.exec();
+}
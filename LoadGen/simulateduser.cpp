@@ -0,0 +1,72 @@
+#include "simulateduser.h"
+
+SimulatedUser::SimulatedUser(const int &index, const QString &host, const quint16 &port, QObject *parent)
+    : QObject(parent)
+{
+    this->index = index;
+    this->host = host;
+    this->port = port;
+
+    this->socket = new QTcpSocket(this);
+    connect(this->socket, SIGNAL(readyRead()), this, SLOT(slotReadyRead()));
+    connect(this->socket, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
+    connect(this->socket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)), this, SLOT(slotError()));
+}
+
+bool SimulatedUser::isBusy() const
+{
+    return !this->pendingMethod.isEmpty();
+}
+
+void SimulatedUser::request(const QString &method, const QByteArray &query)
+{
+    //the query is buffered by the socket until the connection is up,
+    //so the connection time of the first query is measured too
+    if (this->socket->state() == QAbstractSocket::UnconnectedState)
+        this->socket->connectToHost(this->host, this->port);
+
+    this->pendingMethod = method;
+    this->sent.start();
+    this->socket->write(query);
+}
+
+void SimulatedUser::slotReadyRead()
+{
+    this->in += this->socket->readAll();
+    int lineEnd;
+    while ((lineEnd = this->in.indexOf('\n')) >= 0)
+    {
+        QJsonObject response = QJsonDocument::fromJson(this->in.left(lineEnd)).object();
+        this->in.remove(0, lineEnd + 1);
+
+        //pushed events are not answers to the query in flight
+        if (response.contains("event") || this->pendingMethod.isEmpty())
+            continue;
+
+        QString method = this->pendingMethod;
+        this->pendingMethod.clear();
+        emit this->replied(this, method, response, this->sent.nsecsElapsed() / 1000);
+    }
+}
+
+void SimulatedUser::slotDisconnected()
+{
+    this->in.clear();
+    if (this->pendingMethod.isEmpty())
+        return;
+
+    //a lost query is reported as a failed one
+    QString method = this->pendingMethod;
+    this->pendingMethod.clear();
+    QJsonObject response;
+    response.insert("error_code", -1);
+    emit this->replied(this, method, response, this->sent.nsecsElapsed() / 1000);
+}
+
+void SimulatedUser::slotError()
+{
+    //a refused or unreachable connect never emits disconnected, the query
+    //buffered for it is dropped and the next one connects again
+    this->socket->abort();
+    this->slotDisconnected();
+}
@@ -0,0 +1,42 @@
+#ifndef SIMULATEDUSER_H
+#define SIMULATEDUSER_H
+
+#include <QtCore>
+#include <QTcpSocket>
+
+//one user of the load generator with its own persistent connection,
+//it has at most one query in flight and measures its round trip
+class SimulatedUser : public QObject
+{
+    Q_OBJECT
+public:
+    SimulatedUser(const int &index, const QString &host, const quint16 &port, QObject *parent = nullptr);
+
+    void request(const QString &method, const QByteArray &query);
+    bool isBusy() const;
+
+    int index;
+    QString username;
+    QString accessToken;
+    QVector<int> chats;
+    int currentChatID = -1;
+
+signals:
+    void replied(SimulatedUser *user, const QString &method,
+                 const QJsonObject &response, qint64 latencyUs);
+
+private slots:
+    void slotReadyRead();
+    void slotDisconnected();
+    void slotError();
+
+private:
+    QTcpSocket *socket;
+    QString host;
+    quint16 port;
+    QByteArray in;
+    QString pendingMethod;
+    QElapsedTimer sent;
+};
+
+#endif // SIMULATEDUSER_H
@@ -0,0 +1,27 @@
+QT -= gui
+QT += core network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+# the connections are the simulated users of the load generator
+# and the latencies are kept in the histograms the server exports
+INCLUDEPATH += \
+    ../LoadGen \
+    ../Server
+
+SOURCES += \
+        ../LoadGen/simulateduser.cpp \
+        ../Server/latencyhistogram.cpp \
+        main.cpp \
+        replayer.cpp
+
+HEADERS += \
+    ../LoadGen/simulateduser.h \
+    ../Server/latencyhistogram.h \
+    replayer.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,44 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "replayer.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("chatapp_replay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a traffic capture of the server ([capture] path) against a "
+                                     "server started with the storage it had when the capture began, "
+                                     "usually an empty data directory, and compares the error codes of "
+                                     "the responses with the captured ones.\n"
+                                     "Disable the rate limits of the replayed server unless the capture "
+                                     "was taken with the same limits and is replayed at its speed.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "Capture file written by the server.");
+    const QCommandLineOption hostOption("host", "Server address.", "host", "127.0.0.1"),
+                             portOption("port", "Server port.", "port", "9999"),
+                             speedOption("speed", "Speed factor, 1 is the captured speed, 0 replays "
+                                                  "one query at a time as fast as possible.", "factor", "1"),
+                             mismatchesOption("show-mismatches", "Number of mismatches printed.", "n", "10");
+    parser.addOptions({hostOption, portOption, speedOption, mismatchesOption});
+    parser.process(a);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+
+    Replayer::Options options;
+    options.capturePath = parser.positionalArguments().first();
+    options.host = parser.value(hostOption);
+    options.port = parser.value(portOption).toUShort();
+    options.speed = qMax(parser.value(speedOption).toDouble(), 0.0);
+    options.reportedMismatches = parser.value(mismatchesOption).toInt();
+
+    Replayer replayer(options);
+    if (!replayer.load())
+        return 1;
+    QObject::connect(&replayer, SIGNAL(finished()), &a, SLOT(quit()));
+    replayer.start();
+    a.exec();
+    return replayer.exitCode();
+}
@@ -0,0 +1,197 @@
+#include "replayer.h"
+
+Replayer::Replayer(const Options &options, QObject *parent)
+    : QObject(parent)
+{
+    this->options = options;
+    this->dispatchTimer = new QTimer(this);
+    this->dispatchTimer->setSingleShot(true);
+    this->dispatchTimer->setTimerType(Qt::PreciseTimer);
+    connect(this->dispatchTimer, SIGNAL(timeout()), this, SLOT(slotDispatch()));
+}
+
+bool Replayer::load()
+{
+    QFile captureFile(this->options.capturePath);
+    if (!captureFile.open(QIODevice::ReadOnly))
+    {
+        qCritical() << "Unable to open capture" << this->options.capturePath;
+        return false;
+    }
+
+    //a capture file is appended to by every server run, each run starts
+    //with a header and restarts the clock and the connection ids
+    quint64 run = 0;
+    qint64 runOffset = 0;
+    while (!captureFile.atEnd())
+    {
+        QJsonObject line = QJsonDocument::fromJson(captureFile.readLine()).object();
+        if (line.contains("capture"))
+        {
+            ++run;
+            runOffset = this->entries.isEmpty() ? 0 : this->entries.last().time;
+            continue;
+        }
+        if (!line.contains("query"))
+            continue;
+
+        Entry entry;
+        entry.time = runOffset + line["t"].toVariant().toLongLong();
+        entry.connectionID = (run << 40) | line["conn"].toVariant().toULongLong();
+        entry.query = line["query"].toObject();
+        entry.method = entry.query["method"].toString();
+        entry.errorCode = line.contains("error_code") ? line["error_code"].toInt() : -1;
+        entry.unresolvedToken = false;
+        this->entries.append(entry);
+    }
+    captureFile.close();
+    qInfo() << "Loaded" << this->entries.size() << "queries";
+    return true;
+}
+
+void Replayer::start()
+{
+    this->clock.start();
+    if (this->entries.isEmpty())
+    {
+        this->report();
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+        return;
+    }
+
+    if (this->options.speed <= 0)
+    {
+        const int entry = this->nextEntry++;
+        this->send(this->connection(this->entries[entry].connectionID), entry);
+    }
+    else
+        this->slotDispatch();
+}
+
+SimulatedUser *Replayer::connection(const quint64 &connectionID)
+{
+    auto user = this->connections.find(connectionID);
+    if (user == this->connections.end())
+    {
+        SimulatedUser *newUser = new SimulatedUser(this->connections.size(), this->options.host, this->options.port, this);
+        connect(newUser, SIGNAL(replied(SimulatedUser*, QString, QJsonObject, qint64)),
+                this, SLOT(slotReplied(SimulatedUser*, QString, QJsonObject, qint64)));
+        user = this->connections.insert(connectionID, newUser);
+    }
+    return user.value();
+}
+
+void Replayer::slotDispatch()
+{
+    //every query due by now goes to its connection, which sends it
+    //right away or after the query it already has in flight
+    const qint64 now = this->clock.elapsed();
+    while (this->nextEntry < this->entries.size() &&
+           this->entries[this->nextEntry].time / this->options.speed <= now)
+    {
+        const int entry = this->nextEntry++;
+        SimulatedUser *user = this->connection(this->entries[entry].connectionID);
+        if (this->inFlight.contains(user))
+            this->queued[user].enqueue(entry);
+        else
+            this->send(user, entry);
+    }
+
+    if (this->nextEntry < this->entries.size())
+        this->dispatchTimer->start(qMax<qint64>(this->entries[this->nextEntry].time / this->options.speed - now, 0));
+}
+
+void Replayer::send(SimulatedUser *user, const int &entry)
+{
+    //tokens are replaced by the ones this server issued to the same users
+    Entry &replayed = this->entries[entry];
+    QJsonObject query = replayed.query;
+    QJsonObject params = query["params"].toObject();
+    const QString token = params["access_token"].toString();
+    if (token.startsWith("@token:"))
+    {
+        auto issued = this->tokens.constFind(token.mid(7));
+        if (issued != this->tokens.constEnd())
+        {
+            params["access_token"] = issued.value();
+            query["params"] = params;
+        }
+        else
+            replayed.unresolvedToken = true;
+    }
+
+    this->inFlight.insert(user, entry);
+    user->request(replayed.method, QJsonDocument(query).toJson(QJsonDocument::Compact));
+}
+
+void Replayer::slotReplied(SimulatedUser *user, const QString &method,
+                           const QJsonObject &response, qint64 latencyUs)
+{
+    const int entry = this->inFlight.take(user);
+    const Entry &replayed = this->entries[entry];
+    ++this->repliedEntries;
+
+    MethodStats &methodStats = this->stats[method];
+    methodStats.latency.record(latencyUs);
+
+    const QJsonObject params = replayed.query["params"].toObject();
+    if (response.contains("new_token") && params.contains("username"))
+        this->tokens.insert(params["username"].toString(), response["new_token"].toString());
+
+    //tokens issued before the capture started are unknown to this server
+    const int errorCode = response["error_code"].toInt();
+    if (errorCode == -1)
+        ++this->lost;
+    if (replayed.unresolvedToken)
+        ++this->unresolved;
+    else if (replayed.errorCode >= 0 && errorCode != replayed.errorCode)
+    {
+        ++methodStats.mismatches;
+        if (++this->mismatches <= quint64(this->options.reportedMismatches))
+            qWarning().noquote() << QStringLiteral("Mismatch at %1ms %2: captured error %3, replayed %4")
+                                    .arg(replayed.time).arg(method).arg(replayed.errorCode).arg(errorCode);
+    }
+
+    if (this->options.speed <= 0)
+    {
+        if (this->nextEntry < this->entries.size())
+        {
+            const int next = this->nextEntry++;
+            this->send(this->connection(this->entries[next].connectionID), next);
+        }
+    }
+    else if (!this->queued[user].isEmpty())
+        this->send(user, this->queued[user].dequeue());
+
+    if (this->repliedEntries == this->entries.size())
+    {
+        this->report();
+        emit this->finished();
+    }
+}
+
+int Replayer::exitCode() const
+{
+    return this->mismatches > 0 || this->lost > 0 ? 1 : 0;
+}
+
+void Replayer::report()
+{
+    const double seconds = qMax<qint64>(this->clock.elapsed(), 1) / 1000.0;
+    QTextStream out(stdout);
+    out << QString("%1 %2 %3 %4 %5 %6\n")
+           .arg("method", -22).arg("count", 9).arg("mismatch", 9)
+           .arg("p50 ms", 9).arg("p99 ms", 9).arg("max ms", 9);
+    for (auto i = this->stats.constBegin(); i != this->stats.constEnd(); ++i)
+        out << QString("%1 %2 %3 %4 %5 %6\n")
+               .arg(i.key(), -22)
+               .arg(i->latency.count(), 9)
+               .arg(i->mismatches, 9)
+               .arg(i->latency.percentile(0.5) / 1000.0, 9, 'f', 2)
+               .arg(i->latency.percentile(0.99) / 1000.0, 9, 'f', 2)
+               .arg(i->latency.max() / 1000.0, 9, 'f', 2);
+    out << QString("%1 queries in %2 s (%3 q/s), %4 mismatches, %5 with tokens issued before the capture, %6 lost\n")
+           .arg(this->repliedEntries).arg(seconds, 0, 'f', 2).arg(this->repliedEntries / seconds, 0, 'f', 1)
+           .arg(this->mismatches).arg(this->unresolved).arg(this->lost);
+    out.flush();
+}
@@ -0,0 +1,87 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QtCore>
+#include "simulateduser.h"
+#include "latencyhistogram.h"
+
+//feeds a traffic capture of the server back into a fresh instance.
+//at real speed every captured connection gets its own connection and
+//queries are sent at their captured times scaled by the speed factor,
+//at maximum speed they are sent one at a time in the captured order,
+//so the storage ends up the same on every run. the error code of
+//every response is compared with the captured one
+class Replayer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        QString host = "127.0.0.1";
+        quint16 port = 9999;
+        QString capturePath;
+
+        //1 replays at the captured speed, 2 twice as fast,
+        //zero as fast as possible in the captured order
+        double  speed = 1;
+        int     reportedMismatches = 10;
+    };
+
+    explicit Replayer(const Options &options, QObject *parent = nullptr);
+
+    bool load();
+    void start();
+
+    //zero if every response matched the capture
+    int exitCode() const;
+
+signals:
+    void finished();
+
+private slots:
+    void slotReplied(SimulatedUser *user, const QString &method,
+                     const QJsonObject &response, qint64 latencyUs);
+    void slotDispatch();
+
+private:
+    struct Entry
+    {
+        qint64      time;
+        quint64     connectionID;
+        QString     method;
+        QJsonObject query;
+        int         errorCode;
+        bool        unresolvedToken;
+    };
+
+    struct MethodStats
+    {
+        LatencyHistogram    latency;
+        quint64             mismatches = 0;
+    };
+
+    Options options;
+    QVector<Entry> entries;
+    int nextEntry = 0;
+    int repliedEntries = 0;
+    QTimer *dispatchTimer;
+    QElapsedTimer clock;
+
+    QHash<quint64, SimulatedUser*> connections;
+    QHash<SimulatedUser*, QQueue<int>> queued;
+    QHash<SimulatedUser*, int> inFlight;
+
+    //username to the token the replayed server issued for it
+    QHash<QString, QString> tokens;
+
+    QMap<QString, MethodStats> stats;
+    quint64 mismatches = 0;
+    quint64 unresolved = 0;
+    quint64 lost = 0;
+
+    SimulatedUser *connection(const quint64 &connectionID);
+    void send(SimulatedUser *user, const int &entry);
+    void report();
+};
+
+#endif // REPLAYER_H
@@ -0,0 +1,72 @@
+#include "accountedfile.h"
+#include "requestprofile.h"
+
+QAtomicInteger<quint64> AccountedFile::opensCount = 0;
+QAtomicInteger<quint64> AccountedFile::readBytes = 0;
+QAtomicInteger<quint64> AccountedFile::writtenBytes = 0;
+
+AccountedFile::AccountedFile(const QString &name)
+    : QFile(name)
+{
+
+}
+
+bool AccountedFile::open(OpenMode mode)
+{
+    AccountedFile::opensCount.fetchAndAddRelaxed(1);
+    //the clock is read only while a request is profiled
+    if (!RequestProfile::isActive())
+        return QFile::open(mode);
+    const qint64 startNs = RequestProfile::now();
+    bool opened = QFile::open(mode);
+    RequestProfile::addFileOpen(startNs);
+    return opened;
+}
+
+qint64 AccountedFile::readData(char *data, qint64 maxSize)
+{
+    const qint64 startNs = RequestProfile::isActive() ? RequestProfile::now() : -1;
+    qint64 bytes = QFile::readData(data, maxSize);
+    if (bytes > 0)
+        AccountedFile::readBytes.fetchAndAddRelaxed(bytes);
+    if (startNs >= 0)
+        RequestProfile::addRead(bytes, startNs);
+    return bytes;
+}
+
+qint64 AccountedFile::readLineData(char *data, qint64 maxSize)
+{
+    const qint64 startNs = RequestProfile::isActive() ? RequestProfile::now() : -1;
+    qint64 bytes = QFile::readLineData(data, maxSize);
+    if (bytes > 0)
+        AccountedFile::readBytes.fetchAndAddRelaxed(bytes);
+    if (startNs >= 0)
+        RequestProfile::addRead(bytes, startNs);
+    return bytes;
+}
+
+qint64 AccountedFile::writeData(const char *data, qint64 size)
+{
+    const qint64 startNs = RequestProfile::isActive() ? RequestProfile::now() : -1;
+    qint64 bytes = QFile::writeData(data, size);
+    if (bytes > 0)
+        AccountedFile::writtenBytes.fetchAndAddRelaxed(bytes);
+    if (startNs >= 0)
+        RequestProfile::addWrite(bytes, startNs);
+    return bytes;
+}
+
+quint64 AccountedFile::opens()
+{
+    return AccountedFile::opensCount.loadRelaxed();
+}
+
+quint64 AccountedFile::bytesRead()
+{
+    return AccountedFile::readBytes.loadRelaxed();
+}
+
+quint64 AccountedFile::bytesWritten()
+{
+    return AccountedFile::writtenBytes.loadRelaxed();
+}
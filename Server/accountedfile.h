@@ -0,0 +1,30 @@
+#ifndef ACCOUNTEDFILE_H
+#define ACCOUNTEDFILE_H
+
+#include <QtCore>
+
+//QFile counting the opens and the bytes read from and written to
+//the storage, the counters are shared by all the storage files
+class AccountedFile : public QFile
+{
+public:
+    explicit AccountedFile(const QString &name);
+
+    bool open(OpenMode mode) override;
+
+    static quint64 opens();
+    static quint64 bytesRead();
+    static quint64 bytesWritten();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 readLineData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private:
+    static QAtomicInteger<quint64> opensCount;
+    static QAtomicInteger<quint64> readBytes;
+    static QAtomicInteger<quint64> writtenBytes;
+};
+
+#endif // ACCOUNTEDFILE_H
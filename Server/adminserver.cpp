@@ -0,0 +1,88 @@
+#include "adminserver.h"
+
+AdminServer::AdminServer(QObject *parent)
+    : QObject(parent)
+{
+    this->server = new QTcpServer(this);
+    connect(this->server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
+}
+
+bool AdminServer::listen(const QHostAddress &address, const quint16 &port)
+{
+    if (!this->server->listen(address, port))
+    {
+        qDebug() << "Unable to listen admin port" << port;
+        return false;
+    }
+    return true;
+}
+
+void AdminServer::addRoute(const QString &path, const QByteArray &contentType, const Handler &handler)
+{
+    Route route;
+    route.contentType = contentType;
+    route.handler = handler;
+    this->routes.insert(path, route);
+}
+
+void AdminServer::slotNewConnection()
+{
+    while (this->server->hasPendingConnections())
+    {
+        QTcpSocket *socket = this->server->nextPendingConnection();
+        this->requests.insert(socket, QByteArray());
+        connect(socket, SIGNAL(readyRead()), this, SLOT(slotReadRequest()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
+    }
+}
+
+void AdminServer::slotDisconnected()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    this->requests.remove(socket);
+    socket->deleteLater();
+}
+
+void AdminServer::slotReadRequest()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    auto request = this->requests.find(socket);
+    if (request == this->requests.end())
+        return;
+
+    request.value() += socket->readAll();
+    if (!request->contains("\r\n\r\n"))
+    {
+        if (request->size() > AdminServer::maxRequestSize)
+        {
+            this->requests.erase(request);
+            this->respond(socket, "431 Request Header Fields Too Large", "text/plain", "");
+        }
+        return;
+    }
+
+    //"GET /path?query HTTP/1.1", the query string is ignored
+    QList<QByteArray> requestLine = request->left(request->indexOf("\r\n")).split(' ');
+    this->requests.erase(request);
+    if (requestLine.size() < 2 || requestLine[0] != "GET")
+        return this->respond(socket, "405 Method Not Allowed", "text/plain", "");
+
+    QString path = QString::fromUtf8(requestLine[1]).section('?', 0, 0);
+    auto route = this->routes.constFind(path);
+    if (route == this->routes.constEnd())
+        return this->respond(socket, "404 Not Found", "text/plain", "");
+
+    this->respond(socket, "200 OK", route->contentType, route->handler());
+}
+
+void AdminServer::respond(QTcpSocket *socket, const QByteArray &status,
+                          const QByteArray &contentType, const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.1 " + status + "\r\n";
+    response += "Content-Type: " + contentType + "\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
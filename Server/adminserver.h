@@ -0,0 +1,44 @@
+#ifndef ADMINSERVER_H
+#define ADMINSERVER_H
+
+#include <QtCore>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <functional>
+
+//minimal http server for the operators, every route is a GET
+//returning a generated document, one request per connection
+class AdminServer : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<QByteArray()> Handler;
+
+    explicit AdminServer(QObject *parent = nullptr);
+
+    bool listen(const QHostAddress &address, const quint16 &port);
+    void addRoute(const QString &path, const QByteArray &contentType, const Handler &handler);
+
+public slots:
+    void slotNewConnection();
+    void slotReadRequest();
+    void slotDisconnected();
+
+private:
+    struct Route
+    {
+        QByteArray  contentType;
+        Handler     handler;
+    };
+
+    QTcpServer *server;
+    QHash<QString, Route> routes;
+    QHash<QTcpSocket*, QByteArray> requests;
+
+    static const int maxRequestSize = 8192;
+
+    void respond(QTcpSocket *socket, const QByteArray &status,
+                 const QByteArray &contentType, const QByteArray &body);
+};
+
+#endif // ADMINSERVER_H
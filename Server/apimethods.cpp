@@ -0,0 +1,618 @@
+#include "tcpserver.h"
+#include "exceptions.h"
+
+QHash<QString, Server::ApiMethod> Server::apiMethods = QHash<QString, Server::ApiMethod>();
+
+void Server::registerApiMethod(const QString&            name,
+                               ApiHandler                handler,
+                               bool                      needsToken,
+                               bool                      readOnly,
+                               const QVector<ApiParam>&  schema)
+{
+    ApiMethod apiMethod;
+    apiMethod.handler       = handler;
+    apiMethod.needsToken    = needsToken;
+    apiMethod.readOnly      = readOnly;
+    apiMethod.schema        = schema;
+    if (Server::config.methodLimits.contains(name))
+        apiMethod.limiter.setLimit(Server::config.methodLimits[name].first,
+                                   Server::config.methodLimits[name].second);
+    Server::apiMethods.insert(name, apiMethod);
+}
+
+void Server::registerApiMethods()
+{
+    if (!Server::apiMethods.isEmpty())
+        return;
+
+    //methods that dont need access tokens
+    Server::registerApiMethod("access_token.change", &Server::apiChangeAccessToken, false, false,
+                              {{ApiParams::USERNAME,          NO_USER_ID,             false},
+                               {ApiParams::PASSWORD,          NO_USER_PASSWORD,       false}});
+
+    Server::registerApiMethod("user.create", &Server::apiCreateUser, false, false,
+                              {{ApiParams::USERNAME,          NO_USERNAME,            false},
+                               {ApiParams::PASSWORD,          NO_USER_PASSWORD,       false}});
+
+    //for other queries access token is essential
+    Server::registerApiMethod("user.getmyinfo", &Server::apiGetMyInfo, true, true);
+
+    Server::registerApiMethod("chat.get", &Server::apiGetChat, true, true,
+                              {{ApiParams::CHAT_ID,           NO_CHAT_ID,             true}});
+
+    Server::registerApiMethod("chat.set.property", &Server::apiSetChatProperty, true, false,
+                              {{ApiParams::CHAT_ID,           NO_CHAT_ID,             true},
+                               {ApiParams::PROPERTY,          NO_CHAT_PROPERTY,       false},
+                               {ApiParams::VALUE,             NO_CHAT_PROPERTY_VALUE, false}});
+
+    Server::registerApiMethod("chat.addmember", &Server::apiAddChatMember, true, false,
+                              {{ApiParams::CHAT_ID,           NO_CHAT_ID,             true},
+                               {ApiParams::USER_ID,           NO_USER_ID,             true}});
+
+    Server::registerApiMethod("chat.kickmember", &Server::apiKickChatMember, true, false,
+                              {{ApiParams::CHAT_ID,           NO_CHAT_ID,             true},
+                               {ApiParams::USER_ID,           NO_USER_ID,             true}});
+
+    Server::registerApiMethod("chat.sendmessage", &Server::apiSendMessage, true, false,
+                              {{ApiParams::CHAT_ID,           NO_CHAT_ID,             true},
+                               {ApiParams::TEXT,              NO_MESSAGE_TEXT,        false}});
+
+    //after_id leaves out the messages the client has, as in user.getmyinfo
+    Server::registerApiMethod("chat.getlastmessages", &Server::apiGetLastMessages, true, true,
+                              {{ApiParams::CHAT_ID,           NO_CHAT_ID,             false},
+                               {ApiParams::NUM,               NO_LAST_MESSAGES_NUM,   false}});
+
+    //older messages page by page, before_id is the oldest message the client has
+    Server::registerApiMethod("chat.gethistory", &Server::apiGetHistory, true, true,
+                              {{ApiParams::CHAT_ID,           NO_CHAT_ID,             true},
+                               {ApiParams::BEFORE_ID,         INCORRECT_VALUE,        true},
+                               {ApiParams::NUM,               NO_LAST_MESSAGES_NUM,   true}});
+
+    Server::registerApiMethod("chat.create", &Server::apiCreateChat, true, false,
+                              {{ApiParams::IS_VISIBLE,        NO_CHAT_VISIBILITY,     false},
+                               {ApiParams::NAME,              NO_CHAT_NAME,           false},
+                               {ApiParams::MEMBERS,           NO_CHAT_MEMBERS,        false}});
+
+    //keeps the connection registered as a live session of the user,
+    //new messages of the user chats are pushed into it as they are sent
+    Server::registerApiMethod("events.subscribe", &Server::apiSubscribeEvents, true, true);
+
+    //the same for a reconnecting client, which also gets
+    //what it missed in its chats while it was away
+    Server::registerApiMethod("session.resume", &Server::apiResumeSession, true, true);
+
+    //role of the node, followers report how far behind the leader they are
+    Server::registerApiMethod("replication.status", &Server::apiReplicationStatus, true, true);
+
+    //live internals, for the users listed in the admin section of the config
+    Server::registerApiMethod("server.stats", &Server::apiServerStats, true, true);
+
+    //called by the router only, with the shard secret. whois finds a user
+    //of this shard by access_token, username or user_id, addmembership
+    //lists a chat of another shard in the chats of a user of this one
+    Server::registerApiMethod("internal.whois", &Server::apiWhois, false, true);
+
+    Server::registerApiMethod("internal.addmembership", &Server::apiAddMembership, false, false,
+                              {{ApiParams::USER_ID,           NO_USER_ID,             true},
+                               {ApiParams::CHAT_ID,           NO_CHAT_ID,             true},
+                               {ApiParams::NAME,              NO_CHAT_NAME,           false}});
+}
+
+Server::apiErrorCode Server::validateParams(const ApiParams&          params,
+                                            const QVector<ApiParam>&  schema)
+{
+    //all the missing parameters are reported before incorrect values
+    for (const ApiParam &i: schema)
+        if (!params.has(i.field))
+            return i.missingError;
+
+    if (params.isOutOfRange)
+        return INCORRECT_VALUE;
+
+    for (const ApiParam &i: schema)
+        if (i.nonNegative && params.number(i.field) < 0)
+            return INCORRECT_VALUE;
+
+    return NULL_ERROR;
+}
+
+void Server::apiChangeAccessToken(const ApiRequest &request, QByteArray &out)
+{
+    size_t userID;
+    try
+    {
+        userID = Server::getIDFromUsername(request.params.username);
+    }
+    catch (const UserNotFoundException &e)
+    {
+        return Server::writeError(out, USER_VALIDATION_FAILURE);
+    }
+
+    QString passwordHash = Server::getPasswordHash(userID);
+    if (passwordHash.isEmpty())
+        return Server::writeError(out, USER_VALIDATION_FAILURE);
+
+    //the slow hash is verified on the auth pool, the response
+    //is written to the connection when the job is done
+    QString password = request.params.password,
+            method = request.params.method;
+    QPointer<QTcpSocket> socket = request.socket;
+    bool queued = Server::runAuthJob([password, passwordHash]()
+    {
+        return QVariant(PasswordHasher::verify(password, passwordHash));
+    },
+    [socket, method, userID, password, passwordHash](const QVariant &verified)
+    {
+        QByteArray response;
+        if (!verified.toBool())
+            Server::writeError(response, USER_VALIDATION_FAILURE);
+        else
+        {
+            Server::writeResponse(response, Server::updAccessToken(userID));
+            if (PasswordHasher::needsRehash(passwordHash, Server::config.passwordHashIterations))
+                Server::rehashPassword(userID, password);
+        }
+        Server::writeDeferred(socket, method, response);
+    });
+
+    if (!queued)
+        return Server::writeError(out, SERVER_IS_BUSY);
+    Server::deferResponse();
+}
+
+void Server::apiCreateUser(const ApiRequest &request, QByteArray &out)
+{
+    try
+    {
+        Server::getIDFromUsername(request.params.username);
+        return Server::writeError(out, USER_ALREADY_EXISTS);
+    }
+    catch (const UserNotFoundException &e)
+    {
+        //qDebug() << "User doesnt exist";
+    }
+
+    QString username = request.params.username,
+            password = request.params.password,
+            method = request.params.method;
+    const int iterations = Server::config.passwordHashIterations;
+    QPointer<QTcpSocket> socket = request.socket;
+    bool queued = Server::runAuthJob([password, iterations]()
+    {
+        return QVariant(PasswordHasher::hash(password, iterations));
+    },
+    [socket, method, username](const QVariant &passwordHash)
+    {
+        QByteArray response;
+        //the username could have been taken while the password was hashed
+        if (Server::usernames.contains(username))
+            Server::writeError(response, USER_ALREADY_EXISTS);
+        else
+            Server::writeResponse(response, Server::createUser(username, passwordHash.toString()));
+        Server::writeDeferred(socket, method, response);
+    });
+
+    if (!queued)
+        return Server::writeError(out, SERVER_IS_BUSY);
+    Server::deferResponse();
+}
+
+void Server::apiGetMyInfo(const ApiRequest &request, QByteArray &out)
+{
+    const ApiParams &params = request.params;
+
+    //a message sent along with the poll costs the same
+    //as one sent by chat.sendmessage
+    if (params.has(ApiParams::MESSAGE_TO_SEND))
+    {
+        qint64 retryAfterMs;
+        auto sendMethod = Server::apiMethods.find("chat.sendmessage");
+        if (sendMethod != Server::apiMethods.end() &&
+            !sendMethod->limiter.tryAcquire(request.limiterKey, retryAfterMs))
+            return Server::writeResponse(out, Server::generateRateLimitJson(retryAfterMs));
+    }
+
+    const int responseStart = out.size();
+    try
+    {
+        out += '{';
+        JsonWriter::writeKey(out, "username");
+        JsonWriter::writeString(out, Server::getUsernameByID(request.senderID));
+        out += ',';
+        JsonWriter::writeKey(out, "chat_membership");
+        JsonWriter::write(out, Server::getChatMembership(request.senderID));
+        if (params.has(ApiParams::CURRENT_CHAT_ID) && params.currentChatID >= 0
+         && params.has(ApiParams::MESSAGES_NUM) && params.messagesNum > 0)
+        {
+            //the history is spliced from the cached encoded messages,
+            //a client with a local copy of it only gets the messages after
+            //the last one it has
+            const int newestMessagesStart = out.size();
+            try
+            {
+                out += ',';
+                JsonWriter::writeKey(out, "newest_messages");
+                out += '{';
+                JsonWriter::writeKey(out, "chat_id");
+                JsonWriter::writeNumber(out, params.currentChatID);
+                out += ',';
+                JsonWriter::writeKey(out, "messages");
+                Server::writeNewestMessages(out,
+                                            params.currentChatID,
+                                            request.senderID,
+                                            params.messagesNum,
+                                            params.has(ApiParams::AFTER_ID) ? params.afterID : -1);
+                out += '}';
+            }
+            catch (const UserIsNotMemberOfChatException &e)
+            {
+                out.truncate(newestMessagesStart);
+            }
+        }
+        out += "}\n";
+        if (params.has(ApiParams::MESSAGE_TO_SEND))
+        {
+            Server::sendMessage(
+                        params.messageChatID,
+                        params.messageText,
+                        request.senderID);
+            //qDebug() << "sent message";
+        }
+    }
+    catch (const UserNotFoundException &e)
+    {
+        out.truncate(responseStart);
+        return Server::writeError(out, USER_DOES_NOT_EXIST);
+    }
+}
+
+void Server::apiGetChat(const ApiRequest &request, QByteArray &out)
+{
+    size_t chatID = request.params.chatID;
+
+    QJsonObject response;
+    try
+    {
+        response = Server::getChatInfo(chatID, request.senderID);
+    }
+    catch (const ChatIsNotVisibleException &e)
+    {
+        return Server::writeError(out, apiErrorCode::CHAT_IS_NOT_VISIBLE);
+    }
+
+    return Server::writeResponse(out, response);
+}
+
+void Server::apiSetChatProperty(const ApiRequest &request, QByteArray &out)
+{
+    QString property = request.params.property,
+            value    = request.params.value;
+    size_t chatID = request.params.chatID;
+
+    QJsonObject chatInfo;
+    try
+    {
+        chatInfo = Server::getChatInfo(chatID, request.senderID);
+    }
+    catch (const ChatIsNotVisibleException &e)
+    {
+        return Server::writeError(out, apiErrorCode::CHAT_IS_NOT_VISIBLE);
+    }
+
+    if (!chatInfo.contains(property) ||
+        property == "admin" ||
+        property == "members" ||
+        property == "total_messages")
+        return Server::writeError(out, INCORRECT_VALUE);
+
+    chatInfo[property] = value;
+    QJsonObject response;
+    try
+    {
+        response = Server::setChatInfo(chatID, request.senderID, chatInfo);
+    }
+    catch (const UserIsNotAdminException &e)
+    {
+        return Server::writeError(out, apiErrorCode::USER_NOT_ADMIN);
+    }
+
+    return Server::writeResponse(out, response);
+}
+
+void Server::apiAddChatMember(const ApiRequest &request, QByteArray &out)
+{
+    try
+    {
+        //the user is looked up first, so unknown ids never get into the chat
+        const QString username = Server::getUsernameByID(request.params.userID);
+        QJsonObject response = Server::addMemberInChatByUser(
+                    request.params.chatID,
+                    request.senderID,
+                    request.params.userID);
+        QJsonObject serverMessageResponse = Server::sendMessage(
+                    request.params.chatID,
+                    QStringLiteral("%1 was invited in chat").arg(username),
+                    -1,
+                    true);
+        return Server::writeResponse(out, response);
+    }
+    catch (const UserIsNotMemberOfChatException &e)
+    {
+        return Server::writeError(out, USER_NOT_IN_CHAT);
+    }
+    catch (const UserNotFoundException &e)
+    {
+        return Server::writeError(out, USER_DOES_NOT_EXIST);
+    }
+}
+
+void Server::apiKickChatMember(const ApiRequest &request, QByteArray &out)
+{
+    try
+    {
+        const QString username = Server::getUsernameByID(request.params.userID);
+        QJsonObject response = Server::kickMember(
+                    request.params.chatID,
+                    request.senderID,
+                    request.params.userID);
+        QJsonObject serverMessageResponse = Server::sendMessage(
+                    request.params.chatID,
+                    QStringLiteral("%1 was kicked from chat").arg(username),
+                    -1,
+                    true);
+        return Server::writeResponse(out, response);
+    }
+    catch (const UserIsNotAdminException &e)
+    {
+        return Server::writeError(out, USER_NOT_ADMIN);
+    }
+    catch (const UserNotFoundException &e)
+    {
+        return Server::writeError(out, USER_DOES_NOT_EXIST);
+    }
+}
+
+void Server::apiSendMessage(const ApiRequest &request, QByteArray &out)
+{
+    return Server::writeResponse(out, Server::sendMessage(request.params.chatID,
+                                                          request.params.text,
+                                                          request.senderID));
+}
+
+void Server::apiGetLastMessages(const ApiRequest &request, QByteArray &out)
+{
+    const int responseStart = out.size();
+    try
+    {
+        out += '{';
+        JsonWriter::writeKey(out, "chat_id");
+        JsonWriter::writeNumber(out, request.params.chatID);
+        out += ',';
+        JsonWriter::writeKey(out, "newest_messages");
+        Server::writeNewestMessages(out,
+                                    request.params.chatID,
+                                    request.senderID,
+                                    request.params.num,
+                                    request.params.has(ApiParams::AFTER_ID) ? request.params.afterID : -1);
+        out += "}\n";
+    }
+    catch (const UserIsNotMemberOfChatException &e)
+    {
+        out.truncate(responseStart);
+        return Server::writeError(out, USER_NOT_IN_CHAT);
+    }
+}
+
+void Server::apiGetHistory(const ApiRequest &request, QByteArray &out)
+{
+    const ApiParams &params = request.params;
+    qint64 totalMessages;
+    try
+    {
+        totalMessages = Server::getMemberChatInfo(params.chatID, request.senderID)["total_messages"].toInt();
+    }
+    catch (const UserIsNotMemberOfChatException &e)
+    {
+        return Server::writeError(out, USER_NOT_IN_CHAT);
+    }
+
+    const qint64 beforeMessageID = qMin(params.beforeID, totalMessages),
+                 messagesNum = qMin<qint64>(params.num, Server::maxHistoryPage);
+
+    out += '{';
+    JsonWriter::writeKey(out, "chat_id");
+    JsonWriter::writeNumber(out, params.chatID);
+    out += ',';
+    JsonWriter::writeKey(out, "history");
+    Server::writeMessagesRange(out, params.chatID, qMax<qint64>(0, beforeMessageID - messagesNum), beforeMessageID);
+    out += "}\n";
+}
+
+void Server::apiCreateChat(const ApiRequest &request, QByteArray &out)
+{
+    QJsonArray members = QJsonArray::fromStringList(request.params.members);
+    return Server::writeResponse(out, Server::createChat(request.params.name,
+                                                         members,
+                                                         request.senderID,
+                                                         request.params.isVisible));
+}
+
+void Server::apiSubscribeEvents(const ApiRequest &request, QByteArray &out)
+{
+    if (request.socket == nullptr)
+        return Server::writeError(out, UNKNOWN_ERROR);
+
+    //sessions live on the shard of their user, the bus brings them
+    //the events of the chats on the other shards
+    if (Server::ownsUser(request.senderID))
+        Server::sessions.add(request.senderID, request.socket);
+    return Server::writeError(out, NULL_ERROR);
+}
+
+void Server::apiResumeSession(const ApiRequest &request, QByteArray &out)
+{
+    const ApiParams &params = request.params;
+    if (request.socket == nullptr)
+        return Server::writeError(out, UNKNOWN_ERROR);
+    if (params.watermarks.size() > Server::maxResumedChats)
+        return Server::writeError(out, INCORRECT_VALUE);
+
+    //subscribed before reading, a message sent meanwhile is either
+    //in the response or pushed as an event, it is never lost. the
+    //router resumes the chats of the other shards after the shard of
+    //the user has subscribed, they only answer for their chats
+    const bool isOwnUser = Server::ownsUser(request.senderID);
+    if (isOwnUser)
+        Server::sessions.add(request.senderID, request.socket);
+
+    out += '{';
+    if (isOwnUser)
+    {
+        JsonWriter::writeKey(out, "chat_membership");
+        JsonWriter::write(out, Server::getChatMembership(request.senderID));
+        out += ',';
+    }
+    JsonWriter::writeKey(out, "resumed");
+    out += '[';
+    bool first = true;
+    for (const QPair<qint64, qint64> &i: params.watermarks)
+    {
+        if (i.first < 0)
+            continue;
+
+        qint64 totalMessages;
+        try
+        {
+            totalMessages = Server::getMemberChatInfo(i.first, request.senderID)["total_messages"].toInt();
+        }
+        catch (const UserIsNotMemberOfChatException &e)
+        {
+            continue;
+        }
+
+        //only the chats with new messages are in the response
+        const qint64 fromMessageID = qMax(i.second + 1, totalMessages - Server::maxResumedMessages);
+        if (fromMessageID >= totalMessages)
+            continue;
+
+        if (!first)
+            out += ',';
+        first = false;
+        out += '{';
+        JsonWriter::writeKey(out, "chat_id");
+        JsonWriter::writeNumber(out, i.first);
+        out += ',';
+        JsonWriter::writeKey(out, "messages");
+        Server::writeMessagesRange(out, i.first, fromMessageID, totalMessages);
+        out += '}';
+    }
+    out += "]}\n";
+}
+
+void Server::apiReplicationStatus(const ApiRequest &request, QByteArray &out)
+{
+    Q_UNUSED(request);
+
+    QJsonObject response;
+    response.insert("role", Server::config.replicationRole);
+    response.insert("last_seq", static_cast<double>(Server::replicationLog != nullptr ? Server::replicationLog->lastSeq() : 0));
+    if (Server::replicationLeader != nullptr)
+        response.insert("followers", Server::replicationLeader->followersStatus());
+    if (Server::replicationFollower != nullptr)
+    {
+        const ReplicationFollower *follower = Server::replicationFollower;
+        response.insert("connected",   follower->isConnected());
+        response.insert("leader_seq",  static_cast<double>(follower->leaderSeq()));
+        response.insert("lag_entries", static_cast<double>(follower->leaderSeq() - follower->appliedSeq()));
+        response.insert("lag_ms",      static_cast<double>(follower->lagMs()));
+    }
+    return Server::writeResponse(out, response);
+}
+
+void Server::apiServerStats(const ApiRequest &request, QByteArray &out)
+{
+    bool isServerAdmin = false;
+    for (const QString &i: Server::config.adminUsers)
+    {
+        auto userID = Server::usernames.constFind(i.trimmed());
+        if (userID != Server::usernames.constEnd() && userID.value() == request.senderID)
+            isServerAdmin = true;
+    }
+    if (!isServerAdmin)
+        return Server::writeError(out, ACCESS_DENIED);
+
+    return Server::writeResponse(out, Server::instance->statsJson());
+}
+
+void Server::apiWhois(const ApiRequest &request, QByteArray &out)
+{
+    if (!request.isFromRouter)
+        return Server::writeError(out, ACCESS_DENIED);
+
+    const ApiParams &params = request.params;
+    size_t userID;
+    if (params.has(ApiParams::ACCESS_TOKEN))
+    {
+        //callApiMethod has looked the token up already
+        if (request.senderID == static_cast<size_t>(-1))
+            return Server::writeError(out, TOKEN_VALIDATION_FAILURE);
+        userID = request.senderID;
+        Server::renewAccessToken(userID);
+    }
+    else if (params.has(ApiParams::USERNAME))
+    {
+        try
+        {
+            userID = Server::getIDFromUsername(params.username);
+        }
+        catch (const UserNotFoundException &e)
+        {
+            return Server::writeError(out, USER_DOES_NOT_EXIST);
+        }
+    }
+    else if (params.has(ApiParams::USER_ID) && params.userID >= 0 && Server::ownsUser(params.userID))
+        userID = params.userID;
+    else
+        return Server::writeError(out, USER_DOES_NOT_EXIST);
+
+    QJsonObject response;
+    try
+    {
+        response.insert("user_id", static_cast<double>(userID));
+        response.insert("username", Server::getUsernameByID(userID));
+    }
+    catch (const UserNotFoundException &e)
+    {
+        return Server::writeError(out, USER_DOES_NOT_EXIST);
+    }
+    return Server::writeResponse(out, response);
+}
+
+void Server::apiAddMembership(const ApiRequest &request, QByteArray &out)
+{
+    if (!request.isFromRouter)
+        return Server::writeError(out, ACCESS_DENIED);
+
+    const ApiParams &params = request.params;
+    if (!Server::ownsUser(params.userID))
+        return Server::writeError(out, USER_DOES_NOT_EXIST);
+
+    try
+    {
+        Server::addChatMembership(params.userID, params.chatID, params.name);
+    }
+    catch (const UserNotFoundException &e)
+    {
+        return Server::writeError(out, USER_DOES_NOT_EXIST);
+    }
+    catch (const UserIsAlreadyInChatException &e)
+    {
+        return Server::writeError(out, USER_ALREADY_IN_CHAT);
+    }
+
+    Server::replicate({{"op",      "membership.add"},
+                       {"user_id", static_cast<double>(params.userID)},
+                       {"chat_id", static_cast<double>(params.chatID)},
+                       {"name",    params.name}});
+    return Server::writeError(out, NULL_ERROR);
+}
@@ -0,0 +1,62 @@
+#include "chatactivity.h"
+#include <cmath>
+
+ChatActivity::ChatActivity(qint64 windowMs)
+{
+    this->windowMs = qMax<qint64>(windowMs, 1);
+}
+
+double ChatActivity::decayed(const Rate &rate, const qint64 &nowMs) const
+{
+    return rate.count * std::exp(-double(qMax<qint64>(nowMs - rate.lastMs, 0)) / this->windowMs);
+}
+
+void ChatActivity::record(const size_t &chatID, const qint64 &nowMs)
+{
+    auto rate = this->chats.find(chatID);
+    if (rate == this->chats.end())
+        this->chats.insert(chatID, {1, nowMs});
+    else
+    {
+        rate->count = this->decayed(rate.value(), nowMs) + 1;
+        rate->lastMs = nowMs;
+    }
+
+    if (++this->recordsSincePrune >= 4096)
+        this->prune(nowMs);
+}
+
+void ChatActivity::prune(const qint64 &nowMs)
+{
+    this->recordsSincePrune = 0;
+    for (auto i = this->chats.begin(); i != this->chats.end();)
+    {
+        if (this->decayed(i.value(), nowMs) < 0.01)
+            i = this->chats.erase(i);
+        else
+            ++i;
+    }
+}
+
+QVector<QPair<size_t, double>> ChatActivity::hottest(int n, const qint64 &nowMs)
+{
+    this->prune(nowMs);
+    QVector<QPair<size_t, double>> rates;
+    rates.reserve(this->chats.size());
+    for (auto i = this->chats.constBegin(); i != this->chats.constEnd(); ++i)
+        rates.append({i.key(), this->decayed(i.value(), nowMs)});
+
+    n = qBound(0, n, rates.size());
+    std::partial_sort(rates.begin(), rates.begin() + n, rates.end(),
+                      [](const QPair<size_t, double> &a, const QPair<size_t, double> &b)
+    {
+        return a.second > b.second;
+    });
+    rates.resize(n);
+    return rates;
+}
+
+int ChatActivity::chatsCount() const
+{
+    return this->chats.size();
+}
@@ -0,0 +1,38 @@
+#ifndef CHATACTIVITY_H
+#define CHATACTIVITY_H
+
+#include <QtCore>
+
+//exponentially weighted message rate of every chat, a message adds
+//one to the count of its chat and counts decay with the time constant
+//of the window, so the count is the messages of about the last window
+class ChatActivity
+{
+public:
+    explicit ChatActivity(qint64 windowMs = 60000);
+
+    void record(const size_t &chatID, const qint64 &nowMs);
+
+    //the n chats with the biggest rates, in messages per window
+    QVector<QPair<size_t, double>> hottest(int n, const qint64 &nowMs);
+
+    int chatsCount() const;
+
+private:
+    struct Rate
+    {
+        double count;
+        qint64 lastMs;
+    };
+
+    QHash<size_t, Rate> chats;
+    qint64 windowMs;
+    int recordsSincePrune = 0;
+
+    double decayed(const Rate &rate, const qint64 &nowMs) const;
+
+    //forgets chats whose rate has decayed to nothing
+    void prune(const qint64 &nowMs);
+};
+
+#endif // CHATACTIVITY_H
@@ -9,8 +9,32 @@ CONFIG -= app_bundle
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+        accountedfile.cpp \
+        adminserver.cpp \
+        apimethods.cpp \
+        chatactivity.cpp \
+        consistenthashring.cpp \
+        jsonwriter.cpp \
+        latencyhistogram.cpp \
         main.cpp \
-        tcpserver.cpp
+        messagebus.cpp \
+        messagecache.cpp \
+        metrics.cpp \
+        passwordhasher.cpp \
+        peerauth.cpp \
+        ratelimiter.cpp \
+        replicationfollower.cpp \
+        replicationleader.cpp \
+        replicationlog.cpp \
+        requestdecoder.cpp \
+        requestprofile.cpp \
+        serverconfig.cpp \
+        sessionregistry.cpp \
+        shardrouter.cpp \
+        tcpserver.cpp \
+        timerwheel.cpp \
+        tracer.cpp \
+        trafficcapture.cpp
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -18,7 +42,30 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    accountedfile.h \
+    adminserver.h \
+    chatactivity.h \
+    consistenthashring.h \
     exceptions.h \
-    tcpserver.h
+    jsonwriter.h \
+    latencyhistogram.h \
+    messagebus.h \
+    messagecache.h \
+    metrics.h \
+    passwordhasher.h \
+    peerauth.h \
+    ratelimiter.h \
+    replicationfollower.h \
+    replicationleader.h \
+    replicationlog.h \
+    requestdecoder.h \
+    requestprofile.h \
+    serverconfig.h \
+    sessionregistry.h \
+    shardrouter.h \
+    tcpserver.h \
+    timerwheel.h \
+    tracer.h \
+    trafficcapture.h
 
 FORMS +=
@@ -0,0 +1,104 @@
+#include "consistenthashring.h"
+
+ConsistentHashRing::ConsistentHashRing(int virtualNodes)
+{
+    this->virtualNodes = qMax(virtualNodes, 1);
+}
+
+void ConsistentHashRing::addNode(const QString &node)
+{
+    if (this->nodesSet.contains(node))
+        return;
+    this->nodesSet.insert(node);
+    for (int i = 0; i < this->virtualNodes; ++i)
+        this->ring.insert(ConsistentHashRing::hash(QStringLiteral("%1#%2").arg(node).arg(i).toUtf8()), node);
+}
+
+void ConsistentHashRing::removeNode(const QString &node)
+{
+    if (!this->nodesSet.remove(node))
+        return;
+    for (int i = 0; i < this->virtualNodes; ++i)
+    {
+        auto point = this->ring.find(ConsistentHashRing::hash(QStringLiteral("%1#%2").arg(node).arg(i).toUtf8()));
+        if (point != this->ring.end() && point.value() == node)
+            this->ring.erase(point);
+    }
+}
+
+QStringList ConsistentHashRing::nodes() const
+{
+    return this->nodesSet.values();
+}
+
+bool ConsistentHashRing::isEmpty() const
+{
+    return this->ring.isEmpty();
+}
+
+QString ConsistentHashRing::node(const QByteArray &key) const
+{
+    if (this->ring.isEmpty())
+        return QString();
+
+    //the first virtual node clockwise from the key, wrapping around
+    auto point = this->ring.lowerBound(ConsistentHashRing::hash(key));
+    if (point == this->ring.constEnd())
+        point = this->ring.constBegin();
+    return point.value();
+}
+
+quint64 ConsistentHashRing::hash(const QByteArray &key)
+{
+    //fnv-1a with a splitmix finalizer, qHash is seeded per process
+    quint64 h = 14695981039346656037ULL;
+    for (char c: key)
+    {
+        h ^= static_cast<quint8>(c);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+QByteArray ConsistentHashRing::chatKey(const quint64 &chatID)
+{
+    return "chat:" + QByteArray::number(chatID);
+}
+
+QByteArray ConsistentHashRing::userKey(const QString &username)
+{
+    return "user:" + username.toUtf8();
+}
+
+
+quint64 ConsistentHashRing::shardUserID(const quint64 &slot, const int &shardIndex)
+{
+    return slot * ConsistentHashRing::maxShards + shardIndex;
+}
+
+quint64 ConsistentHashRing::userSlot(const quint64 &userID)
+{
+    return userID / ConsistentHashRing::maxShards;
+}
+
+int ConsistentHashRing::userShardIndex(const quint64 &userID)
+{
+    return userID % ConsistentHashRing::maxShards;
+}
+
+QString ConsistentHashRing::tokenPrefix(const int &shardIndex)
+{
+    return QStringLiteral("%1").arg(shardIndex, ConsistentHashRing::tokenPrefixLen, 16, QLatin1Char('0'));
+}
+
+int ConsistentHashRing::tokenShardIndex(const QString &token)
+{
+    bool ok;
+    const int shardIndex = token.left(ConsistentHashRing::tokenPrefixLen).toInt(&ok, 16);
+    return ok && shardIndex >= 0 && shardIndex < int(ConsistentHashRing::maxShards) ? shardIndex : -1;
+}
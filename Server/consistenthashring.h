@@ -0,0 +1,50 @@
+#ifndef CONSISTENTHASHRING_H
+#define CONSISTENTHASHRING_H
+
+#include <QtCore>
+
+//maps keys to nodes through a ring of virtual nodes, adding or
+//removing a node moves only the keys of the ring arcs it owns.
+//the hash is stable across processes, so the router and every
+//shard agree on the owner of a key
+class ConsistentHashRing
+{
+public:
+    ConsistentHashRing(int virtualNodes = 160);
+
+    void addNode(const QString &node);
+    void removeNode(const QString &node);
+    QStringList nodes() const;
+    bool isEmpty() const;
+
+    //empty string if the ring has no nodes
+    QString node(const QByteArray &key) const;
+
+    static quint64 hash(const QByteArray &key);
+
+    //keys of the sharded state, chats by id and new users by username
+    static QByteArray chatKey(const quint64 &chatID);
+    static QByteArray userKey(const QString &username);
+
+    //user ids of a sharded deployment carry the index of the shard
+    //the user lives on, so every node finds it from the id alone.
+    //slot is the position of the user in the storage of its shard
+    static const quint64 maxShards = 1024;
+    static quint64 shardUserID(const quint64 &slot, const int &shardIndex);
+    static quint64 userSlot(const quint64 &userID);
+    static int userShardIndex(const quint64 &userID);
+
+    //tokens start with the same index in hex, so they are routed to
+    //the shard of their user however the ring changes. -1 if the
+    //token has no valid prefix
+    static const int tokenPrefixLen = 3;
+    static QString tokenPrefix(const int &shardIndex);
+    static int tokenShardIndex(const QString &token);
+
+private:
+    int virtualNodes;
+    QMap<quint64, QString> ring;
+    QSet<QString> nodesSet;
+};
+
+#endif // CONSISTENTHASHRING_H
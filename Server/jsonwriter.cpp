@@ -0,0 +1,114 @@
+#include "jsonwriter.h"
+#include <cmath>
+
+void JsonWriter::write(QByteArray &out, const QJsonValue &value)
+{
+    switch (value.type())
+    {
+    case QJsonValue::Bool:
+        out += value.toBool() ? "true" : "false";
+        break;
+
+    case QJsonValue::Double:
+        JsonWriter::writeNumber(out, value.toDouble());
+        break;
+
+    case QJsonValue::String:
+        JsonWriter::writeString(out, value.toString());
+        break;
+
+    case QJsonValue::Array:
+        JsonWriter::write(out, value.toArray());
+        break;
+
+    case QJsonValue::Object:
+        JsonWriter::write(out, value.toObject());
+        break;
+
+    default:
+        out += "null";
+        break;
+    }
+}
+
+void JsonWriter::write(QByteArray &out, const QJsonObject &object)
+{
+    out += '{';
+    bool first = true;
+    for (auto i = object.constBegin(); i != object.constEnd(); ++i)
+    {
+        if (!first)
+            out += ',';
+        first = false;
+        JsonWriter::writeKey(out, i.key());
+        JsonWriter::write(out, i.value());
+    }
+    out += '}';
+}
+
+void JsonWriter::write(QByteArray &out, const QJsonArray &array)
+{
+    out += '[';
+    bool first = true;
+    for (QJsonValue i: array)
+    {
+        if (!first)
+            out += ',';
+        first = false;
+        JsonWriter::write(out, i);
+    }
+    out += ']';
+}
+
+void JsonWriter::writeKey(QByteArray &out, const QString &key)
+{
+    JsonWriter::writeString(out, key);
+    out += ':';
+}
+
+void JsonWriter::writeString(QByteArray &out, const QString &str)
+{
+    JsonWriter::writeString(out, str.toUtf8());
+}
+
+void JsonWriter::writeString(QByteArray &out, const QByteArray &utf8)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    out.reserve(out.size() + utf8.size() + 2);
+    out += '"';
+    for (char c: utf8)
+    {
+        switch (c)
+        {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b";  break;
+        case '\f': out += "\\f";  break;
+        case '\n': out += "\\n";  break;
+        case '\r': out += "\\r";  break;
+        case '\t': out += "\\t";  break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                out += "\\u00";
+                out += hexDigits[(c >> 4) & 0xf];
+                out += hexDigits[c & 0xf];
+            }
+            else
+                out += c;
+            break;
+        }
+    }
+    out += '"';
+}
+
+void JsonWriter::writeNumber(QByteArray &out, const double &number)
+{
+    //same output as QJsonDocument: integers without exponent or fraction
+    if (!qIsFinite(number))
+        out += "null";
+    else if (number == std::floor(number) && qAbs(number) <= 9007199254740992.0)
+        out += QByteArray::number(static_cast<qint64>(number));
+    else
+        out += QByteArray::number(number, 'g', QLocale::FloatingPointShortest);
+}
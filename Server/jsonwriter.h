@@ -0,0 +1,23 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QtCore>
+
+//compact json serializer that appends straight into a caller
+//owned buffer, so responses are built without an intermediate
+//QJsonDocument, QByteArray or QString copy
+class JsonWriter
+{
+public:
+    static void write(QByteArray &out, const QJsonValue &value);
+    static void write(QByteArray &out, const QJsonObject &object);
+    static void write(QByteArray &out, const QJsonArray &array);
+    static void writeString(QByteArray &out, const QString &str);
+    static void writeString(QByteArray &out, const QByteArray &utf8);
+    static void writeNumber(QByteArray &out, const double &number);
+
+    //writes "key": so raw pre-encoded values can be appended after it
+    static void writeKey(QByteArray &out, const QString &key);
+};
+
+#endif // JSONWRITER_H
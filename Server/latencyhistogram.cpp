@@ -0,0 +1,81 @@
+#include "latencyhistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+    : counts((LatencyHistogram::maxValueBits - LatencyHistogram::subBucketBits + 1) * LatencyHistogram::subBuckets, 0)
+{
+
+}
+
+int LatencyHistogram::bucketIndex(quint64 value)
+{
+    if (value < static_cast<quint64>(LatencyHistogram::subBuckets))
+        return value;
+
+    //shift keeps the subBucketBits + 1 highest bits of the value
+    const int shift = 63 - qCountLeadingZeroBits(value) - LatencyHistogram::subBucketBits;
+    const int mantissa = value >> shift;
+    return (shift + 1) * LatencyHistogram::subBuckets + mantissa - LatencyHistogram::subBuckets;
+}
+
+quint64 LatencyHistogram::bucketLowerBound(int index)
+{
+    if (index < LatencyHistogram::subBuckets)
+        return index;
+
+    const int shift = index / LatencyHistogram::subBuckets - 1;
+    const quint64 mantissa = LatencyHistogram::subBuckets + index % LatencyHistogram::subBuckets;
+    return mantissa << shift;
+}
+
+quint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    return LatencyHistogram::bucketLowerBound(index + 1) - 1;
+}
+
+void LatencyHistogram::record(quint64 valueUs)
+{
+    valueUs = qMin(valueUs, (Q_UINT64_C(1) << LatencyHistogram::maxValueBits) - 1);
+    ++this->counts[LatencyHistogram::bucketIndex(valueUs)];
+    ++this->total;
+    this->valuesSum += valueUs;
+    this->maxValue = qMax(this->maxValue, valueUs);
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return this->total;
+}
+
+quint64 LatencyHistogram::sum() const
+{
+    return this->valuesSum;
+}
+
+quint64 LatencyHistogram::max() const
+{
+    return this->maxValue;
+}
+
+quint64 LatencyHistogram::percentile(double fraction) const
+{
+    if (this->total == 0)
+        return 0;
+
+    const quint64 rank = qMax<quint64>(qCeil(qBound(0.0, fraction, 1.0) * this->total), 1);
+    quint64 seen = 0;
+    for (int i = 0; i < this->counts.size(); ++i)
+    {
+        seen += this->counts[i];
+        if (seen >= rank)
+            return qMin(LatencyHistogram::bucketUpperBound(i), this->maxValue);
+    }
+    return this->maxValue;
+}
+
+quint64 LatencyHistogram::countNotAbove(quint64 boundUs) const
+{
+    quint64 seen = 0;
+    for (int i = 0; i < this->counts.size() && LatencyHistogram::bucketLowerBound(i) <= boundUs; ++i)
+        seen += this->counts[i];
+    return seen;
+}
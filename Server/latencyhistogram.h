@@ -0,0 +1,42 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtCore>
+
+//log-linear histogram of microsecond durations in the manner of hdr
+//histograms: values below 2^subBucketBits get exact buckets, above
+//that every power of two is split into 2^subBucketBits buckets, so
+//the relative error stays under 3% from microseconds to days
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(quint64 valueUs);
+
+    quint64 count() const;
+    quint64 sum() const;
+    quint64 max() const;
+
+    //upper bound of the bucket holding the given fraction of values
+    quint64 percentile(double fraction) const;
+
+    //number of values not bigger than boundUs, within bucket precision
+    quint64 countNotAbove(quint64 boundUs) const;
+
+private:
+    static const int subBucketBits = 5;
+    static const int subBuckets = 1 << subBucketBits;
+    static const int maxValueBits = 40;
+
+    QVector<quint64> counts;
+    quint64 total = 0;
+    quint64 valuesSum = 0;
+    quint64 maxValue = 0;
+
+    static int bucketIndex(quint64 value);
+    static quint64 bucketLowerBound(int index);
+    static quint64 bucketUpperBound(int index);
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -1,11 +1,21 @@
 #include <QCoreApplication>
 #include "tcpserver.h"
+#include "shardrouter.h"
 
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
 
-    Server server(9999);
+    //several nodes on one host are started with their own config files
+    QStringList arguments = a.arguments();
+    ServerConfig config = ServerConfig::load(arguments.size() > 1 ? arguments[1] : "server.ini");
+    if (config.shardRouter)
+    {
+        ShardRouter router(config);
+        return a.exec();
+    }
+
+    Server server(config);
 
     // (int i = 0; i < 40; ++i)
         //Server::debugSendMessage(0, "flood0", 1);
@@ -0,0 +1,215 @@
+#include "messagebus.h"
+#include "peerauth.h"
+
+MessageBus::MessageBus(const QStringList    &peers,
+                       const QString        &secret,
+                       const qint64         &flushIntervalMs,
+                       QObject              *parent)
+    : QObject(parent)
+{
+    this->secret = secret;
+    this->server = new QTcpServer(this);
+    connect(this->server, SIGNAL(newConnection()), this, SLOT(slotNewLink()));
+
+    this->flushTimer = new QTimer(this);
+    this->flushTimer->setSingleShot(true);
+    this->flushTimer->setInterval(qMax<qint64>(flushIntervalMs, 0));
+    connect(this->flushTimer, SIGNAL(timeout()), this, SLOT(slotFlush()));
+
+    //links are outgoing only, every node connects to all of its peers
+    for (const QString &i: peers)
+    {
+        Peer peer;
+        peer.host = i.trimmed().section(':', 0, -2);
+        peer.port = i.trimmed().section(':', -1).toUShort();
+        peer.socket = new QTcpSocket(this);
+        connect(peer.socket, SIGNAL(connected()), this, SLOT(slotLinkConnected()));
+        this->peers.append(peer);
+    }
+
+    this->reconnectTimer = new QTimer(this);
+    connect(this->reconnectTimer, SIGNAL(timeout()), this, SLOT(slotReconnect()));
+    this->reconnectTimer->start(1000);
+    this->slotReconnect();
+}
+
+bool MessageBus::listen(const QHostAddress &address, const quint16 &port)
+{
+    if (!PeerAuth::canListen(address, this->secret))
+    {
+        qDebug() << "Message bus port" << port << "is reachable from other hosts, a secret is required";
+        return false;
+    }
+    if (!this->server->listen(address, port))
+    {
+        qDebug() << "Unable to listen message bus port" << port;
+        return false;
+    }
+    return true;
+}
+
+void MessageBus::slotReconnect()
+{
+    for (const Peer &i: this->peers)
+        if (i.socket->state() == QAbstractSocket::UnconnectedState)
+            i.socket->connectToHost(i.host, i.port);
+}
+
+void MessageBus::slotLinkConnected()
+{
+    //sent before any batch, in the same framing
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    QByteArray hello = this->secret.toUtf8();
+    QByteArray size(sizeof(quint32), 0);
+    qToBigEndian<quint32>(hello.size(), size.data());
+    socket->write(size + hello);
+}
+
+void MessageBus::publish(const QString &topic, const QJsonArray &members, const QByteArray &frame)
+{
+    if (this->peers.isEmpty())
+        return;
+
+    //events of a topic share its header in the batch until
+    //the members of the chat change
+    auto topicIndex = this->batchTopics.find(topic);
+    if (topicIndex == this->batchTopics.end() || this->batch[topicIndex.value()].members != members)
+    {
+        TopicEvents events;
+        events.topic = topic;
+        events.members = members;
+        this->batch.append(events);
+        topicIndex = this->batchTopics.insert(topic, this->batch.size() - 1);
+    }
+    this->batch[topicIndex.value()].frames.append(frame);
+    this->batchBytes += frame.size();
+    ++this->published;
+
+    if (this->batchBytes >= MessageBus::maxBatchBytes)
+        this->slotFlush();
+    else if (!this->flushTimer->isActive())
+        this->flushTimer->start();
+}
+
+void MessageBus::slotFlush()
+{
+    this->flushTimer->stop();
+    if (this->batch.isEmpty())
+        return;
+
+    QByteArray data = this->encodeBatch();
+    this->batch.clear();
+    this->batchTopics.clear();
+    this->batchBytes = 0;
+    ++this->batches;
+
+    for (const Peer &i: this->peers)
+        if (i.socket->state() == QAbstractSocket::ConnectedState)
+            i.socket->write(data);
+}
+
+QByteArray MessageBus::encodeBatch() const
+{
+    //quint32 size of the batch, then topics with their members and frames
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << quint32(0) << quint32(this->batch.size());
+    for (const TopicEvents &i: this->batch)
+        out << i.topic << QJsonDocument(i.members).toJson(QJsonDocument::Compact) << i.frames;
+    out.device()->seek(0);
+    out << quint32(data.size() - sizeof(quint32));
+    return data;
+}
+
+void MessageBus::decodeBatch(const QByteArray &data)
+{
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_15);
+    quint32 topicsNum;
+    in >> topicsNum;
+    for (quint32 i = 0; i < topicsNum && in.status() == QDataStream::Ok; ++i)
+    {
+        QString topic;
+        QByteArray members;
+        QVector<QByteArray> frames;
+        in >> topic >> members >> frames;
+        if (in.status() != QDataStream::Ok)
+            break;
+
+        QJsonArray membersArr = QJsonDocument::fromJson(members).array();
+        for (const QByteArray &frame: frames)
+            emit this->delivered(topic, membersArr, frame);
+    }
+}
+
+void MessageBus::slotNewLink()
+{
+    while (this->server->hasPendingConnections())
+    {
+        QTcpSocket *socket = this->server->nextPendingConnection();
+        this->incoming.insert(socket, Link());
+        connect(socket, SIGNAL(readyRead()), this, SLOT(slotReadLink()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(slotLinkDisconnected()));
+    }
+}
+
+void MessageBus::slotReadLink()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    auto link = this->incoming.find(socket);
+    if (link == this->incoming.end())
+        return;
+
+    QByteArray &in = link->in;
+    in += socket->readAll();
+    while (in.size() >= static_cast<int>(sizeof(quint32)))
+    {
+        quint32 size = qFromBigEndian<quint32>(in.constData());
+        if (!link->isAuthenticated && size > MessageBus::maxSecretSize)
+            return socket->abort();
+        if (in.size() - static_cast<int>(sizeof(quint32)) < static_cast<int>(size))
+            break;
+        QByteArray data = in.mid(sizeof(quint32), size);
+        in.remove(0, sizeof(quint32) + size);
+
+        //nothing is delivered from a link before it sent the secret
+        if (!link->isAuthenticated)
+        {
+            if (!this->secret.isEmpty() && !PeerAuth::matches(this->secret, QString::fromUtf8(data)))
+            {
+                qDebug() << "Message bus link" << socket->peerAddress().toString() << "sent a wrong secret";
+                return socket->abort();
+            }
+            link->isAuthenticated = true;
+            continue;
+        }
+        this->decodeBatch(data);
+    }
+}
+
+void MessageBus::slotLinkDisconnected()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    this->incoming.remove(socket);
+    socket->deleteLater();
+}
+
+int MessageBus::linksCount() const
+{
+    int links = 0;
+    for (const Peer &i: this->peers)
+        if (i.socket->state() == QAbstractSocket::ConnectedState)
+            ++links;
+    return links;
+}
+
+quint64 MessageBus::publishedCount() const
+{
+    return this->published;
+}
+
+quint64 MessageBus::batchesCount() const
+{
+    return this->batches;
+}
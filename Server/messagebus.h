@@ -0,0 +1,87 @@
+#ifndef MESSAGEBUS_H
+#define MESSAGEBUS_H
+
+#include <QtCore>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+//carries committed events between server nodes. events are published
+//under a topic ("chat/<id>") with the members to deliver them to, and
+//broadcast to every peer. events of one flush interval form a single
+//batch, grouped by topic so the members of a chat are sent once,
+//encoded once and written as is to every link. delivery is best effort,
+//events are dropped while a link is down. the first frame of a link is
+//the shared secret, links sending a wrong one are closed
+class MessageBus : public QObject
+{
+    Q_OBJECT
+public:
+    MessageBus(const QStringList    &peers,
+               const QString        &secret,
+               const qint64         &flushIntervalMs,
+               QObject              *parent = nullptr);
+
+    bool listen(const QHostAddress &address, const quint16 &port);
+
+    void publish(const QString      &topic,
+                 const QJsonArray   &members,
+                 const QByteArray   &frame);
+
+    int linksCount() const;
+    quint64 publishedCount() const;
+    quint64 batchesCount() const;
+
+signals:
+    //frame is a complete event line, as it was published
+    void delivered(const QString &topic, const QJsonArray &members, const QByteArray &frame);
+
+public slots:
+    void slotFlush();
+    void slotNewLink();
+    void slotReadLink();
+    void slotLinkDisconnected();
+    void slotLinkConnected();
+    void slotReconnect();
+
+private:
+    struct TopicEvents
+    {
+        QString             topic;
+        QJsonArray          members;
+        QVector<QByteArray> frames;
+    };
+
+    struct Peer
+    {
+        QString     host;
+        quint16     port;
+        QTcpSocket  *socket;
+    };
+
+    struct Link
+    {
+        QByteArray  in;
+        bool        isAuthenticated = false;
+    };
+
+    QString secret;
+    QTcpServer *server;
+    QTimer *flushTimer;
+    QTimer *reconnectTimer;
+    QVector<Peer> peers;
+    QHash<QTcpSocket*, Link> incoming;
+
+    QVector<TopicEvents> batch;
+    QHash<QString, int> batchTopics;
+    qint64 batchBytes = 0;
+    quint64 published = 0;
+    quint64 batches = 0;
+
+    static const qint64 maxBatchBytes = 64 * 1024;
+    static const quint32 maxSecretSize = 1024;
+
+    QByteArray encodeBatch() const;
+    void decodeBatch(const QByteArray &data);
+};
+
+#endif // MESSAGEBUS_H
@@ -0,0 +1,74 @@
+#include "messagecache.h"
+
+MessageCache::MessageCache(int maxBytes)
+{
+    this->blocks.setMaxCost(maxBytes);
+}
+
+void MessageCache::setMaxBytes(int maxBytes)
+{
+    this->blocks.setMaxCost(maxBytes);
+}
+
+int MessageCache::cost(const QVector<QByteArray> &messages)
+{
+    int bytes = 0;
+    for (const QByteArray &i: messages)
+        bytes += i.size();
+    return bytes;
+}
+
+bool MessageCache::contains(const size_t &chatID, const size_t &blockID) const
+{
+    return this->blocks.contains(BlockKey(chatID, blockID));
+}
+
+QVector<QByteArray> MessageCache::block(const size_t &chatID, const size_t &blockID)
+{
+    QVector<QByteArray> *messages = this->blocks.object(BlockKey(chatID, blockID));
+    if (messages == nullptr)
+    {
+        ++this->missesNum;
+        return {};
+    }
+    ++this->hitsNum;
+    return *messages;
+}
+
+void MessageCache::insert(const size_t &chatID, const size_t &blockID, const QVector<QByteArray> &messages)
+{
+    this->blocks.insert(BlockKey(chatID, blockID),
+                        new QVector<QByteArray>(messages),
+                        MessageCache::cost(messages));
+}
+
+void MessageCache::clear()
+{
+    this->blocks.clear();
+}
+
+void MessageCache::append(const size_t &chatID, const size_t &blockID, const QByteArray &message)
+{
+    //the cost of the block changes, so it is reinserted
+    QVector<QByteArray> *messages = this->blocks.take(BlockKey(chatID, blockID));
+    if (messages == nullptr)
+        return;
+    messages->append(message);
+    int blockCost = MessageCache::cost(*messages);
+    this->blocks.insert(BlockKey(chatID, blockID), messages, blockCost);
+}
+
+quint64 MessageCache::hits() const
+{
+    return this->hitsNum;
+}
+
+quint64 MessageCache::misses() const
+{
+    return this->missesNum;
+}
+
+int MessageCache::bytes() const
+{
+    return this->blocks.totalCost();
+}
@@ -0,0 +1,43 @@
+#ifndef MESSAGECACHE_H
+#define MESSAGECACHE_H
+
+#include <QtCore>
+
+//messages are immutable once written, so every block of a chat
+//is kept in memory already encoded in its final wire form and
+//history responses just concatenate the cached byte ranges
+class MessageCache
+{
+public:
+    MessageCache(int maxBytes = 64 * 1024 * 1024);
+
+    void setMaxBytes(int maxBytes);
+
+    bool contains(const size_t &chatID, const size_t &blockID) const;
+
+    //encoded messages of the block, empty if the block is not cached
+    QVector<QByteArray> block(const size_t &chatID, const size_t &blockID);
+    void insert(const size_t &chatID, const size_t &blockID, const QVector<QByteArray> &messages);
+
+    //appends a new message to the block if it is cached,
+    //otherwise it is loaded from disk on the next read
+    void append(const size_t &chatID, const size_t &blockID, const QByteArray &message);
+
+    //drops every block, the counters are kept
+    void clear();
+
+    quint64 hits() const;
+    quint64 misses() const;
+    int bytes() const;
+
+private:
+    typedef QPair<size_t, size_t> BlockKey;
+
+    QCache<BlockKey, QVector<QByteArray>> blocks;
+    quint64 hitsNum = 0;
+    quint64 missesNum = 0;
+
+    static int cost(const QVector<QByteArray> &messages);
+};
+
+#endif // MESSAGECACHE_H
@@ -0,0 +1,79 @@
+#include "metrics.h"
+
+void Metrics::recordRequest(const QString &method, int errorCode, quint64 durationUs)
+{
+    MethodStats &stats = this->methods[method];
+    stats.latency.record(durationUs);
+    ++stats.errors[errorCode];
+}
+
+QByteArray Metrics::number(double value)
+{
+    return QByteArray::number(value, 'g', 12);
+}
+
+void Metrics::writeHeader(QByteArray &out, const char *name, const char *type, const char *help)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void Metrics::writeCounter(QByteArray &out, const char *name, const char *help, double value)
+{
+    Metrics::writeHeader(out, name, "counter", help);
+    out += name;
+    out += ' ' + Metrics::number(value) + '\n';
+}
+
+void Metrics::writeGauge(QByteArray &out, const char *name, const char *help, double value)
+{
+    Metrics::writeHeader(out, name, "gauge", help);
+    out += name;
+    out += ' ' + Metrics::number(value) + '\n';
+}
+
+void Metrics::writeRequests(QByteArray &out) const
+{
+    static const double bucketBounds[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                                          0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    Metrics::writeHeader(out, "chatapp_requests_total", "counter",
+                         "Queries handled, by api method and error code of the response");
+    for (auto i = this->methods.constBegin(); i != this->methods.constEnd(); ++i)
+        for (auto j = i->errors.constBegin(); j != i->errors.constEnd(); ++j)
+            out += "chatapp_requests_total{method=\"" + i.key().toUtf8() +
+                   "\",error_code=\"" + QByteArray::number(j.key()) + "\"} " +
+                   Metrics::number(j.value()) + '\n';
+
+    Metrics::writeHeader(out, "chatapp_request_duration_seconds", "histogram",
+                         "Time spent on the event loop thread per query");
+    for (auto i = this->methods.constBegin(); i != this->methods.constEnd(); ++i)
+    {
+        const QByteArray label = "{method=\"" + i.key().toUtf8() + "\"";
+        for (double bound: bucketBounds)
+            out += "chatapp_request_duration_seconds_bucket" + label + ",le=\"" + Metrics::number(bound) + "\"} " +
+                   Metrics::number(i->latency.countNotAbove(bound * 1e6)) + '\n';
+        out += "chatapp_request_duration_seconds_bucket" + label + ",le=\"+Inf\"} " +
+               Metrics::number(i->latency.count()) + '\n';
+        out += "chatapp_request_duration_seconds_sum" + label + "} " + Metrics::number(i->latency.sum() / 1e6) + '\n';
+        out += "chatapp_request_duration_seconds_count" + label + "} " + Metrics::number(i->latency.count()) + '\n';
+    }
+
+    //precomputed from the full resolution histograms, the buckets
+    //above are too coarse to read tail latencies from
+    Metrics::writeHeader(out, "chatapp_request_duration_quantile_seconds", "gauge",
+                         "Latency quantiles per api method since the start");
+    for (auto i = this->methods.constBegin(); i != this->methods.constEnd(); ++i)
+        for (double quantile: quantiles)
+            out += "chatapp_request_duration_quantile_seconds{method=\"" + i.key().toUtf8() +
+                   "\",quantile=\"" + Metrics::number(quantile) + "\"} " +
+                   Metrics::number(i->latency.percentile(quantile) / 1e6) + '\n';
+}
@@ -0,0 +1,34 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QtCore>
+#include "latencyhistogram.h"
+
+//request counters and latency histograms per api method, written
+//in the prometheus text exposition format
+class Metrics
+{
+public:
+    void recordRequest(const QString &method, int errorCode, quint64 durationUs);
+
+    void writeRequests(QByteArray &out) const;
+
+    //single sample metrics without labels
+    static void writeCounter(QByteArray &out, const char *name, const char *help, double value);
+    static void writeGauge(QByteArray &out, const char *name, const char *help, double value);
+
+private:
+    struct MethodStats
+    {
+        LatencyHistogram    latency;
+        QMap<int, quint64>  errors;
+    };
+
+    //ordered, so the exposition is stable between scrapes
+    QMap<QString, MethodStats> methods;
+
+    static void writeHeader(QByteArray &out, const char *name, const char *type, const char *help);
+    static QByteArray number(double value);
+};
+
+#endif // METRICS_H
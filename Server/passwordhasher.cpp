@@ -0,0 +1,66 @@
+#include "passwordhasher.h"
+#include <QPasswordDigestor>
+
+QString PasswordHasher::scheme()
+{
+    return QStringLiteral("pbkdf2-sha256");
+}
+
+QByteArray PasswordHasher::deriveKey(const QString&      password,
+                                     const QByteArray&   salt,
+                                     int                 iterations,
+                                     int                 length)
+{
+    return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256,
+                                              password.toUtf8(),
+                                              salt,
+                                              iterations,
+                                              length);
+}
+
+bool PasswordHasher::constantTimeEquals(const QByteArray &a, const QByteArray &b)
+{
+    if (a.size() != b.size())
+        return false;
+    char diff = 0;
+    for (int i = 0; i < a.size(); ++i)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+QString PasswordHasher::hash(const QString &password, int iterations)
+{
+    QByteArray salt(PasswordHasher::saltLength, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(salt.data()),
+                                          PasswordHasher::saltLength / sizeof(quint32));
+    QByteArray key = PasswordHasher::deriveKey(password, salt, iterations, PasswordHasher::keyLength);
+    return QStringLiteral("%1$%2$%3$%4").arg(PasswordHasher::scheme())
+                                        .arg(iterations)
+                                        .arg(QString(salt.toBase64()))
+                                        .arg(QString(key.toBase64()));
+}
+
+bool PasswordHasher::verify(const QString &password, const QString &storedHash)
+{
+    QStringList parts = storedHash.split('$');
+    if (parts.size() != 4 || parts[0] != PasswordHasher::scheme())
+        return PasswordHasher::constantTimeEquals(password.toUtf8(), storedHash.toUtf8());
+
+    bool ok;
+    int iterations = parts[1].toInt(&ok);
+    if (!ok || iterations <= 0)
+        return false;
+    QByteArray salt = QByteArray::fromBase64(parts[2].toLatin1());
+    QByteArray expected = QByteArray::fromBase64(parts[3].toLatin1());
+    return PasswordHasher::constantTimeEquals(
+                PasswordHasher::deriveKey(password, salt, iterations, expected.size()),
+                expected);
+}
+
+bool PasswordHasher::needsRehash(const QString &storedHash, int iterations)
+{
+    QStringList parts = storedHash.split('$');
+    return parts.size() != 4 ||
+           parts[0] != PasswordHasher::scheme() ||
+           parts[1].toInt() != iterations;
+}
@@ -0,0 +1,31 @@
+#ifndef PASSWORDHASHER_H
+#define PASSWORDHASHER_H
+
+#include <QtCore>
+
+//salted PBKDF2-HMAC-SHA256 password hashes, stored as
+//pbkdf2-sha256$<iterations>$<salt>$<hash> with base64 salt and hash.
+//hashing is slow on purpose, so it must not run on the event loop thread
+class PasswordHasher
+{
+public:
+    static QString hash(const QString &password, int iterations);
+    static bool verify(const QString &password, const QString &storedHash);
+
+    //plaintext passwords of old databases and hashes made
+    //with another number of iterations have to be rehashed
+    static bool needsRehash(const QString &storedHash, int iterations);
+
+private:
+    static const int saltLength = 16;
+    static const int keyLength = 32;
+
+    static QByteArray deriveKey(const QString&      password,
+                                const QByteArray&   salt,
+                                int                 iterations,
+                                int                 length);
+    static bool constantTimeEquals(const QByteArray &a, const QByteArray &b);
+    static QString scheme();
+};
+
+#endif // PASSWORDHASHER_H
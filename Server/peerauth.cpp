@@ -0,0 +1,18 @@
+#include "peerauth.h"
+
+bool PeerAuth::canListen(const QHostAddress &address, const QString &secret)
+{
+    return address.isLoopback() || !secret.isEmpty();
+}
+
+bool PeerAuth::matches(const QString &secret, const QString &given)
+{
+    //compares every byte, so the time doesnt tell how much matched
+    const QByteArray expected = secret.toUtf8(), received = given.toUtf8();
+    if (expected.isEmpty() || expected.size() != received.size())
+        return false;
+    char diff = 0;
+    for (int i = 0; i < expected.size(); ++i)
+        diff |= expected[i] ^ received[i];
+    return diff == 0;
+}
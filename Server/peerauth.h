@@ -0,0 +1,17 @@
+#ifndef PEERAUTH_H
+#define PEERAUTH_H
+
+#include <QtCore>
+#include <QHostAddress>
+
+//shared secret checks of the ports the nodes talk to each other on.
+//a port reachable from other hosts needs a secret, which the
+//connecting node sends before anything else
+class PeerAuth
+{
+public:
+    static bool canListen(const QHostAddress &address, const QString &secret);
+    static bool matches(const QString &secret, const QString &given);
+};
+
+#endif // PEERAUTH_H
@@ -0,0 +1,67 @@
+#include "ratelimiter.h"
+
+RateLimiter::RateLimiter(double rate, double burst)
+{
+    this->setLimit(rate, burst);
+}
+
+void RateLimiter::setLimit(double rate, double burst)
+{
+    this->rate = rate;
+    this->burst = qMax(burst, 1.0);
+    this->buckets.clear();
+}
+
+bool RateLimiter::isEnabled() const
+{
+    return this->rate > 0;
+}
+
+qint64 RateLimiter::now()
+{
+    static QElapsedTimer clock;
+    if (!clock.isValid())
+        clock.start();
+    return clock.elapsed();
+}
+
+bool RateLimiter::tryAcquire(const QString &key, qint64 &retryAfterMs)
+{
+    retryAfterMs = 0;
+    if (!this->isEnabled())
+        return true;
+
+    if (++this->acquiresSincePrune >= RateLimiter::pruneInterval)
+        this->prune();
+
+    const qint64 currentTime = RateLimiter::now();
+    auto bucket = this->buckets.find(key);
+    if (bucket == this->buckets.end())
+        bucket = this->buckets.insert(key, {this->burst, currentTime});
+
+    bucket->tokens = qMin(this->burst,
+                          bucket->tokens + (currentTime - bucket->lastRefill) * this->rate / 1000.0);
+    bucket->lastRefill = currentTime;
+
+    if (bucket->tokens < 1.0)
+    {
+        retryAfterMs = qCeil((1.0 - bucket->tokens) * 1000.0 / this->rate);
+        return false;
+    }
+
+    bucket->tokens -= 1.0;
+    return true;
+}
+
+void RateLimiter::prune()
+{
+    this->acquiresSincePrune = 0;
+    const qint64 currentTime = RateLimiter::now();
+    for (auto i = this->buckets.begin(); i != this->buckets.end();)
+    {
+        if (i->tokens + (currentTime - i->lastRefill) * this->rate / 1000.0 >= this->burst)
+            i = this->buckets.erase(i);
+        else
+            ++i;
+    }
+}
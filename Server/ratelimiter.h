@@ -0,0 +1,41 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QtCore>
+
+//token bucket admission control: every key (access token, ip, ...)
+//gets a bucket of burst tokens refilled at rate tokens per second,
+//a request takes one token or is rejected with a retry-after hint
+class RateLimiter
+{
+public:
+    RateLimiter(double rate = 0, double burst = 0);
+
+    void setLimit(double rate, double burst);
+    bool isEnabled() const;
+
+    //returns false if the bucket of the key is empty,
+    //retryAfterMs is set to the time until the next token
+    bool tryAcquire(const QString &key, qint64 &retryAfterMs);
+
+    //forgets buckets which are full again, so the table
+    //doesnt grow with every address that ever connected
+    void prune();
+
+private:
+    struct Bucket
+    {
+        double tokens;
+        qint64 lastRefill;
+    };
+
+    double rate;
+    double burst;
+    QHash<QString, Bucket> buckets;
+    quint32 acquiresSincePrune = 0;
+
+    static const quint32 pruneInterval = 4096;
+    static qint64 now();
+};
+
+#endif // RATELIMITER_H
@@ -0,0 +1,136 @@
+#include "replicationfollower.h"
+
+ReplicationFollower::ReplicationFollower(ReplicationLog      *log,
+                                         const QString&      leaderHost,
+                                         const quint16&      leaderPort,
+                                         const QString&      secret,
+                                         const qint64&       heartbeatMs,
+                                         const Applier&      apply,
+                                         QObject             *parent)
+    : QObject(parent)
+{
+    this->log = log;
+    this->leaderHost = leaderHost;
+    this->leaderPort = leaderPort;
+    this->secret = secret;
+    this->heartbeatMs = qMax<qint64>(heartbeatMs, 1);
+    this->apply = apply;
+    this->lastLeaderSeq = log->lastSeq();
+
+    this->socket = new QTcpSocket(this);
+    connect(this->socket, SIGNAL(connected()), this, SLOT(slotConnected()));
+    connect(this->socket, SIGNAL(readyRead()), this, SLOT(slotReadLeader()));
+    connect(this->socket, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
+
+    //reconnects when the leader is unreachable or went silent
+    this->checkTimer = new QTimer(this);
+    connect(this->checkTimer, SIGNAL(timeout()), this, SLOT(slotCheckLeader()));
+}
+
+void ReplicationFollower::start()
+{
+    this->checkTimer->start(this->heartbeatMs);
+    this->reconnect();
+}
+
+void ReplicationFollower::reconnect()
+{
+    this->connected = false;
+    this->in.clear();
+    this->socket->abort();
+    this->lastReceived = QDateTime::currentMSecsSinceEpoch();
+    this->socket->connectToHost(this->leaderHost, this->leaderPort);
+}
+
+void ReplicationFollower::slotConnected()
+{
+    this->connected = true;
+    this->lastReceived = QDateTime::currentMSecsSinceEpoch();
+    QJsonObject handshake;
+    handshake.insert("from_seq", static_cast<double>(this->log->lastSeq()));
+    handshake.insert("secret", this->secret);
+    this->socket->write(QJsonDocument(handshake).toJson(QJsonDocument::Compact) + '\n');
+    qDebug() << "Connected to leader" << this->leaderHost << this->leaderPort
+             << "from seq" << this->log->lastSeq();
+}
+
+void ReplicationFollower::slotDisconnected()
+{
+    if (this->connected)
+        qDebug() << "Disconnected from leader at seq" << this->log->lastSeq();
+    this->connected = false;
+}
+
+void ReplicationFollower::slotCheckLeader()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now - this->lastReceived > 3 * this->heartbeatMs)
+        this->reconnect();
+}
+
+void ReplicationFollower::slotReadLeader()
+{
+    this->lastReceived = QDateTime::currentMSecsSinceEpoch();
+    this->in += this->socket->readAll();
+
+    const quint64 seqBefore = this->log->lastSeq();
+    int lineEnd;
+    while ((lineEnd = this->in.indexOf('\n')) >= 0)
+    {
+        QByteArray line = this->in.left(lineEnd + 1);
+        this->in.remove(0, lineEnd + 1);
+        QJsonObject entry = QJsonDocument::fromJson(line).object();
+
+        if (entry.contains("heartbeat"))
+        {
+            this->lastLeaderSeq = qMax<quint64>(this->lastLeaderSeq, entry["heartbeat"].toDouble());
+            continue;
+        }
+
+        const quint64 seq = entry["seq"].toDouble();
+        this->lastLeaderSeq = qMax(this->lastLeaderSeq, seq);
+        if (seq <= this->log->lastSeq())
+            continue;
+
+        //an entry that cant be applied means the storages diverged,
+        //stopping here keeps the follower on the last consistent state
+        if (seq != this->log->lastSeq() + 1 || !this->apply(entry) ||
+            !this->log->appendReplicated(seq, line))
+        {
+            qDebug() << "Unable to apply replication entry" << seq << "stopping replication";
+            this->checkTimer->stop();
+            this->socket->abort();
+            return;
+        }
+        this->lastAppliedTime = entry["time"].toDouble();
+    }
+
+    if (this->log->lastSeq() != seqBefore)
+        this->socket->write(QStringLiteral("{\"ack\":%1}\n").arg(this->log->lastSeq()).toUtf8());
+}
+
+bool ReplicationFollower::isConnected() const
+{
+    return this->connected;
+}
+
+quint64 ReplicationFollower::appliedSeq() const
+{
+    return this->log->lastSeq();
+}
+
+quint64 ReplicationFollower::leaderSeq() const
+{
+    return this->lastLeaderSeq;
+}
+
+qint64 ReplicationFollower::lagMs() const
+{
+    //time since the newest applied entry was written on the leader,
+    //-1 while nothing has been applied yet to measure it
+    if (this->appliedSeq() >= this->lastLeaderSeq)
+        return 0;
+    if (this->lastAppliedTime == 0)
+        return -1;
+    return QDateTime::currentMSecsSinceEpoch() - this->lastAppliedTime;
+}
@@ -0,0 +1,58 @@
+#ifndef REPLICATIONFOLLOWER_H
+#define REPLICATIONFOLLOWER_H
+
+#include <QtCore>
+#include <QTcpSocket>
+#include <functional>
+#include "replicationlog.h"
+
+//connects to the leader, applies every received entry to the local
+//storage and appends it to the local log, so a restarted follower
+//resumes from its last applied seq
+class ReplicationFollower : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<bool(const QJsonObject&)> Applier;
+
+    ReplicationFollower(ReplicationLog      *log,
+                        const QString&      leaderHost,
+                        const quint16&      leaderPort,
+                        const QString&      secret,
+                        const qint64&       heartbeatMs,
+                        const Applier&      apply,
+                        QObject             *parent = nullptr);
+
+    void start();
+
+    bool isConnected() const;
+    quint64 appliedSeq() const;
+    quint64 leaderSeq() const;
+    qint64 lagMs() const;
+
+public slots:
+    void slotConnected();
+    void slotReadLeader();
+    void slotDisconnected();
+    void slotCheckLeader();
+
+private:
+    ReplicationLog *log;
+    QString leaderHost;
+    quint16 leaderPort;
+    QString secret;
+    qint64 heartbeatMs;
+    Applier apply;
+
+    QTcpSocket *socket;
+    QTimer *checkTimer;
+    QByteArray in;
+    bool connected = false;
+    quint64 lastLeaderSeq = 0;
+    qint64 lastAppliedTime = 0;
+    qint64 lastReceived = 0;
+
+    void reconnect();
+};
+
+#endif // REPLICATIONFOLLOWER_H
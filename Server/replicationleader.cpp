@@ -0,0 +1,182 @@
+#include "replicationleader.h"
+#include "peerauth.h"
+
+ReplicationLeader::ReplicationLeader(ReplicationLog    *log,
+                                     const QString&    secret,
+                                     const qint64&     heartbeatMs,
+                                     QObject           *parent)
+    : QObject(parent)
+{
+    this->log = log;
+    this->secret = secret;
+    this->server = new QTcpServer(this);
+    connect(this->server, SIGNAL(newConnection()), this, SLOT(slotNewFollower()));
+    connect(this->log, SIGNAL(appended(quint64, QByteArray)), this, SLOT(slotAppended(quint64, QByteArray)));
+
+    this->heartbeatTimer = new QTimer(this);
+    connect(this->heartbeatTimer, SIGNAL(timeout()), this, SLOT(slotHeartbeat()));
+    this->heartbeatTimer->start(heartbeatMs);
+}
+
+bool ReplicationLeader::listen(const QHostAddress &address, const quint16 &port)
+{
+    if (!PeerAuth::canListen(address, this->secret))
+    {
+        qDebug() << "Replication port" << port << "is reachable from other hosts, a secret is required";
+        return false;
+    }
+    if (!this->server->listen(address, port))
+    {
+        qDebug() << "Unable to listen replication port" << port;
+        return false;
+    }
+    return true;
+}
+
+void ReplicationLeader::slotNewFollower()
+{
+    while (this->server->hasPendingConnections())
+    {
+        QTcpSocket *socket = this->server->nextPendingConnection();
+
+        Follower follower;
+        follower.address = QStringLiteral("%1:%2").arg(socket->peerAddress().toString()).arg(socket->peerPort());
+        follower.handshaken = false;
+        follower.sentSeq = 0;
+        follower.ackedSeq = 0;
+        this->followers.insert(socket, follower);
+
+        connect(socket, SIGNAL(readyRead()), this, SLOT(slotReadFollower()));
+        connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(slotFollowerWritten()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(slotFollowerDisconnected()));
+    }
+}
+
+void ReplicationLeader::slotReadFollower()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    auto follower = this->followers.find(socket);
+    if (follower == this->followers.end())
+        return;
+
+    follower->in += socket->readAll();
+    if (!follower->handshaken && follower->in.size() > ReplicationLeader::maxHandshakeSize)
+    {
+        socket->disconnectFromHost();
+        return;
+    }
+
+    int lineEnd;
+    while ((lineEnd = follower->in.indexOf('\n')) >= 0)
+    {
+        QJsonObject message = QJsonDocument::fromJson(follower->in.left(lineEnd)).object();
+        follower->in.remove(0, lineEnd + 1);
+
+        //a loopback follower doesnt need the secret if none is set
+        if (!follower->handshaken && !this->secret.isEmpty() &&
+            !PeerAuth::matches(this->secret, message["secret"].toString()))
+        {
+            qDebug() << "Follower" << follower->address << "sent a wrong secret";
+            socket->disconnectFromHost();
+            return;
+        }
+
+        if (message.contains("from_seq"))
+        {
+            const quint64 fromSeq = message["from_seq"].toDouble();
+            //the follower has entries the leader never wrote, its data diverged
+            if (fromSeq > this->log->lastSeq())
+            {
+                qDebug() << "Follower" << follower->address << "is ahead of the leader:"
+                         << fromSeq << ">" << this->log->lastSeq();
+                socket->disconnectFromHost();
+                return;
+            }
+            follower->handshaken = true;
+            follower->sentSeq = fromSeq;
+            follower->ackedSeq = fromSeq;
+            qDebug() << "Follower" << follower->address << "connected from seq" << fromSeq;
+            this->sendBacklog(socket);
+        }
+        else if (message.contains("ack"))
+            follower->ackedSeq = qMax<quint64>(follower->ackedSeq, message["ack"].toDouble());
+    }
+}
+
+void ReplicationLeader::slotFollowerDisconnected()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    auto follower = this->followers.find(socket);
+    if (follower != this->followers.end())
+    {
+        qDebug() << "Follower" << follower->address << "disconnected at seq" << follower->ackedSeq;
+        this->followers.erase(follower);
+    }
+    socket->deleteLater();
+}
+
+void ReplicationLeader::slotFollowerWritten()
+{
+    this->sendBacklog(static_cast<QTcpSocket*>(sender()));
+}
+
+void ReplicationLeader::sendBacklog(QTcpSocket *socket)
+{
+    auto follower = this->followers.find(socket);
+    if (follower == this->followers.end() || !follower->handshaken)
+        return;
+
+    while (follower->sentSeq < this->log->lastSeq() &&
+           socket->bytesToWrite() < ReplicationLeader::maxBufferedBytes)
+    {
+        QByteArray lines = this->log->read(follower->sentSeq + 1, ReplicationLeader::catchUpBatchSize);
+        if (lines.isEmpty())
+            return;
+        follower->sentSeq = qMin<quint64>(follower->sentSeq + lines.count('\n'), this->log->lastSeq());
+        socket->write(lines);
+    }
+}
+
+void ReplicationLeader::slotAppended(quint64 seq, const QByteArray &line)
+{
+    //followers which are caught up get the entry without rereading the log
+    for (auto i = this->followers.begin(); i != this->followers.end(); ++i)
+    {
+        if (!i->handshaken)
+            continue;
+        if (i->sentSeq + 1 == seq)
+        {
+            i.key()->write(line);
+            i->sentSeq = seq;
+        }
+        else
+            this->sendBacklog(i.key());
+    }
+}
+
+void ReplicationLeader::slotHeartbeat()
+{
+    //lets the followers measure their lag while nothing is written
+    QByteArray heartbeat = QStringLiteral("{\"heartbeat\":%1,\"time\":%2}\n")
+            .arg(this->log->lastSeq())
+            .arg(QDateTime::currentMSecsSinceEpoch()).toUtf8();
+    for (auto i = this->followers.begin(); i != this->followers.end(); ++i)
+        if (i->handshaken)
+            i.key()->write(heartbeat);
+}
+
+QJsonArray ReplicationLeader::followersStatus() const
+{
+    QJsonArray status;
+    for (const Follower &i: this->followers)
+    {
+        if (!i.handshaken)
+            continue;
+        QJsonObject follower;
+        follower.insert("address",     i.address);
+        follower.insert("acked_seq",   static_cast<double>(i.ackedSeq));
+        follower.insert("lag_entries", static_cast<double>(this->log->lastSeq() - i.ackedSeq));
+        status.append(follower);
+    }
+    return status;
+}
@@ -0,0 +1,60 @@
+#ifndef REPLICATIONLEADER_H
+#define REPLICATIONLEADER_H
+
+#include <QtCore>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "replicationlog.h"
+
+//streams the replication log to the followers. a follower sends
+//{"from_seq":N,"secret":S} and gets every entry after N, then new
+//entries as they are appended and heartbeats, it acks with {"ack":N}
+class ReplicationLeader : public QObject
+{
+    Q_OBJECT
+public:
+    ReplicationLeader(ReplicationLog    *log,
+                      const QString&    secret,
+                      const qint64&     heartbeatMs,
+                      QObject           *parent = nullptr);
+
+    bool listen(const QHostAddress &address, const quint16 &port);
+
+    QJsonArray followersStatus() const;
+
+public slots:
+    void slotNewFollower();
+    void slotReadFollower();
+    void slotFollowerDisconnected();
+    void slotFollowerWritten();
+    void slotAppended(quint64 seq, const QByteArray &line);
+    void slotHeartbeat();
+
+private:
+    struct Follower
+    {
+        QString     address;
+        bool        handshaken;
+        quint64     sentSeq;
+        quint64     ackedSeq;
+        QByteArray  in;
+    };
+
+    ReplicationLog *log;
+    QString secret;
+    QTcpServer *server;
+    QTimer *heartbeatTimer;
+    QHash<QTcpSocket*, Follower> followers;
+
+    //entries are read from the log in batches while the socket
+    //buffer is small, so a far behind follower doesnt eat memory
+    static const int catchUpBatchSize = 1000;
+    static const qint64 maxBufferedBytes = 1024 * 1024;
+
+    //longest handshake line, anything longer isnt a follower
+    static const int maxHandshakeSize = 4096;
+
+    void sendBacklog(QTcpSocket *socket);
+};
+
+#endif // REPLICATIONLEADER_H
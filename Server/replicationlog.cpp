@@ -0,0 +1,102 @@
+#include "replicationlog.h"
+#include "jsonwriter.h"
+
+ReplicationLog::ReplicationLog(QObject *parent)
+    : QObject(parent)
+{
+
+}
+
+bool ReplicationLog::open(const QString &path)
+{
+    this->file.setFileName(path);
+    this->reader.setFileName(path);
+    this->offsets.clear();
+
+    if (this->file.open(QIODevice::ReadOnly))
+    {
+        //a torn line at the end is cut off, the leader sends it again
+        qint64 offset = 0;
+        while (!this->file.atEnd())
+        {
+            QByteArray line = this->file.readLine();
+            if (!line.endsWith('\n'))
+                break;
+            this->offsets.append(offset);
+            offset += line.size();
+        }
+        this->file.close();
+        if (offset != QFileInfo(path).size())
+            QFile::resize(path, offset);
+    }
+
+    if (!this->file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qDebug() << "Unable to open replication log" << path << "for appending";
+        return false;
+    }
+    if (!this->reader.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "Unable to open replication log" << path << "for reading";
+        return false;
+    }
+    return true;
+}
+
+quint64 ReplicationLog::append(QJsonObject entry)
+{
+    const quint64 seq = this->lastSeq() + 1;
+    entry.insert("seq", static_cast<double>(seq));
+    entry.insert("time", static_cast<double>(QDateTime::currentMSecsSinceEpoch()));
+
+    QByteArray line;
+    JsonWriter::write(line, entry);
+    line += '\n';
+    if (!this->write(line))
+        return 0;
+
+    emit this->appended(seq, line);
+    return seq;
+}
+
+bool ReplicationLog::appendReplicated(const quint64 &seq, const QByteArray &line)
+{
+    if (seq != this->lastSeq() + 1)
+        return false;
+    if (!this->write(line.endsWith('\n') ? line : line + '\n'))
+        return false;
+
+    emit this->appended(seq, line);
+    return true;
+}
+
+bool ReplicationLog::write(const QByteArray &line)
+{
+    const qint64 offset = this->file.size();
+    if (this->file.write(line) != line.size() || !this->file.flush())
+    {
+        qDebug() << "Unable to write replication log entry" << this->lastSeq() + 1;
+        QFile::resize(this->file.fileName(), offset);
+        return false;
+    }
+    this->offsets.append(offset);
+    return true;
+}
+
+quint64 ReplicationLog::lastSeq() const
+{
+    return this->offsets.size();
+}
+
+QByteArray ReplicationLog::read(const quint64 &fromSeq, int maxEntries)
+{
+    QByteArray lines;
+    if (fromSeq < 1 || fromSeq > this->lastSeq())
+        return lines;
+
+    if (!this->reader.seek(this->offsets[fromSeq - 1]))
+        return lines;
+    for (quint64 seq = fromSeq; seq <= this->lastSeq() && maxEntries > 0; ++seq, --maxEntries)
+        lines += this->reader.readLine();
+    return lines;
+}
@@ -0,0 +1,41 @@
+#ifndef REPLICATIONLOG_H
+#define REPLICATIONLOG_H
+
+#include <QtCore>
+
+//append-only log of the logical storage mutations, one compact
+//json entry per line numbered by seq starting from 1. the leader
+//appends what it executes, followers append what they apply
+class ReplicationLog : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ReplicationLog(QObject *parent = nullptr);
+
+    bool open(const QString &path);
+
+    //assigns the next seq and the time to the entry
+    quint64 append(QJsonObject entry);
+
+    //entry received from the leader, kept only if it is the next one
+    bool appendReplicated(const quint64 &seq, const QByteArray &line);
+
+    quint64 lastSeq() const;
+
+    //up to maxEntries lines starting with fromSeq, for followers catching up
+    QByteArray read(const quint64 &fromSeq, int maxEntries);
+
+signals:
+    void appended(quint64 seq, const QByteArray &line);
+
+private:
+    QFile file;
+    QFile reader;
+
+    //file offset of every entry, seq - 1 is the index
+    QVector<qint64> offsets;
+
+    bool write(const QByteArray &line);
+};
+
+#endif // REPLICATIONLOG_H
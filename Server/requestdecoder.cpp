@@ -0,0 +1,587 @@
+#include "requestdecoder.h"
+
+qint64 ApiParams::number(Field field) const
+{
+    switch (field)
+    {
+    case CHAT_ID:
+        return this->chatID;
+
+    case USER_ID:
+        return this->userID;
+
+    case NUM:
+        return this->num;
+
+    case CURRENT_CHAT_ID:
+        return this->currentChatID;
+
+    case MESSAGES_NUM:
+        return this->messagesNum;
+
+    case AFTER_ID:
+        return this->afterID;
+
+    case BEFORE_ID:
+        return this->beforeID;
+
+    case SENDER_ID:
+        return this->senderID;
+
+    default:
+        return 0;
+    }
+}
+
+int RequestDecoder::frameLength(const QByteArray &buffer)
+{
+    int depth = 0;
+    bool inString = false;
+    for (int i = 0; i < buffer.size(); ++i)
+    {
+        const char c = buffer[i];
+        if (inString)
+        {
+            if (c == '\\')
+                ++i;
+            else if (c == '"')
+                inString = false;
+            continue;
+        }
+
+        if (depth == 0 && c != '{')
+        {
+            //anything but whitespace before the query is garbage,
+            //it is returned as a frame and fails to decode
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                return buffer.size();
+            continue;
+        }
+
+        if (c == '"')
+            inString = true;
+        else if (c == '{' || c == '[')
+            ++depth;
+        else if ((c == '}' || c == ']') && --depth == 0)
+            return i + 1;
+    }
+    return -1;
+}
+
+bool RequestDecoder::decode(const QByteArray &frame, ApiParams &params)
+{
+    RequestDecoder decoder(frame);
+    if (!decoder.parseRequest(params))
+        return false;
+    params.isOutOfRange = decoder.isOutOfRange;
+    decoder.skipSpaces();
+    return decoder.pos == decoder.end;
+}
+
+RequestDecoder::RequestDecoder(const QByteArray &frame)
+{
+    this->pos = frame.constData();
+    this->end = frame.constData() + frame.size();
+}
+
+void RequestDecoder::skipSpaces()
+{
+    while (this->pos < this->end &&
+           (*this->pos == ' ' || *this->pos == '\n' || *this->pos == '\r' || *this->pos == '\t'))
+        ++this->pos;
+}
+
+bool RequestDecoder::consume(char c)
+{
+    this->skipSpaces();
+    if (this->pos >= this->end || *this->pos != c)
+        return false;
+    ++this->pos;
+    return true;
+}
+
+bool RequestDecoder::parseRequest(ApiParams &params)
+{
+    if (!this->consume('{'))
+        return false;
+    if (this->consume('}'))
+        return true;
+
+    do
+    {
+        QString key;
+        if (!this->parseString(key) || !this->consume(':'))
+            return false;
+
+        this->skipSpaces();
+        if (key == QLatin1String("method"))
+        {
+            Scalar value;
+            if (!this->parseValue(value, 1))
+                return false;
+            params.method = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("params") && this->pos < this->end && *this->pos == '{')
+        {
+            if (!this->parseParams(params))
+                return false;
+        }
+        else if (!this->skipValue(1))
+            return false;
+    }
+    while (this->consume(','));
+
+    return this->consume('}');
+}
+
+bool RequestDecoder::parseParams(ApiParams &params)
+{
+    if (!this->consume('{'))
+        return false;
+    if (this->consume('}'))
+        return true;
+
+    do
+    {
+        QString key;
+        if (!this->parseString(key) || !this->consume(':'))
+            return false;
+        this->skipSpaces();
+
+        if (key == QLatin1String("members"))
+        {
+            params.present |= ApiParams::MEMBERS;
+            if (this->pos < this->end && *this->pos == '[')
+            {
+                if (!this->parseStringArray(params.members))
+                    return false;
+            }
+            else if (!this->skipValue(2))
+                return false;
+            continue;
+        }
+
+        if (key == QLatin1String("message_to_send"))
+        {
+            params.present |= ApiParams::MESSAGE_TO_SEND;
+            if (this->pos < this->end && *this->pos == '{')
+            {
+                if (!this->parseMessageToSend(params))
+                    return false;
+            }
+            else if (!this->skipValue(2))
+                return false;
+            continue;
+        }
+
+        if (key == QLatin1String("watermarks"))
+        {
+            params.present |= ApiParams::WATERMARKS;
+            if (this->pos < this->end && *this->pos == '{')
+            {
+                if (!this->parseWatermarks(params))
+                    return false;
+            }
+            else if (!this->skipValue(2))
+                return false;
+            continue;
+        }
+
+        if (key == QLatin1String("identities"))
+        {
+            params.present |= ApiParams::IDENTITIES;
+            if (this->pos < this->end && *this->pos == '{')
+            {
+                if (!this->parseIdentities(params))
+                    return false;
+            }
+            else if (!this->skipValue(2))
+                return false;
+            continue;
+        }
+
+        Scalar value;
+        if (!this->parseValue(value, 2))
+            return false;
+
+        if (key == QLatin1String("access_token"))
+        {
+            params.present |= ApiParams::ACCESS_TOKEN;
+            params.accessToken = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("username"))
+        {
+            params.present |= ApiParams::USERNAME;
+            params.username = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("password"))
+        {
+            params.present |= ApiParams::PASSWORD;
+            params.password = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("chat_id"))
+        {
+            params.present |= ApiParams::CHAT_ID;
+            params.chatID = this->toInteger(value);
+        }
+        else if (key == QLatin1String("user_id"))
+        {
+            params.present |= ApiParams::USER_ID;
+            params.userID = this->toInteger(value);
+        }
+        else if (key == QLatin1String("num"))
+        {
+            params.present |= ApiParams::NUM;
+            params.num = this->toInteger(value);
+        }
+        else if (key == QLatin1String("text"))
+        {
+            params.present |= ApiParams::TEXT;
+            params.text = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("name"))
+        {
+            params.present |= ApiParams::NAME;
+            params.name = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("is_visible"))
+        {
+            params.present |= ApiParams::IS_VISIBLE;
+            params.isVisible = value.type == Scalar::BOOL && value.boolean;
+        }
+        else if (key == QLatin1String("property"))
+        {
+            params.present |= ApiParams::PROPERTY;
+            params.property = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("value"))
+        {
+            params.present |= ApiParams::VALUE;
+            params.value = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("current_chat_id"))
+        {
+            params.present |= ApiParams::CURRENT_CHAT_ID;
+            params.currentChatID = this->toInteger(value);
+        }
+        else if (key == QLatin1String("messages_num"))
+        {
+            params.present |= ApiParams::MESSAGES_NUM;
+            params.messagesNum = this->toInteger(value);
+        }
+        else if (key == QLatin1String("after_id"))
+        {
+            params.present |= ApiParams::AFTER_ID;
+            params.afterID = this->toInteger(value);
+        }
+        else if (key == QLatin1String("before_id"))
+        {
+            params.present |= ApiParams::BEFORE_ID;
+            params.beforeID = this->toInteger(value);
+        }
+        else if (key == QLatin1String("shard_secret"))
+        {
+            params.present |= ApiParams::SHARD_SECRET;
+            params.shardSecret = RequestDecoder::toString(value);
+        }
+        else if (key == QLatin1String("sender_id"))
+        {
+            params.present |= ApiParams::SENDER_ID;
+            params.senderID = this->toInteger(value);
+        }
+        else if (key == QLatin1String("client_address"))
+        {
+            params.present |= ApiParams::CLIENT_ADDRESS;
+            params.clientAddress = RequestDecoder::toString(value);
+        }
+    }
+    while (this->consume(','));
+
+    return this->consume('}');
+}
+
+bool RequestDecoder::parseMessageToSend(ApiParams &params)
+{
+    if (!this->consume('{'))
+        return false;
+    if (this->consume('}'))
+        return true;
+
+    do
+    {
+        QString key;
+        Scalar value;
+        if (!this->parseString(key) || !this->consume(':') || !this->parseValue(value, 3))
+            return false;
+
+        if (key == QLatin1String("chat_id"))
+            params.messageChatID = this->toInteger(value);
+        else if (key == QLatin1String("text"))
+            params.messageText = RequestDecoder::toString(value);
+    }
+    while (this->consume(','));
+
+    return this->consume('}');
+}
+
+bool RequestDecoder::parseWatermarks(ApiParams &params)
+{
+    //{"<chat id>": <last message id>, ...}, keys that are not
+    //numbers are dropped like the other unknown fields
+    if (!this->consume('{'))
+        return false;
+    if (this->consume('}'))
+        return true;
+
+    do
+    {
+        QString key;
+        Scalar value;
+        if (!this->parseString(key) || !this->consume(':') || !this->parseValue(value, 3))
+            return false;
+
+        bool ok;
+        const qint64 chatID = key.toLongLong(&ok);
+        if (ok)
+            params.watermarks.append(qMakePair(chatID, this->toInteger(value)));
+    }
+    while (this->consume(','));
+
+    return this->consume('}');
+}
+
+bool RequestDecoder::parseIdentities(ApiParams &params)
+{
+    //{"<user id>": "<username>", ...}
+    if (!this->consume('{'))
+        return false;
+    if (this->consume('}'))
+        return true;
+
+    do
+    {
+        QString key;
+        Scalar value;
+        if (!this->parseString(key) || !this->consume(':') || !this->parseValue(value, 3))
+            return false;
+
+        bool ok;
+        const qint64 userID = key.toLongLong(&ok);
+        if (ok && userID >= 0 && value.type == Scalar::STRING)
+            params.identities.append(qMakePair(userID, value.str));
+    }
+    while (this->consume(','));
+
+    return this->consume('}');
+}
+
+bool RequestDecoder::parseStringArray(QStringList &list)
+{
+    if (!this->consume('['))
+        return false;
+    if (this->consume(']'))
+        return true;
+
+    do
+    {
+        Scalar value;
+        if (!this->parseValue(value, 3))
+            return false;
+        list.append(RequestDecoder::toString(value));
+    }
+    while (this->consume(','));
+
+    return this->consume(']');
+}
+
+bool RequestDecoder::parseString(QString &str)
+{
+    if (!this->consume('"'))
+        return false;
+
+    //fast path: no escapes, the bytes are decoded at once
+    const char *begin = this->pos;
+    bool escaped = false;
+    while (this->pos < this->end && *this->pos != '"')
+    {
+        if (*this->pos == '\\')
+        {
+            if (this->end - this->pos < 2)
+                return false;
+            escaped = true;
+            ++this->pos;
+        }
+        ++this->pos;
+    }
+    if (this->pos >= this->end)
+        return false;
+
+    const char *stringEnd = this->pos++;
+    if (!escaped)
+    {
+        str = QString::fromUtf8(begin, stringEnd - begin);
+        return true;
+    }
+
+    str.clear();
+    const char *run = begin;
+    for (const char *i = begin; i < stringEnd; ++i)
+    {
+        if (*i != '\\')
+            continue;
+        str += QString::fromUtf8(run, i - run);
+        ++i;
+        switch (*i)
+        {
+        case 'b': str += QChar('\b'); break;
+        case 'f': str += QChar('\f'); break;
+        case 'n': str += QChar('\n'); break;
+        case 'r': str += QChar('\r'); break;
+        case 't': str += QChar('\t'); break;
+        case 'u':
+        {
+            //surrogate pairs come as two escapes and end up
+            //as two utf-16 code units, which is what QString wants
+            if (stringEnd - i < 5)
+                return false;
+            bool ok;
+            ushort code = QByteArray::fromRawData(i + 1, 4).toUShort(&ok, 16);
+            if (!ok)
+                return false;
+            str += QChar(code);
+            i += 4;
+            break;
+        }
+        default:
+            str += QChar::fromLatin1(*i);
+            break;
+        }
+        run = i + 1;
+    }
+    str += QString::fromUtf8(run, stringEnd - run);
+    return true;
+}
+
+bool RequestDecoder::parseNumber(double &number)
+{
+    const char *begin = this->pos;
+    while (this->pos < this->end &&
+           ((*this->pos >= '0' && *this->pos <= '9') ||
+            *this->pos == '-' || *this->pos == '+' ||
+            *this->pos == '.' || *this->pos == 'e' || *this->pos == 'E'))
+        ++this->pos;
+    if (this->pos == begin)
+        return false;
+
+    bool ok;
+    number = QByteArray(begin, this->pos - begin).toDouble(&ok);
+    return ok;
+}
+
+bool RequestDecoder::parseLiteral(const char *literal)
+{
+    const int length = qstrlen(literal);
+    if (this->end - this->pos < length || qstrncmp(this->pos, literal, length) != 0)
+        return false;
+    this->pos += length;
+    return true;
+}
+
+bool RequestDecoder::parseValue(Scalar &value, int depth)
+{
+    this->skipSpaces();
+    if (this->pos >= this->end)
+        return false;
+
+    switch (*this->pos)
+    {
+    case '"':
+        value.type = Scalar::STRING;
+        return this->parseString(value.str);
+
+    case 't':
+        value.type = Scalar::BOOL;
+        value.boolean = true;
+        return this->parseLiteral("true");
+
+    case 'f':
+        value.type = Scalar::BOOL;
+        value.boolean = false;
+        return this->parseLiteral("false");
+
+    case 'n':
+        value.type = Scalar::NONE;
+        return this->parseLiteral("null");
+
+    case '{':
+    case '[':
+        value.type = Scalar::NONE;
+        return this->skipValue(depth);
+
+    default:
+        value.type = Scalar::NUMBER;
+        return this->parseNumber(value.number);
+    }
+}
+
+bool RequestDecoder::skipValue(int depth)
+{
+    if (depth > RequestDecoder::maxDepth)
+        return false;
+
+    this->skipSpaces();
+    if (this->pos >= this->end)
+        return false;
+
+    if (*this->pos == '{')
+    {
+        ++this->pos;
+        if (this->consume('}'))
+            return true;
+        do
+        {
+            QString key;
+            if (!this->parseString(key) || !this->consume(':') || !this->skipValue(depth + 1))
+                return false;
+        }
+        while (this->consume(','));
+        return this->consume('}');
+    }
+
+    if (*this->pos == '[')
+    {
+        ++this->pos;
+        if (this->consume(']'))
+            return true;
+        do
+        {
+            if (!this->skipValue(depth + 1))
+                return false;
+        }
+        while (this->consume(','));
+        return this->consume(']');
+    }
+
+    Scalar value;
+    return this->parseValue(value, depth);
+}
+
+qint64 RequestDecoder::toInteger(const Scalar &value)
+{
+    if (value.type != Scalar::NUMBER)
+        return 0;
+
+    //converting a double out of the range is undefined, 2^63 itself
+    //is the first double above the largest qint64
+    if (!(value.number >= -9223372036854775808.0 && value.number < 9223372036854775808.0))
+    {
+        this->isOutOfRange = true;
+        return 0;
+    }
+    return static_cast<qint64>(value.number);
+}
+
+QString RequestDecoder::toString(const Scalar &value)
+{
+    return value.type == Scalar::STRING ? value.str : QString();
+}
@@ -0,0 +1,129 @@
+#ifndef REQUESTDECODER_H
+#define REQUESTDECODER_H
+
+#include <QtCore>
+
+//typed parameters of a query, every field the api knows about
+//is extracted once while decoding instead of being looked up
+//in a QJsonObject by every handler
+struct ApiParams
+{
+    enum Field : quint32
+    {
+        ACCESS_TOKEN    = 1 << 0,
+        USERNAME        = 1 << 1,
+        PASSWORD        = 1 << 2,
+        CHAT_ID         = 1 << 3,
+        USER_ID         = 1 << 4,
+        NUM             = 1 << 5,
+        TEXT            = 1 << 6,
+        NAME            = 1 << 7,
+        MEMBERS         = 1 << 8,
+        IS_VISIBLE      = 1 << 9,
+        PROPERTY        = 1 << 10,
+        VALUE           = 1 << 11,
+        CURRENT_CHAT_ID = 1 << 12,
+        MESSAGES_NUM    = 1 << 13,
+        MESSAGE_TO_SEND = 1 << 14,
+        WATERMARKS      = 1 << 15,
+        AFTER_ID        = 1 << 16,
+        BEFORE_ID       = 1 << 17,
+        SHARD_SECRET    = 1 << 18,
+        SENDER_ID       = 1 << 19,
+        IDENTITIES      = 1 << 20,
+        CLIENT_ADDRESS  = 1 << 21
+    };
+
+    QString     method;
+    quint32     present = 0;
+
+    QString     accessToken;
+    QString     username;
+    QString     password;
+    qint64      chatID = 0;
+    qint64      userID = 0;
+    qint64      num = 0;
+    QString     text;
+    QString     name;
+    QStringList members;
+    bool        isVisible = false;
+    QString     property;
+    QString     value;
+    qint64      currentChatID = 0;
+    qint64      messagesNum = 0;
+    qint64      afterID = 0;
+    qint64      beforeID = 0;
+    qint64      messageChatID = 0;
+    QString     messageText;
+
+    //chat id and the id of the last message the client has in it
+    QVector<QPair<qint64, qint64>> watermarks;
+
+    //set by the router only, the sender and the users of the query
+    //it looked up on their shards, trusted with the right shard secret
+    QString     shardSecret;
+    qint64      senderID = 0;
+    QVector<QPair<qint64, QString>> identities;
+
+    //sent once by the router on the connection it forwards a client on
+    QString     clientAddress;
+
+    //an integer field got a number no qint64 holds, it is rejected
+    //as an incorrect value instead of being converted
+    bool        isOutOfRange = false;
+
+    bool has(Field field) const {return (this->present & field) != 0;}
+
+    //value of an integer field, zero for the other ones
+    qint64 number(Field field) const;
+};
+
+//single pass decoder of the query json, it never builds a DOM:
+//known fields go straight into ApiParams, others are skipped
+class RequestDecoder
+{
+public:
+    //length of the first complete query in the buffer,
+    //-1 if the query is not received completely yet
+    static int frameLength(const QByteArray &buffer);
+
+    //false if the query is malformed or nested too deep
+    static bool decode(const QByteArray &frame, ApiParams &params);
+
+private:
+    RequestDecoder(const QByteArray &frame);
+
+    struct Scalar
+    {
+        enum Type {NONE, NUMBER, STRING, BOOL};
+        Type    type = NONE;
+        double  number = 0;
+        QString str;
+        bool    boolean = false;
+    };
+
+    static const int maxDepth = 16;
+
+    const char *pos;
+    const char *end;
+    bool isOutOfRange = false;
+
+    void skipSpaces();
+    bool consume(char c);
+    bool parseRequest(ApiParams &params);
+    bool parseParams(ApiParams &params);
+    bool parseMessageToSend(ApiParams &params);
+    bool parseStringArray(QStringList &list);
+    bool parseWatermarks(ApiParams &params);
+    bool parseIdentities(ApiParams &params);
+    bool parseString(QString &str);
+    bool parseNumber(double &number);
+    bool parseValue(Scalar &value, int depth);
+    bool skipValue(int depth);
+    bool parseLiteral(const char *literal);
+
+    qint64 toInteger(const Scalar &value);
+    static QString toString(const Scalar &value);
+};
+
+#endif // REQUESTDECODER_H
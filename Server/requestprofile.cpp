@@ -0,0 +1,100 @@
+#include "requestprofile.h"
+#include "tracer.h"
+
+QElapsedTimer RequestProfile::clock = QElapsedTimer();
+thread_local RequestProfile::Profile RequestProfile::profile = RequestProfile::Profile();
+
+RequestProfile::Scope::Scope(const Stage &stage)
+{
+    this->stage = stage;
+    this->startNs = RequestProfile::profile.active ? RequestProfile::now() : -1;
+}
+
+RequestProfile::Scope::~Scope()
+{
+    if (this->startNs >= 0)
+        RequestProfile::addTime(this->stage, RequestProfile::now() - this->startNs);
+}
+
+void RequestProfile::begin()
+{
+    if (!RequestProfile::clock.isValid())
+        RequestProfile::clock.start();
+    Profile &profile = RequestProfile::profile;
+    profile.active = true;
+    std::fill(profile.stageNs, profile.stageNs + STAGES_NUM, 0);
+    profile.total = FileStats();
+    profile.functions.clear();
+}
+
+void RequestProfile::end()
+{
+    RequestProfile::profile.active = false;
+}
+
+bool RequestProfile::isActive()
+{
+    return RequestProfile::profile.active;
+}
+
+qint64 RequestProfile::now()
+{
+    return RequestProfile::clock.nsecsElapsed();
+}
+
+void RequestProfile::addTime(const Stage &stage, const qint64 &ns)
+{
+    RequestProfile::profile.stageNs[stage] += ns;
+}
+
+RequestProfile::FileStats &RequestProfile::functionStats()
+{
+    //a request touches a handful of storage functions, a linear
+    //scan over their literal names is cheaper than hashing
+    const char *function = Tracer::currentSpan();
+    QVector<FileStats> &functions = RequestProfile::profile.functions;
+    for (FileStats &i: functions)
+        if (i.function == function)
+            return i;
+    functions.append(FileStats());
+    functions.last().function = function;
+    return functions.last();
+}
+
+void RequestProfile::addFileOpen(const qint64 &startNs)
+{
+    RequestProfile::addTime(FILE_OPEN, RequestProfile::now() - startNs);
+    ++RequestProfile::profile.total.opens;
+    ++RequestProfile::functionStats().opens;
+}
+
+void RequestProfile::addRead(const qint64 &bytes, const qint64 &startNs)
+{
+    RequestProfile::addTime(FILE_READ, RequestProfile::now() - startNs);
+    RequestProfile::profile.total.readBytes += qMax<qint64>(bytes, 0);
+    RequestProfile::functionStats().readBytes += qMax<qint64>(bytes, 0);
+}
+
+void RequestProfile::addWrite(const qint64 &bytes, const qint64 &startNs)
+{
+    RequestProfile::addTime(FILE_WRITE, RequestProfile::now() - startNs);
+    RequestProfile::profile.total.writtenBytes += qMax<qint64>(bytes, 0);
+    RequestProfile::functionStats().writtenBytes += qMax<qint64>(bytes, 0);
+}
+
+QString RequestProfile::describe()
+{
+    static const char *stageNames[STAGES_NUM] = {"decode", "auth", "handler", "serialize",
+                                                 "open", "read", "write"};
+    const Profile &profile = RequestProfile::profile;
+    QStringList parts;
+    for (int i = 0; i < STAGES_NUM; ++i)
+        parts << QStringLiteral("%1=%2ms").arg(stageNames[i]).arg(profile.stageNs[i] / 1e6, 0, 'f', 3);
+    parts << QStringLiteral("files=%1 read=%2B written=%3B")
+             .arg(profile.total.opens).arg(profile.total.readBytes).arg(profile.total.writtenBytes);
+    for (const FileStats &i: profile.functions)
+        parts << QStringLiteral("[%1 files=%2 read=%3B written=%4B]")
+                 .arg(i.function != nullptr ? i.function : "request")
+                 .arg(i.opens).arg(i.readBytes).arg(i.writtenBytes);
+    return parts.join(' ');
+}
@@ -0,0 +1,71 @@
+#ifndef REQUESTPROFILE_H
+#define REQUESTPROFILE_H
+
+#include <QtCore>
+
+//time per stage and storage io of the request handled on the
+//current thread, for the slow request log. file io is attributed
+//to the innermost trace span, i.e. the storage function doing it
+class RequestProfile
+{
+public:
+    enum Stage
+    {
+        DECODE,
+        AUTH,
+        HANDLER,
+        SERIALIZE,
+        FILE_OPEN,
+        FILE_READ,
+        FILE_WRITE,
+        STAGES_NUM
+    };
+
+    class Scope
+    {
+    public:
+        explicit Scope(const Stage &stage);
+        ~Scope();
+
+    private:
+        Stage stage;
+        qint64 startNs;
+    };
+
+    static void begin();
+    static void end();
+    static bool isActive();
+
+    static qint64 now();
+    static void addTime(const Stage &stage, const qint64 &ns);
+    static void addFileOpen(const qint64 &startNs);
+    static void addRead(const qint64 &bytes, const qint64 &startNs);
+    static void addWrite(const qint64 &bytes, const qint64 &startNs);
+
+    //one line with the stage times and the io per storage function
+    static QString describe();
+
+private:
+    struct FileStats
+    {
+        const char  *function = nullptr;
+        quint64     opens = 0;
+        quint64     readBytes = 0;
+        quint64     writtenBytes = 0;
+    };
+
+    struct Profile
+    {
+        bool                active = false;
+        qint64              stageNs[STAGES_NUM];
+        FileStats           total;
+        QVector<FileStats>  functions;
+    };
+
+    static QElapsedTimer clock;
+    static thread_local Profile profile;
+
+    static FileStats &functionStats();
+};
+
+#endif // REQUESTPROFILE_H
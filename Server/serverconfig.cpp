@@ -0,0 +1,108 @@
+#include "serverconfig.h"
+
+ServerConfig ServerConfig::load(const QString &path)
+{
+    ServerConfig config;
+    if (!QFile::exists(path))
+        return config;
+
+    QSettings settings(path, QSettings::IniFormat);
+
+    settings.beginGroup("network");
+    config.host = settings.value("host", config.host).toString();
+    config.port = settings.value("port", config.port).toUInt();
+    settings.endGroup();
+
+    settings.beginGroup("connections");
+    config.maxQuerySize          = settings.value("max_query_size",          config.maxQuerySize).toInt();
+    config.maxConnections        = settings.value("max_connections",         config.maxConnections).toInt();
+    config.maxConnectionsPerIP   = settings.value("max_connections_per_ip",  config.maxConnectionsPerIP).toInt();
+    config.maxPendingConnections = settings.value("max_pending_connections", config.maxPendingConnections).toInt();
+    config.listenBacklog         = settings.value("listen_backlog",          config.listenBacklog).toInt();
+    config.readTimeout           = settings.value("read_timeout",            config.readTimeout).toLongLong();
+    config.idleTimeout           = settings.value("idle_timeout",            config.idleTimeout).toLongLong();
+    config.timeoutTick           = settings.value("timeout_tick",            config.timeoutTick).toLongLong();
+    settings.endGroup();
+
+    settings.beginGroup("storage");
+    config.messageCacheSize = settings.value("message_cache_size", config.messageCacheSize).toInt();
+    config.dataDir          = settings.value("data_dir",           config.dataDir).toString();
+    settings.endGroup();
+
+    settings.beginGroup("replication");
+    config.replicationRole      = settings.value("role",        config.replicationRole).toString();
+    config.replicationHost      = settings.value("host",        config.replicationHost).toString();
+    config.replicationPort      = settings.value("port",        config.replicationPort).toUInt();
+    config.replicationSecret    = settings.value("secret",      config.replicationSecret).toString();
+    config.leaderHost           = settings.value("leader_host", config.leaderHost).toString();
+    config.leaderPort           = settings.value("leader_port", config.leaderPort).toUInt();
+    config.replicationHeartbeat = settings.value("heartbeat",   config.replicationHeartbeat).toLongLong();
+    settings.endGroup();
+
+    settings.beginGroup("sharding");
+    config.shards            = settings.value("shards",        config.shards).toStringList();
+    config.shardIndex        = settings.value("shard_index",   config.shardIndex).toInt();
+    config.shardVirtualNodes = settings.value("virtual_nodes", config.shardVirtualNodes).toInt();
+    config.shardRouter       = settings.value("router",        config.shardRouter).toBool();
+    config.shardSecret       = settings.value("secret",        config.shardSecret).toString();
+    settings.endGroup();
+
+    settings.beginGroup("bus");
+    config.busHost          = settings.value("host",           config.busHost).toString();
+    config.busPort          = settings.value("port",           config.busPort).toUInt();
+    config.busSecret        = settings.value("secret",         config.busSecret).toString();
+    config.busPeers         = settings.value("peers",          config.busPeers).toStringList();
+    config.busFlushInterval = settings.value("flush_interval", config.busFlushInterval).toLongLong();
+    settings.endGroup();
+
+    settings.beginGroup("admin");
+    config.adminHost  = settings.value("host",  config.adminHost).toString();
+    config.adminPort  = settings.value("port",  config.adminPort).toUInt();
+    config.adminUsers = settings.value("users", config.adminUsers).toStringList();
+    settings.endGroup();
+
+    settings.beginGroup("tracing");
+    config.traceSampleRate = settings.value("sample_rate", config.traceSampleRate).toDouble();
+    config.traceBufferSize = settings.value("buffer_size", config.traceBufferSize).toInt();
+    settings.endGroup();
+
+    settings.beginGroup("slow_log");
+    config.slowRequestThreshold = settings.value("threshold", config.slowRequestThreshold).toLongLong();
+    settings.endGroup();
+
+    settings.beginGroup("capture");
+    config.capturePath = settings.value("path", config.capturePath).toString();
+    settings.endGroup();
+
+    settings.beginGroup("auth");
+    config.tokenTTL               = settings.value("token_ttl",                config.tokenTTL).toLongLong();
+    config.tokenSlidingRenewal    = settings.value("token_sliding_renewal",    config.tokenSlidingRenewal).toBool();
+    config.tokenExpiryTick        = settings.value("token_expiry_tick",        config.tokenExpiryTick).toLongLong();
+    config.passwordHashIterations = settings.value("password_hash_iterations", config.passwordHashIterations).toInt();
+    config.authThreads            = settings.value("threads",                  config.authThreads).toInt();
+    config.authQueueSize          = settings.value("queue_size",               config.authQueueSize).toInt();
+    settings.endGroup();
+
+    settings.beginGroup("rate_limits");
+    config.ipRate     = settings.value("ip_rate",     config.ipRate).toDouble();
+    config.ipBurst    = settings.value("ip_burst",    config.ipBurst).toDouble();
+    config.tokenRate  = settings.value("token_rate",  config.tokenRate).toDouble();
+    config.tokenBurst = settings.value("token_burst", config.tokenBurst).toDouble();
+    settings.endGroup();
+
+    //every key is a method name, value is "rate,burst"
+    settings.beginGroup("method_limits");
+    for (const QString &method: settings.childKeys())
+    {
+        QStringList values = settings.value(method).toStringList();
+        if (values.size() != 2)
+        {
+            qDebug() << "Incorrect rate limit for method" << method;
+            continue;
+        }
+        config.methodLimits[method] = {values[0].toDouble(), values[1].toDouble()};
+    }
+    settings.endGroup();
+
+    return config;
+}
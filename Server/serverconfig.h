@@ -0,0 +1,122 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <QtCore>
+
+//all the tunables of the server, read from an ini file
+//so nothing has to be recompiled to change a limit
+struct ServerConfig
+{
+    QString host = "192.168.50.19";
+    quint16 port = 9999;
+
+    //token bucket limits, rate is in requests per second,
+    //burst is the size of the bucket. zero rate disables the limit
+    double  ipRate = 50;
+    double  ipBurst = 100;
+    double  tokenRate = 20;
+    double  tokenBurst = 40;
+    QMap<QString, QPair<double, double>> methodLimits = {
+        {"chat.sendmessage",     {5,  10}},
+        {"chat.create",          {1,  5}},
+        {"user.create",          {1,  3}},
+        {"access_token.change",  {1,  5}}
+    };
+
+    //queries bigger than this are rejected before decoding
+    int     maxQuerySize = 2048;
+
+    //connection lifecycle, timeouts are in milliseconds,
+    //read timeout applies while a query is partly received,
+    //from its first byte on, idle timeout between queries
+    int     maxConnections = 10000;
+    int     maxConnectionsPerIP = 64;
+    int     maxPendingConnections = 128;
+    int     listenBacklog = 128;
+    qint64  readTimeout = 10000;
+    qint64  idleTimeout = 120000;
+    qint64  timeoutTick = 500;
+
+    //access tokens expire token_ttl seconds after they were issued or,
+    //with sliding renewal, after they were used for the last time
+    qint64  tokenTTL = 30 * 24 * 60 * 60;
+    bool    tokenSlidingRenewal = true;
+    qint64  tokenExpiryTick = 1000;
+
+    //password hashing runs on a separate bounded pool, logins
+    //over the queue size are rejected instead of stalling requests
+    int     passwordHashIterations = 100000;
+    int     authThreads = qMax(1, QThread::idealThreadCount() - 1);
+    int     authQueueSize = 64;
+
+    //memory for the pre-encoded messages of the history responses
+    int     messageCacheSize = 64 * 1024 * 1024;
+
+    //chats/ and dbase/ are looked up here, empty is the working directory
+    QString dataDir;
+
+    //"standalone", "leader" streams its mutation log to followers on
+    //replication_port, "follower" applies the log of the leader and
+    //serves only read-only methods. the log holds password hashes and
+    //tokens, so the leader listens on localhost unless a secret is set,
+    //followers have to send the same secret before getting anything
+    QString replicationRole = "standalone";
+    QString replicationHost = "127.0.0.1";
+    quint16 replicationPort = 9998;
+    QString replicationSecret;
+    QString leaderHost = "127.0.0.1";
+    quint16 leaderPort = 9998;
+    qint64  replicationHeartbeat = 1000;
+
+    //"host:port" of every shard, chats are placed by chat id and new
+    //users by username on a consistent hash ring. shard_index is the
+    //position of this node in the list, -1 runs it unsharded. users never
+    //move, their ids and tokens carry the index of their shard and the
+    //router looks usernames up on every shard. so a shard is added at
+    //the end of the list on every node, router included, and only the
+    //chat directories the ring gives to it are moved there. a router
+    //node only forwards queries to the shards, together with the users
+    //it looked up on the other shards, which the shards trust with the
+    //secret. with the secret the router also tells the shards the address
+    //of every client it forwards, the per address limits are kept for it
+    //and the connections of the router arent capped by its own address
+    QStringList shards;
+    int     shardIndex = -1;
+    int     shardVirtualNodes = 160;
+    bool    shardRouter = false;
+    QString shardSecret;
+
+    //committed events are broadcast to the bus_port of every peer node
+    //in batches of flush_interval milliseconds, zero port disables the bus.
+    //it listens on localhost unless a secret every peer sends is set
+    QString busHost = "127.0.0.1";
+    quint16 busPort = 0;
+    QString busSecret;
+    QStringList busPeers;
+    qint64  busFlushInterval = 5;
+
+    //prometheus metrics are served over http on the admin port,
+    //bound to localhost only. zero port disables it
+    QString adminHost = "127.0.0.1";
+    quint16 adminPort = 9997;
+
+    //usernames allowed to call server.stats
+    QStringList adminUsers;
+
+    //fraction of the requests traced into a ring buffer of buffer_size
+    //events, dumped in the chrome trace format on the admin port
+    double  traceSampleRate = 0.01;
+    int     traceBufferSize = 65536;
+
+    //requests slower than this many milliseconds are logged with their
+    //time per stage and storage io, zero disables the log
+    qint64  slowRequestThreshold = 100;
+
+    //incoming queries are recorded here for a later replay, with
+    //passwords and access tokens redacted. empty disables the capture
+    QString capturePath;
+
+    static ServerConfig load(const QString &path);
+};
+
+#endif // SERVERCONFIG_H
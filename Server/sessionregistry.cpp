@@ -0,0 +1,59 @@
+#include "sessionregistry.h"
+
+void SessionRegistry::add(const size_t &userID, QTcpSocket *socket)
+{
+    //the same connection can be reused by another account
+    this->remove(socket);
+    this->sessions[userID].insert(socket);
+    this->users.insert(socket, userID);
+}
+
+void SessionRegistry::remove(QTcpSocket *socket)
+{
+    auto user = this->users.find(socket);
+    if (user == this->users.end())
+        return;
+
+    auto userSessions = this->sessions.find(user.value());
+    userSessions->remove(socket);
+    if (userSessions->isEmpty())
+        this->sessions.erase(userSessions);
+    this->users.erase(user);
+}
+
+bool SessionRegistry::isOnline(const size_t &userID) const
+{
+    return this->sessions.contains(userID);
+}
+
+QList<QTcpSocket*> SessionRegistry::connections(const size_t &userID) const
+{
+    return this->sessions.value(userID).values();
+}
+
+int SessionRegistry::usersCount() const
+{
+    return this->sessions.size();
+}
+
+int SessionRegistry::sessionsCount() const
+{
+    return this->users.size();
+}
+
+int SessionRegistry::publish(const QJsonArray &userIDs, const QByteArray &frame) const
+{
+    int writes = 0;
+    for (QJsonValue i: userIDs)
+    {
+        auto userSessions = this->sessions.constFind(static_cast<size_t>(i.toDouble()));
+        if (userSessions == this->sessions.constEnd())
+            continue;
+        for (QTcpSocket *socket: *userSessions)
+        {
+            socket->write(frame);
+            ++writes;
+        }
+    }
+    return writes;
+}
@@ -0,0 +1,29 @@
+#ifndef SESSIONREGISTRY_H
+#define SESSIONREGISTRY_H
+
+#include <QtCore>
+#include <QTcpSocket>
+
+//keeps track of which users are online and through which
+//connections, so new events can be pushed instead of polled
+class SessionRegistry
+{
+public:
+    void add(const size_t &userID, QTcpSocket *socket);
+    void remove(QTcpSocket *socket);
+
+    bool isOnline(const size_t &userID) const;
+    QList<QTcpSocket*> connections(const size_t &userID) const;
+    int usersCount() const;
+    int sessionsCount() const;
+
+    //writes one already serialized frame to every online
+    //member of the list, returns the number of socket writes
+    int publish(const QJsonArray &userIDs, const QByteArray &frame) const;
+
+private:
+    QHash<size_t, QSet<QTcpSocket*>> sessions;
+    QHash<QTcpSocket*, size_t> users;
+};
+
+#endif // SESSIONREGISTRY_H
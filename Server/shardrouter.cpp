@@ -0,0 +1,626 @@
+#include "shardrouter.h"
+
+ShardRouter::ShardRouter(const ServerConfig &config, QObject *parent)
+    : QObject(parent), ring(config.shardVirtualNodes)
+{
+    this->config = config;
+    for (const QString &i: config.shards)
+    {
+        QString shard = i.trimmed();
+        this->ring.addNode(shard);
+        this->shardAddresses.insert(shard, {shard.section(':', 0, -2), shard.section(':', -1).toUShort()});
+    }
+
+    this->server = new QTcpServer(this);
+    if (!this->server->listen(QHostAddress(config.host), config.port))
+    {
+        qDebug() << "Unable to listen port" << config.port;
+        return;
+    }
+    connect(this->server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
+    qDebug() << "Router started with shards" << this->ring.nodes();
+}
+
+QByteArray ShardRouter::hello(const QString &clientAddress) const
+{
+    //the shard charges the client address its limits instead of the
+    //address of the router, the control connection goes without one
+    QJsonObject params;
+    params.insert("shard_secret", this->config.shardSecret);
+    if (!clientAddress.isEmpty())
+        params.insert("client_address", clientAddress);
+    QJsonObject query;
+    query.insert("method", "internal.hello");
+    query.insert("params", params);
+    return QJsonDocument(query).toJson(QJsonDocument::Compact);
+}
+
+QString ShardRouter::route(const ApiParams &params) const
+{
+    //chat scoped methods go to the shard of the chat, the others to
+    //the shard of the user, named by the token. a username is looked
+    //up by locate, the ring only places the new ones
+    if (params.has(ApiParams::CHAT_ID))
+        return this->ring.node(ConsistentHashRing::chatKey(params.chatID));
+    if (params.has(ApiParams::ACCESS_TOKEN))
+    {
+        //a token without the prefix is refused by any shard
+        const QString shard = this->tokenShard(params.accessToken);
+        return shard.isEmpty() ? this->ring.node(QByteArray()) : shard;
+    }
+    if (params.has(ApiParams::USERNAME))
+        return this->ring.node(ConsistentHashRing::userKey(params.username));
+    return this->ring.node(QByteArray());
+}
+
+QString ShardRouter::userShard(const qint64 &userID) const
+{
+    return this->shardAt(ConsistentHashRing::userShardIndex(userID));
+}
+
+QString ShardRouter::tokenShard(const QString &token) const
+{
+    return this->shardAt(ConsistentHashRing::tokenShardIndex(token));
+}
+
+QString ShardRouter::shardAt(const int &shardIndex) const
+{
+    return shardIndex >= 0 && shardIndex < this->config.shards.size() ? this->config.shards[shardIndex].trimmed() : QString();
+}
+
+void ShardRouter::slotNewConnection()
+{
+    while (this->server->hasPendingConnections())
+    {
+        QTcpSocket *clientSocket = this->server->nextPendingConnection();
+        this->clients.insert(clientSocket, Client());
+        connect(clientSocket, SIGNAL(readyRead()), this, SLOT(slotReadClient()));
+        connect(clientSocket, SIGNAL(disconnected()), this, SLOT(slotClientDisconnected()));
+    }
+}
+
+void ShardRouter::slotReadClient()
+{
+    QTcpSocket *clientSocket = static_cast<QTcpSocket*>(sender());
+    auto client = this->clients.find(clientSocket);
+    if (client == this->clients.end())
+        return;
+
+    client->in += clientSocket->readAll();
+    int frameLength;
+    while ((frameLength = RequestDecoder::frameLength(client->in)) > 0 &&
+           frameLength <= this->config.maxQuerySize)
+    {
+        client->pending.enqueue(client->in.left(frameLength));
+        client->in.remove(0, frameLength);
+    }
+
+    //the shard answers oversized queries itself, the router only
+    //has to stop buffering them
+    if (frameLength > this->config.maxQuerySize ||
+        (frameLength < 0 && client->in.size() > this->config.maxQuerySize))
+    {
+        client->pending.enqueue(client->in);
+        client->in.clear();
+    }
+    else if (frameLength < 0 && client->in.trimmed().isEmpty())
+        client->in.clear();
+
+    this->forwardNext(clientSocket);
+}
+
+void ShardRouter::forwardNext(QTcpSocket *clientSocket)
+{
+    auto client = this->clients.find(clientSocket);
+    if (client == this->clients.end() || client->waitingOn != nullptr ||
+        client->pendingLookups > 0 || !client->parts.isEmpty() || client->pending.isEmpty())
+        return;
+
+    QByteArray frame = client->pending.dequeue();
+    ApiParams params;
+    const bool isDecoded = RequestDecoder::decode(frame, params);
+    QString shard = isDecoded ? this->route(params) : this->ring.node(QByteArray());
+    if (shard.isEmpty())
+    {
+        qDebug() << "No shards to route the query to";
+        return this->closeClient(clientSocket);
+    }
+
+    client->resolving = frame;
+    client->resolvingShard = shard;
+    client->senderID = -1;
+    client->identities = QJsonObject();
+    client->remoteMembers.clear();
+    client->chatName = params.name;
+    client->accessToken = params.accessToken;
+
+    //logins and sign ups go to the shard which has the username,
+    //wherever the ring would put it now
+    if (isDecoded && !this->config.shardSecret.isEmpty() && !params.has(ApiParams::CHAT_ID) &&
+        !params.has(ApiParams::ACCESS_TOKEN) && params.has(ApiParams::USERNAME))
+        return this->locate(clientSocket, params.username);
+
+    //the sender and the users of the query that live on other shards
+    //are looked up there. the shards trust the lookups only with the
+    //secret, without it the query goes as it is
+    if (isDecoded && !this->config.shardSecret.isEmpty())
+    {
+        //the parts are asked for the sender, so it is looked up
+        //on its own shard too
+        if (params.has(ApiParams::ACCESS_TOKEN) && !params.has(ApiParams::CHAT_ID))
+            client->resolving = this->split(frame, params, shard, client->parts);
+
+        if (params.has(ApiParams::ACCESS_TOKEN))
+        {
+            QString tokenShard = this->tokenShard(params.accessToken);
+            if (!tokenShard.isEmpty() && (tokenShard != shard || !client->parts.isEmpty()))
+                this->lookUp(clientSocket, tokenShard, {{"access_token", params.accessToken}});
+        }
+        //a member is only on one shard, the one of the query finds
+        //its own users itself
+        if (params.has(ApiParams::MEMBERS))
+            for (const QString &i: params.members)
+                for (const QString &j: this->shardAddresses.keys())
+                    if (j != shard)
+                        this->lookUp(clientSocket, j, {{"username", i}});
+        if (params.has(ApiParams::USER_ID) && params.userID >= 0)
+        {
+            QString memberShard = this->userShard(params.userID);
+            if (!memberShard.isEmpty() && memberShard != shard)
+                this->lookUp(clientSocket, memberShard, {{"user_id", static_cast<double>(params.userID)}});
+        }
+    }
+
+    if (this->clients[clientSocket].pendingLookups == 0)
+        this->forwardResolved(clientSocket);
+}
+
+void ShardRouter::lookUp(QTcpSocket *clientSocket, const QString &shard, const QJsonObject &params)
+{
+    ++this->clients[clientSocket].pendingLookups;
+    QPointer<QTcpSocket> client(clientSocket);
+    this->call(shard, "internal.whois", params, [this, client, params](const QJsonObject &reply)
+    {
+        if (client.isNull() || !this->clients.contains(client))
+            return;
+
+        //a user that isnt found is reported by the shard of the query
+        Client &resolving = this->clients[client];
+        if (reply.contains("user_id"))
+        {
+            const qint64 userID = reply["user_id"].toDouble();
+            resolving.identities.insert(QString::number(userID), reply["username"]);
+            if (params.contains("access_token"))
+                resolving.senderID = userID;
+            else if (params.contains("username"))
+                resolving.remoteMembers.append(userID);
+        }
+        if (--resolving.pendingLookups == 0)
+            this->forwardResolved(client);
+    });
+}
+
+void ShardRouter::locate(QTcpSocket *clientSocket, const QString &username)
+{
+    //every shard is asked, a new user goes to the shard the ring
+    //gives its username. a shard which doesnt answer may have the
+    //user, so its username could be taken twice, the client is closed
+    Client &client = this->clients[clientSocket];
+    client.isLocated = false;
+    client.isLookupFailed = false;
+    QPointer<QTcpSocket> clientPointer(clientSocket);
+    for (const QString &i: this->shardAddresses.keys())
+    {
+        ++client.pendingLookups;
+        this->call(i, "internal.whois", {{"username", username}}, [this, clientPointer, i](const QJsonObject &reply)
+        {
+            if (clientPointer.isNull() || !this->clients.contains(clientPointer))
+                return;
+
+            Client &locating = this->clients[clientPointer];
+            if (reply.isEmpty())
+                locating.isLookupFailed = true;
+            else if (reply.contains("user_id"))
+            {
+                locating.isLocated = true;
+                locating.resolvingShard = i;
+            }
+            if (--locating.pendingLookups > 0)
+                return;
+
+            if (locating.isLookupFailed && !locating.isLocated)
+            {
+                qDebug() << "Unable to look a username up, a shard is unavailable";
+                return this->closeClient(clientPointer);
+            }
+            this->forwardResolved(clientPointer);
+        });
+    }
+}
+
+void ShardRouter::forwardResolved(QTcpSocket *clientSocket)
+{
+    Client &client = this->clients[clientSocket];
+    QByteArray frame = client.resolving;
+    client.resolving.clear();
+
+    //these fields come from the router only, the ones a client
+    //may have put into its query are replaced
+    if (!client.identities.isEmpty())
+    {
+        QJsonObject query = QJsonDocument::fromJson(frame).object();
+        QJsonObject params = query["params"].toObject();
+        params.remove("sender_id");
+        params.insert("shard_secret", this->config.shardSecret);
+        params.insert("identities", client.identities);
+        if (client.senderID >= 0)
+            params.insert("sender_id", static_cast<double>(client.senderID));
+        query["params"] = params;
+        frame = QJsonDocument(query).toJson(QJsonDocument::Compact);
+    }
+
+    client.waitingOn = this->upstream(clientSocket, client.resolvingShard);
+    client.waitingOn->write(frame);
+}
+
+QByteArray ShardRouter::split(const QByteArray &frame, const ApiParams &params, const QString &shard, QVector<Part> &parts) const
+{
+    QJsonObject query = QJsonDocument::fromJson(frame).object();
+    QJsonObject queryParams = query["params"].toObject();
+
+    //the open chat of a poll is read with chat.getlastmessages and
+    //the message sent along with it with chat.sendmessage
+    if (params.method == QLatin1String("user.getmyinfo"))
+    {
+        if (params.has(ApiParams::CURRENT_CHAT_ID) && params.currentChatID >= 0 &&
+            params.has(ApiParams::MESSAGES_NUM) && params.messagesNum > 0)
+        {
+            const QString chatShard = this->ring.node(ConsistentHashRing::chatKey(params.currentChatID));
+            if (chatShard != shard)
+            {
+                QJsonObject partParams;
+                partParams.insert("chat_id", static_cast<double>(params.currentChatID));
+                partParams.insert("num", static_cast<double>(params.messagesNum));
+                if (params.has(ApiParams::AFTER_ID))
+                    partParams.insert("after_id", static_cast<double>(params.afterID));
+                parts.append({chatShard, "chat.getlastmessages", partParams, QJsonObject()});
+                queryParams.remove("current_chat_id");
+                queryParams.remove("messages_num");
+                queryParams.remove("after_id");
+            }
+        }
+        if (params.has(ApiParams::MESSAGE_TO_SEND) && params.messageChatID >= 0)
+        {
+            const QString chatShard = this->ring.node(ConsistentHashRing::chatKey(params.messageChatID));
+            if (chatShard != shard)
+            {
+                QJsonObject partParams;
+                partParams.insert("chat_id", static_cast<double>(params.messageChatID));
+                partParams.insert("text", params.messageText);
+                parts.append({chatShard, "chat.sendmessage", partParams, QJsonObject()});
+                queryParams.remove("message_to_send");
+            }
+        }
+    }
+
+    //a resume is split by the shards of the watermarks
+    else if (params.method == QLatin1String("session.resume"))
+    {
+        QJsonObject watermarks = queryParams["watermarks"].toObject();
+        QMap<QString, QJsonObject> shardWatermarks;
+        for (auto i = watermarks.begin(); i != watermarks.end();)
+        {
+            bool ok;
+            const qint64 chatID = i.key().toLongLong(&ok);
+            const QString chatShard = ok && chatID >= 0 ? this->ring.node(ConsistentHashRing::chatKey(chatID)) : shard;
+            if (chatShard == shard)
+            {
+                ++i;
+                continue;
+            }
+            shardWatermarks[chatShard].insert(i.key(), i.value());
+            i = watermarks.erase(i);
+        }
+        for (auto i = shardWatermarks.constBegin(); i != shardWatermarks.constEnd(); ++i)
+            parts.append({i.key(), "session.resume", {{"watermarks", i.value()}}, QJsonObject()});
+        queryParams["watermarks"] = watermarks;
+    }
+
+    if (parts.isEmpty())
+        return frame;
+    query["params"] = queryParams;
+    return QJsonDocument(query).toJson(QJsonDocument::Compact);
+}
+
+void ShardRouter::sendParts(QTcpSocket *clientSocket, const QByteArray &response)
+{
+    //an error of the query, throttling included, is the whole answer
+    Client &client = this->clients[clientSocket];
+    client.response = QJsonDocument::fromJson(response).object();
+    if (client.response.isEmpty() || client.response["error_code"].toInt() != 0 || client.senderID < 0)
+    {
+        client.parts.clear();
+        client.response = QJsonObject();
+        clientSocket->write(response);
+        return this->forwardNext(clientSocket);
+    }
+
+    QPointer<QTcpSocket> clientPointer(clientSocket);
+    client.pendingParts = client.parts.size();
+    for (int i = 0; i < client.parts.size(); ++i)
+    {
+        QJsonObject params = client.parts[i].params;
+        params.insert("access_token", client.accessToken);
+        params.insert("sender_id", static_cast<double>(client.senderID));
+        params.insert("identities", client.identities);
+        this->call(client.parts[i].shard, client.parts[i].method, params, [this, clientPointer, i](const QJsonObject &reply)
+        {
+            if (clientPointer.isNull() || !this->clients.contains(clientPointer))
+                return;
+            Client &merging = this->clients[clientPointer];
+            merging.parts[i].reply = reply;
+            if (--merging.pendingParts == 0)
+                this->mergeParts(clientPointer);
+        });
+    }
+}
+
+void ShardRouter::mergeParts(QTcpSocket *clientSocket)
+{
+    //parts which failed are left out, as the shard of the chat itself
+    //leaves out a chat the user isnt in. a throttled message is the
+    //answer instead, so the client sends it again
+    Client &client = this->clients[clientSocket];
+    QJsonObject response = client.response;
+    QJsonArray resumed = response["resumed"].toArray();
+    for (const Part &i: client.parts)
+    {
+        if (i.method == QLatin1String("chat.sendmessage") && i.reply.contains("retry_after"))
+        {
+            response = i.reply;
+            break;
+        }
+        if (i.method == QLatin1String("chat.getlastmessages") && i.reply.contains("newest_messages"))
+            response.insert("newest_messages", QJsonObject{{"chat_id", i.reply["chat_id"]},
+                                                           {"messages", i.reply["newest_messages"]}});
+        else if (i.method == QLatin1String("session.resume"))
+            for (QJsonValue j: i.reply["resumed"].toArray())
+                resumed.append(j);
+    }
+    if (response.contains("resumed"))
+        response["resumed"] = resumed;
+
+    client.parts.clear();
+    client.response = QJsonObject();
+    clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact) + '\n');
+    this->forwardNext(clientSocket);
+}
+
+void ShardRouter::addRemoteMemberships(QTcpSocket *clientSocket, const QByteArray &response)
+{
+    Client &client = this->clients[clientSocket];
+    QVector<qint64> members = client.remoteMembers;
+    client.remoteMembers.clear();
+
+    QJsonObject chat = QJsonDocument::fromJson(response).object();
+    if (!chat.contains("chat_id"))
+        return;
+
+    for (qint64 i: members)
+    {
+        QJsonObject params;
+        params.insert("user_id", static_cast<double>(i));
+        params.insert("chat_id", chat["chat_id"]);
+        params.insert("name", client.chatName);
+        this->call(this->userShard(i), "internal.addmembership", params, [i](const QJsonObject &reply)
+        {
+            if (reply.isEmpty() || reply["error_code"].toInt() != 0)
+                qDebug() << "Unable to add the new chat to the chats of user" << i;
+        });
+    }
+}
+
+void ShardRouter::call(const QString &shard, const QString &method, QJsonObject params, const Callback &onReply)
+{
+    QTcpSocket *controlSocket = this->controlSockets.value(shard, nullptr);
+    if (controlSocket == nullptr)
+    {
+        controlSocket = new QTcpSocket(this);
+        this->controlSockets.insert(shard, controlSocket);
+        this->controls.insert(controlSocket, Control());
+
+        connect(controlSocket, SIGNAL(readyRead()), this, SLOT(slotReadControl()));
+        connect(controlSocket, SIGNAL(disconnected()), this, SLOT(slotControlDisconnected()));
+        connect(controlSocket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)), this, SLOT(slotControlDisconnected()));
+        controlSocket->connectToHost(this->shardAddresses[shard].first, this->shardAddresses[shard].second);
+
+        this->controls[controlSocket].callbacks.enqueue([shard](const QJsonObject &reply)
+        {
+            if (!reply.isEmpty() && reply["error_code"].toInt() != 0)
+                qDebug() << "Shard" << shard << "refused the router, check the shard secret";
+        });
+        controlSocket->write(this->hello(QString()));
+    }
+
+    params.insert("shard_secret", this->config.shardSecret);
+    QJsonObject query;
+    query.insert("method", method);
+    query.insert("params", params);
+    this->controls[controlSocket].callbacks.enqueue(onReply);
+    controlSocket->write(QJsonDocument(query).toJson(QJsonDocument::Compact));
+}
+
+void ShardRouter::slotReadControl()
+{
+    QTcpSocket *controlSocket = static_cast<QTcpSocket*>(sender());
+    auto control = this->controls.find(controlSocket);
+    if (control == this->controls.end())
+        return;
+
+    control->in += controlSocket->readAll();
+    QVector<QPair<Callback, QJsonObject>> replies;
+    int lineEnd;
+    while ((lineEnd = control->in.indexOf('\n')) >= 0)
+    {
+        QJsonObject reply = QJsonDocument::fromJson(control->in.left(lineEnd)).object();
+        control->in.remove(0, lineEnd + 1);
+        if (!control->callbacks.isEmpty())
+            replies.append(qMakePair(control->callbacks.dequeue(), reply));
+    }
+
+    //callbacks may call the shards again, so they run after the buffer is handled
+    for (const auto &i: replies)
+        i.first(i.second);
+}
+
+void ShardRouter::slotControlDisconnected()
+{
+    QTcpSocket *controlSocket = static_cast<QTcpSocket*>(sender());
+    auto control = this->controls.find(controlSocket);
+    if (control == this->controls.end())
+        return;
+
+    //calls in flight are answered with nothing, the users are not found
+    QQueue<Callback> callbacks = control->callbacks;
+    this->controls.erase(control);
+    this->controlSockets.remove(this->controlSockets.key(controlSocket));
+    controlSocket->disconnect(this);
+    controlSocket->deleteLater();
+
+    if (!callbacks.isEmpty())
+        qDebug() << "Shard" << controlSocket->peerName() << controlSocket->peerPort() << "is unavailable for lookups";
+    for (const Callback &i: callbacks)
+        i(QJsonObject());
+}
+
+QTcpSocket *ShardRouter::upstream(QTcpSocket *clientSocket, const QString &shard)
+{
+    //one connection per client and shard keeps the pushed events
+    //of a subscribed client on the connection they belong to
+    Client &client = this->clients[clientSocket];
+    QTcpSocket *shardSocket = client.shards.value(shard, nullptr);
+    if (shardSocket != nullptr)
+        return shardSocket;
+
+    shardSocket = new QTcpSocket(this);
+    Upstream upstream;
+    upstream.client = clientSocket;
+    upstream.isGreeted = this->config.shardSecret.isEmpty();
+    this->upstreams.insert(shardSocket, upstream);
+    client.shards.insert(shard, shardSocket);
+
+    connect(shardSocket, SIGNAL(readyRead()), this, SLOT(slotReadShard()));
+    connect(shardSocket, SIGNAL(disconnected()), this, SLOT(slotShardDisconnected()));
+    connect(shardSocket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)), this, SLOT(slotShardDisconnected()));
+    shardSocket->connectToHost(this->shardAddresses[shard].first, this->shardAddresses[shard].second);
+    if (!upstream.isGreeted)
+        shardSocket->write(this->hello(clientSocket->peerAddress().toString()));
+    return shardSocket;
+}
+
+void ShardRouter::slotReadShard()
+{
+    QTcpSocket *shardSocket = static_cast<QTcpSocket*>(sender());
+    auto upstream = this->upstreams.find(shardSocket);
+    if (upstream == this->upstreams.end())
+        return;
+
+    //forwarding the next query may open another upstream,
+    //so the buffer is taken out of the table while lines are handled
+    QTcpSocket *clientSocket = upstream->client;
+    QByteArray in = upstream->in + shardSocket->readAll();
+    upstream->in.clear();
+
+    int lineEnd;
+    while ((lineEnd = in.indexOf('\n')) >= 0 && this->clients.contains(clientSocket))
+    {
+        QByteArray line = in.left(lineEnd + 1);
+        in.remove(0, lineEnd + 1);
+
+        //a shard refuses the hello with a wrong secret or when the
+        //client has too many connections already
+        if (!this->upstreams[shardSocket].isGreeted && !line.startsWith("{\"event\""))
+        {
+            this->upstreams[shardSocket].isGreeted = true;
+            if (QJsonDocument::fromJson(line).object()["error_code"].toInt() != 0)
+            {
+                qDebug() << "Shard" << shardSocket->peerName() << shardSocket->peerPort() << "refused the client";
+                this->closeClient(clientSocket);
+                return;
+            }
+            continue;
+        }
+        //pushed events pass through, a response lets the next query go.
+        //the response of a split query waits for its parts
+        Client &client = this->clients[clientSocket];
+        const bool isResponse = !line.startsWith("{\"event\"") && client.waitingOn == shardSocket;
+        if (isResponse && !client.parts.isEmpty())
+        {
+            client.waitingOn = nullptr;
+            this->sendParts(clientSocket, line);
+            continue;
+        }
+        clientSocket->write(line);
+
+        if (isResponse)
+        {
+            client.waitingOn = nullptr;
+            if (!client.remoteMembers.isEmpty())
+                this->addRemoteMemberships(clientSocket, line);
+            this->forwardNext(clientSocket);
+        }
+    }
+
+    if (this->upstreams.contains(shardSocket))
+        this->upstreams[shardSocket].in = in;
+}
+
+void ShardRouter::slotShardDisconnected()
+{
+    QTcpSocket *shardSocket = static_cast<QTcpSocket*>(sender());
+    auto upstream = this->upstreams.find(shardSocket);
+    if (upstream == this->upstreams.end())
+        return;
+
+    //the query in flight is lost, the client sees its connection closed
+    QTcpSocket *clientSocket = upstream->client;
+    this->upstreams.erase(upstream);
+    auto client = this->clients.find(clientSocket);
+    if (client != this->clients.end())
+    {
+        if (client->waitingOn == shardSocket)
+        {
+            qDebug() << "Shard" << shardSocket->peerName() << shardSocket->peerPort() << "is unavailable";
+            this->closeClient(clientSocket);
+            return;
+        }
+        client->shards.remove(client->shards.key(shardSocket));
+    }
+    shardSocket->disconnect(this);
+    shardSocket->deleteLater();
+}
+
+void ShardRouter::slotClientDisconnected()
+{
+    this->closeClient(static_cast<QTcpSocket*>(sender()));
+}
+
+void ShardRouter::closeClient(QTcpSocket *clientSocket)
+{
+    auto client = this->clients.find(clientSocket);
+    if (client == this->clients.end())
+        return;
+
+    for (QTcpSocket *shardSocket: client->shards)
+    {
+        this->upstreams.remove(shardSocket);
+        shardSocket->disconnect(this);
+        shardSocket->abort();
+        shardSocket->deleteLater();
+    }
+    this->clients.erase(client);
+
+    clientSocket->disconnect(this);
+    clientSocket->disconnectFromHost();
+    clientSocket->deleteLater();
+}
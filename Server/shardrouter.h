@@ -0,0 +1,118 @@
+#ifndef SHARDROUTER_H
+#define SHARDROUTER_H
+
+#include <QtCore>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "serverconfig.h"
+#include "consistenthashring.h"
+#include "requestdecoder.h"
+#include <functional>
+
+//front end of a sharded deployment: every query is forwarded to the
+//shard owning its chat id, token or username. chats are placed on the
+//ring, users stay on the shard they were created on, which their ids
+//and tokens name. a username is looked up on every shard. users of the
+//query that live on another shard are looked up there first and sent
+//along with it. queries of a connection are answered in order, so only
+//one of them is in flight while the others wait in its queue
+class ShardRouter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ShardRouter(const ServerConfig &config, QObject *parent = nullptr);
+
+public slots:
+    void slotNewConnection();
+    void slotReadClient();
+    void slotClientDisconnected();
+    void slotReadShard();
+    void slotShardDisconnected();
+    void slotReadControl();
+    void slotControlDisconnected();
+
+private:
+    //a poll or a resume reading chats of other shards is split: the
+    //shard of the user answers the query without them, then each part
+    //is asked on the shard of its chats and merged into the response
+    struct Part
+    {
+        QString     shard;
+        QString     method;
+        QJsonObject params;
+        QJsonObject reply;
+    };
+
+    struct Client
+    {
+        QByteArray                  in;
+        QQueue<QByteArray>          pending;
+        QTcpSocket                  *waitingOn = nullptr;
+        QHash<QString, QTcpSocket*> shards;
+
+        //the query waiting for the lookups of its users
+        QByteArray                  resolving;
+        QString                     resolvingShard;
+        int                         pendingLookups = 0;
+        bool                        isLocated = false;
+        bool                        isLookupFailed = false;
+        qint64                      senderID = -1;
+        QJsonObject                 identities;
+
+        //members of a chat being created who live on other shards,
+        //their shards list the chat once it is created
+        QVector<qint64>             remoteMembers;
+        QString                     chatName;
+
+        QVector<Part>               parts;
+        int                         pendingParts = 0;
+        QJsonObject                 response;
+        QString                     accessToken;
+    };
+
+    //with the secret set the first query on every connection to
+    //a shard is the hello of the router, its answer isnt forwarded
+    struct Upstream
+    {
+        QTcpSocket  *client;
+        QByteArray  in;
+        bool        isGreeted = false;
+    };
+
+    //connection of the router itself to a shard, for the internal
+    //methods. the shard answers them in order, one callback each
+    typedef std::function<void(const QJsonObject&)> Callback;
+    struct Control
+    {
+        QByteArray          in;
+        QQueue<Callback>    callbacks;
+    };
+
+    ServerConfig config;
+    QTcpServer *server;
+    ConsistentHashRing ring;
+    QHash<QString, QPair<QString, quint16>> shardAddresses;
+    QHash<QTcpSocket*, Client> clients;
+    QHash<QTcpSocket*, Upstream> upstreams;
+    QHash<QString, QTcpSocket*> controlSockets;
+    QHash<QTcpSocket*, Control> controls;
+
+    QByteArray hello(const QString &clientAddress) const;
+    QString route(const ApiParams &params) const;
+    QString userShard(const qint64 &userID) const;
+    QString tokenShard(const QString &token) const;
+    QString shardAt(const int &shardIndex) const;
+    QTcpSocket *upstream(QTcpSocket *clientSocket, const QString &shard);
+    void forwardNext(QTcpSocket *clientSocket);
+    void lookUp(QTcpSocket *clientSocket, const QString &shard, const QJsonObject &params);
+    void locate(QTcpSocket *clientSocket, const QString &username);
+    void forwardResolved(QTcpSocket *clientSocket);
+    QByteArray split(const QByteArray &frame, const ApiParams &params, const QString &shard, QVector<Part> &parts) const;
+    void sendParts(QTcpSocket *clientSocket, const QByteArray &response);
+    void mergeParts(QTcpSocket *clientSocket);
+    void addRemoteMemberships(QTcpSocket *clientSocket, const QByteArray &response);
+    void call(const QString &shard, const QString &method, QJsonObject params, const Callback &onReply);
+    void closeClient(QTcpSocket *clientSocket);
+};
+
+#endif // SHARDROUTER_H
@@ -1,23 +1,177 @@
 #include "tcpserver.h"
 #include "exceptions.h"
-
-QMap<QString, size_t> Server::tokens = QMap<QString, size_t>();
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+ServerConfig Server::config = ServerConfig();
+RateLimiter Server::ipLimiter = RateLimiter();
+RateLimiter Server::tokenLimiter = RateLimiter();
+SessionRegistry Server::sessions = SessionRegistry();
+QThreadPool *Server::authPool = nullptr;
+int Server::authJobsPending = 0;
+MessageCache Server::messageCache = MessageCache();
+ReplicationLog *Server::replicationLog = nullptr;
+ReplicationLeader *Server::replicationLeader = nullptr;
+ReplicationFollower *Server::replicationFollower = nullptr;
+ConsistentHashRing Server::shardRing = ConsistentHashRing();
+QString Server::shardName = QString();
+QHash<size_t, QString> Server::remoteUsernames = QHash<size_t, QString>();
+QHash<QString, size_t> Server::remoteUserIDs = QHash<QString, size_t>();
+MessageBus *Server::messageBus = nullptr;
+ChatActivity Server::chatActivity = ChatActivity();
+Server *Server::instance = nullptr;
+Metrics Server::metrics = Metrics();
+int Server::lastResponseError = 0;
+bool Server::isResponseDeferred = false;
+QHash<QString, size_t> Server::tokens = QHash<QString, size_t>();
+QHash<size_t, Server::AccessToken> Server::userTokens = QHash<size_t, Server::AccessToken>();
+TimerWheel *Server::tokenExpiry = nullptr;
 QMap<QString, size_t> Server::usernames = QMap<QString, size_t>();
 
-Server::Server(quint16 port)
+Server::Server(const ServerConfig &config)
 {
+    Server::instance = this;
+    Server::config = config;
+    if (!config.dataDir.isEmpty())
+    {
+        QDir().mkpath(config.dataDir);
+        if (!QDir::setCurrent(config.dataDir))
+            qDebug() << "Unable to use data directory" << config.dataDir;
+    }
+    Server::ipLimiter.setLimit(config.ipRate, config.ipBurst);
+    Server::tokenLimiter.setLimit(config.tokenRate, config.tokenBurst);
+    Server::messageCache.setMaxBytes(config.messageCacheSize);
+    Server::authPool = new QThreadPool(this);
+    Server::authPool->setMaxThreadCount(config.authThreads);
+
     this->server = new QTcpServer;
-    if (!this->server->listen(QHostAddress("192.168.50.19"), port))
+    this->server->setMaxPendingConnections(config.maxPendingConnections);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    this->server->setListenBacklogSize(config.listenBacklog);
+#endif
+    if (!this->server->listen(QHostAddress(config.host), config.port))
     {
-        qDebug() << "Unable to listen port" << port;
+        qDebug() << "Unable to listen port" << config.port;
         return;
     }
+#if QT_VERSION < QT_VERSION_CHECK(6, 3, 0) && defined(Q_OS_UNIX)
+    //calling listen again on a listening socket only updates its backlog
+    if (::listen(this->server->socketDescriptor(), config.listenBacklog) != 0)
+        qDebug() << "Unable to set listen backlog to" << config.listenBacklog;
+#endif
 
     connect(this->server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
 
+    //idle and half-open sockets are reaped by a timer wheel
+    //so every connection costs O(1) on accept and on activity
+    this->clock.start();
+    this->timeouts = new TimerWheel(config.timeoutTick,
+                                    qMax<qint64>(config.idleTimeout / qMax<qint64>(config.timeoutTick, 1), 1) + 1);
+    this->timeoutsTimer = new QTimer(this);
+    connect(this->timeoutsTimer, SIGNAL(timeout()), this, SLOT(slotCheckTimeouts()));
+    this->timeoutsTimer->start(config.timeoutTick);
+
+    Server::registerApiMethods();
+
+    if (config.shards.size() > static_cast<int>(ConsistentHashRing::maxShards))
+        qDebug() << "At most" << ConsistentHashRing::maxShards << "shards are supported, running unsharded";
+    else if (config.shardIndex >= 0 && config.shardIndex < config.shards.size())
+    {
+        Server::shardRing = ConsistentHashRing(config.shardVirtualNodes);
+        for (const QString &i: config.shards)
+            Server::shardRing.addNode(i.trimmed());
+        Server::shardName = config.shards[config.shardIndex].trimmed();
+        qDebug() << "Running as shard" << Server::shardName;
+    }
+
+    if (config.replicationRole != "standalone")
+    {
+        QDir().mkdir("dbase");
+        Server::replicationLog = new ReplicationLog(this);
+        if (!Server::replicationLog->open("dbase/replication.log"))
+            return;
+    }
+
+    //four levels of 64 one second slots cover 194 days of ttl
+    delete Server::tokenExpiry;
+    Server::tokenExpiry = new TimerWheel(config.tokenExpiryTick, 64, 4, QDateTime::currentMSecsSinceEpoch());
+    this->tokenExpiryTimer = new QTimer(this);
+    connect(this->tokenExpiryTimer, SIGNAL(timeout()), this, SLOT(slotExpireTokens()));
+    //on followers tokens expire when the leader says so
+    if (!Server::isFollower())
+        this->tokenExpiryTimer->start(config.tokenExpiryTick);
+
     Server::loadTokensMap();
     Server::loadUsernamesMap();
 
+    //member ids of the events mean the same users on the peers only
+    //if the ids are global, on shards, or the peers replicate one storage
+    if (config.busPort != 0 && Server::shardName.isEmpty() && config.replicationRole == "standalone")
+        qDebug() << "Message bus needs shards or replicas, standalone user ids are local to the node";
+    else if (config.busPort != 0)
+    {
+        Server::messageBus = new MessageBus(config.busPeers, config.busSecret, config.busFlushInterval, this);
+        Server::messageBus->listen(QHostAddress(config.busHost), config.busPort);
+        connect(Server::messageBus, SIGNAL(delivered(QString, QJsonArray, QByteArray)),
+                this, SLOT(slotBusEvent(QString, QJsonArray, QByteArray)));
+    }
+
+    Tracer::configure(config.traceSampleRate, config.traceBufferSize);
+
+    if (!config.capturePath.isEmpty())
+    {
+        this->capture = new TrafficCapture([](const QString &token)
+        {
+            auto userID = Server::tokens.constFind(token);
+            if (userID == Server::tokens.constEnd())
+                return QString();
+            try
+            {
+                return Server::getUsernameByID(userID.value());
+            }
+            catch (const UserNotFoundException &e)
+            {
+                return QString();
+            }
+        });
+        this->capture->open(config.capturePath);
+    }
+
+    this->admin = new AdminServer(this);
+    if (config.adminPort != 0 && this->admin->listen(QHostAddress(config.adminHost), config.adminPort))
+    {
+        this->admin->addRoute("/metrics", "text/plain; version=0.0.4", [this]()
+        {
+            return this->metricsText();
+        });
+        this->admin->addRoute("/trace", "application/json", []()
+        {
+            return Tracer::chromeTrace();
+        });
+    }
+
+    if (config.replicationRole == "leader")
+    {
+        Server::replicationLeader = new ReplicationLeader(Server::replicationLog,
+                                                          config.replicationSecret,
+                                                          config.replicationHeartbeat,
+                                                          this);
+        Server::replicationLeader->listen(QHostAddress(config.replicationHost), config.replicationPort);
+    }
+    else if (Server::isFollower())
+    {
+        Server::replicationFollower = new ReplicationFollower(Server::replicationLog,
+                                                              config.leaderHost,
+                                                              config.leaderPort,
+                                                              config.replicationSecret,
+                                                              config.replicationHeartbeat,
+                                                              &Server::applyReplicated,
+                                                              this);
+        Server::replicationFollower->start();
+    }
+
     //qDebug() << Server::usernames;
 
     qDebug() << "Server started";
@@ -26,28 +180,48 @@ Server::Server(quint16 port)
 Server::~Server()
 {
     this->server->deleteLater();
+    delete this->timeouts;
+    delete this->capture;
 }
 
 void Server::loadTokensMap()
 {
     if (!QDir("dbase/access_tokens").exists())
         return;
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
     size_t sz = QDir("dbase/access_tokens").count() - 2;
     for (size_t i = 0; i < sz; ++i)
     {
-        QFile file(QStringLiteral("dbase/access_tokens/%1").arg(i));
+        AccountedFile file(QStringLiteral("dbase/access_tokens/%1").arg(i));
         if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
         {
             qDebug() << "Unable to open tokens file for reading";
             return;
         }
+        QHash<size_t, QString> expired;
         while (!file.atEnd())
         {
-            QString line = file.readLine();
-            QStringList pairOfValues = line.split(' ');
-            Server::tokens.insert(pairOfValues[1].left(pairOfValues[1].length() - 1), pairOfValues[0].toUInt());
+            QStringList values = QString(file.readLine()).trimmed().split(' ');
+            if (values.size() < 2)
+                continue;
+            //tokens written before expiry existed get a full ttl
+            qint64 expiresAt = values.size() > 2 ? values[2].toLongLong() : now + Server::config.tokenTTL;
+            if (expiresAt <= now)
+                expired.insert(values[0].toULongLong(), QString());
+            else
+                Server::setAccessToken(values[0].toULongLong(), values[1], expiresAt);
         }
         file.close();
+
+        //followers dont write anything the leader didnt, the leader
+        //drops the expired lines and replicates it
+        if (!expired.isEmpty() && !Server::isFollower() && Server::writeTokenLines(i, expired))
+        {
+            QJsonArray userIDs;
+            for (auto j = expired.constBegin(); j != expired.constEnd(); ++j)
+                userIDs.append(static_cast<double>(j.key()));
+            Server::replicate({{"op", "token.expire"}, {"user_ids", userIDs}});
+        }
     }
 }
 
@@ -58,7 +232,7 @@ void Server::loadUsernamesMap()
     size_t sz = QDir("dbase/userlogindata").count() - 2;
     for (size_t i = 0; i < sz; ++i)
     {
-        QFile file(QStringLiteral("dbase/userlogindata/%1").arg(i));
+        AccountedFile file(QStringLiteral("dbase/userlogindata/%1").arg(i));
         if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
         {
             qDebug() << "Unable to open tokens file for reading";
@@ -68,7 +242,7 @@ void Server::loadUsernamesMap()
         {
             QString line = file.readLine();
             QStringList values = line.split(' ');
-            Server::usernames.insert(values[1], values[0].toUInt());
+            Server::usernames.insert(values[1], values[0].toULongLong());
         }
         file.close();
     }
@@ -76,367 +250,334 @@ void Server::loadUsernamesMap()
 
 void Server::slotNewConnection()
 {
-    QTcpSocket *clientSocket = this->server->nextPendingConnection();
-    connect(clientSocket, SIGNAL(readyRead()), this, SLOT(slotReadClient()));
-    connect(clientSocket, SIGNAL(disconnected()), clientSocket, SLOT(deleteLater()));
-}
-
-void Server::slotReadClient()
-{
-    const quint16 maxDataSize = 2048;
-    QTcpSocket *clientSocket = static_cast<QTcpSocket*>(sender());
-    if (clientSocket->bytesAvailable() > maxDataSize)
+    while (this->server->hasPendingConnections())
     {
-        clientSocket->write("Query is too big");
-        return;
+        QTcpSocket *clientSocket = this->server->nextPendingConnection();
+        QString peerAddress = clientSocket->peerAddress().toString();
+
+        //the router opens a connection per client, so its address may
+        //go over the cap. with the secret set a connection over it gets
+        //its first query to say it is one of the router
+        const bool isOverLimit = this->connectionsCount(peerAddress) >= Server::config.maxConnectionsPerIP;
+        if (this->connections.size() >= Server::config.maxConnections ||
+            (isOverLimit && Server::config.shardSecret.isEmpty()))
+        {
+            qDebug() << "Connection limit reached, dropping connection from" << peerAddress
+                     << "open connections:" << this->connections.size();
+            clientSocket->abort();
+            clientSocket->deleteLater();
+            continue;
+        }
+
+        Connection connection;
+        connection.id = ++this->lastConnectionID;
+        connection.peerAddress = peerAddress;
+        connection.isOverLimit = isOverLimit;
+        connection.out.reserve(Server::outputBufferSize);
+        this->connections.insert(clientSocket, connection);
+        this->socketsByID.insert(connection.id, clientSocket);
+        ++this->connectionsPerIP[peerAddress];
+        this->timeouts->schedule(connection.id, Server::config.readTimeout);
+
+        connect(clientSocket, SIGNAL(readyRead()), this, SLOT(slotReadClient()));
+        connect(clientSocket, SIGNAL(disconnected()), this, SLOT(slotClientDisconnected()));
     }
-    QByteArray data = clientSocket->readAll();
-    QString reply = Server::parseQuery(data);
-    clientSocket->write(reply.toUtf8());
 }
 
-QJsonObject Server::generateErrorJson(const apiErrorCode &err)
+void Server::slotClientDisconnected()
 {
-    QJsonObject error;
-    error.insert("error_code", err);
-    error.insert("error_desc", Server::apiErrorCodeDesc(err));
-    return error;
+    QTcpSocket *clientSocket = static_cast<QTcpSocket*>(sender());
+    this->forgetConnection(clientSocket);
+    clientSocket->deleteLater();
 }
 
-QJsonObject Server::callApiMethod(const QString &method, const QJsonObject &params)
+void Server::forgetConnection(QTcpSocket *clientSocket)
 {
-    //first of all methods that dont need access tokens
-    //for other queries access token is essential
-    //qDebug() << method << params;
-    if (method == "access_token.change")
-    {
-        size_t userID;
-        try
-        {
-            userID = Server::getIDFromUsername(params["username"].toString());
-        }
-        catch (const UserNotFoundException &e)
-        {
-            return Server::generateErrorJson(USER_VALIDATION_FAILURE);
-        }
-
-        //qDebug() << userID;
-        apiErrorCode apiErr = NULL_ERROR;
+    auto connection = this->connections.find(clientSocket);
+    if (connection == this->connections.end())
+        return;
 
-        if (!params.contains("username"))
-            apiErr = NO_USER_ID;
+    //the response of a deferred query is never written
+    if (connection->isDeferred && this->capture != nullptr)
+        this->capture->record(connection->id, connection->deferredQuery, -1);
 
-        else if (!params.contains("password"))
-            apiErr = NO_USER_PASSWORD;
+    this->timeouts->cancel(connection->id);
+    Server::sessions.remove(clientSocket);
+    this->socketsByID.remove(connection->id);
+    if (--this->connectionsPerIP[connection->peerAddress] <= 0)
+        this->connectionsPerIP.remove(connection->peerAddress);
+    this->connections.erase(connection);
+}
 
-        else if (!Server::validateUser(userID,
-                                       params["password"].toString()))
-            apiErr = USER_VALIDATION_FAILURE;
+void Server::closeConnection(QTcpSocket *clientSocket)
+{
+    this->forgetConnection(clientSocket);
+    clientSocket->disconnect(this);
+    clientSocket->abort();
+    clientSocket->deleteLater();
+}
 
-        if (apiErr != apiErrorCode::NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
+void Server::slotBusEvent(const QString &topic, const QJsonArray &members, const QByteArray &frame)
+{
+    Q_UNUSED(topic);
+    //the members of a chat on another shard live on any of the
+    //shards, each one pushes the event to its own users only
+    QJsonArray ownMembers;
+    for (QJsonValue i: members)
+        if (Server::ownsUser(i.toDouble()))
+            ownMembers.append(i);
+    Server::sessions.publish(ownMembers, frame);
+}
 
-        QJsonObject response = Server::updAccessToken(userID);
-        return response;
-    }
-    else if (method == "user.create")
+void Server::slotCheckTimeouts()
+{
+    for (quint64 id: this->timeouts->advance(this->clock.elapsed()))
     {
-        apiErrorCode apiErr = NULL_ERROR;
-        if (!params.contains("username"))
-            apiErr = NO_USERNAME;
-        else if (!params.contains("password"))
-            apiErr = NO_USER_PASSWORD;
-        else
-        {
-            try
-            {
-                Server::getIDFromUsername(params["username"].toString());
-                apiErr = USER_ALREADY_EXISTS;
-            }
-            catch (const UserNotFoundException &e)
-            {
-                //qDebug() << "User doesnt exist";
-            }
-        }
-
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
-
-        return Server::createUser(params["username"].toString(),
-                                  params["password"].toString());
+        QTcpSocket *clientSocket = this->socketsByID.value(id, nullptr);
+        if (clientSocket == nullptr)
+            continue;
+        //qDebug() << "Closing timed out connection" << id;
+        this->closeConnection(clientSocket);
     }
+}
+
+int Server::connectionsCount() const
+{
+    return this->connections.size();
+}
 
-    if (!params.contains("access_token"))
-        return Server::generateErrorJson(apiErrorCode::NO_ACCESS_TOKEN);
+int Server::connectionsCount(const QString &peerAddress) const
+{
+    return this->connectionsPerIP.value(peerAddress, 0);
+}
 
-    if (params["access_token"].toString().length() != Server::accessTokenLen)
-        return Server::generateErrorJson(apiErrorCode::TOKEN_VALIDATION_FAILURE);
+void Server::slotReadClient()
+{
+    this->readQueries(static_cast<QTcpSocket*>(sender()));
+}
 
-    size_t senderID;
-    try
-    {
-        senderID = Server::getIDFromAccessToken(params["access_token"].toString());
-    }
-    catch (const UserNotFoundException &e)
-    {
-        return Server::generateErrorJson(apiErrorCode::TOKEN_VALIDATION_FAILURE);
-    }
+void Server::readQueries(QTcpSocket *clientSocket)
+{
+    //the input waits in the socket while a query is deferred
+    auto connection = this->connections.find(clientSocket);
+    if (connection == this->connections.end() || connection->isDeferred)
+        return;
 
-    if (method == "user.getmyinfo")
+    //the output buffer was reserved, so it keeps its capacity
+    QByteArray &out = connection->out;
+    out.resize(0);
+
+    //a connection may carry several queries, each one is
+    //handled as soon as its closing brace has been received
+    QByteArray &in = connection->in;
+    const bool wasPartial = !in.isEmpty();
+    bool isHandled = false;
+    in += clientSocket->readAll();
+    int frameLength;
+    while ((frameLength = RequestDecoder::frameLength(in)) > 0 &&
+           frameLength <= Server::config.maxQuerySize)
     {
-        try
+        if (connection->isFirstQuery)
         {
-            QJsonObject response;
-            response.insert("username", QJsonValue::fromVariant(Server::getUsernameByID(senderID)));
-            response.insert("chat_membership", QJsonValue::fromVariant(Server::getChatMembership(senderID)));
-            if (params.contains("current_chat_id") && params["current_chat_id"].toInt() >= 0
-             && params.contains("messages_num") && params["messages_num"].toInt() > 0)
+            connection->isFirstQuery = false;
+            const bool isHello = this->greetRouter(connection.value(), in.left(frameLength), out);
+            if (connection->isOverLimit && !connection->isFromRouter)
             {
-                QJsonObject newestMessages;
-                newestMessages.insert("chat_id", params["current_chat_id"].toInt());
-                newestMessages.insert("messages", QJsonValue::fromVariant(Server::getNewestMessages(params["current_chat_id"].toInt(),
-                                                                          senderID,
-                                                                          params["messages_num"].toInt())));
-                response.insert("newest_messages", newestMessages);
+                qDebug() << "Connection limit reached, dropping connection from" << connection->peerAddress;
+                this->closeConnection(clientSocket);
+                return;
             }
-            if (params.contains("message_to_send"))
+            if (isHello)
             {
-                Server::sendMessage(
-                            params["message_to_send"].toObject()["chat_id"].toInt(),
-                            params["message_to_send"].toObject()["text"].toString(),
-                            senderID);
-                //qDebug() << "sent message";
+                in.remove(0, frameLength);
+                isHandled = true;
+                continue;
             }
-            return response;
         }
-        catch (const UserNotFoundException &e)
-        {
-            return Server::generateErrorJson(USER_DOES_NOT_EXIST);
-        }
-    }
-    else if (method == "chat.get")
-    {
-        apiErrorCode apiErr = NULL_ERROR;
-
-        if (!params.contains("chat_id"))
-            apiErr = NO_CHAT_ID;
-
-        else if (params["chat_id"].toInt() < 0)
-            apiErr = INCORRECT_VALUE;
 
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
-
-        size_t chatID = params["chat_id"].toInt();
+        //rejecting flooding addresses before even decoding the query,
+        //the queries of the router control connection come from the
+        //shards and are limited by the users they are made for
+        const qint64 startedNs = this->clock.nsecsElapsed();
+        qint64 retryAfterMs;
+        Server::isResponseDeferred = false;
+        if (!connection->isControl && !Server::ipLimiter.tryAcquire(connection->peerAddress, retryAfterMs))
+            Server::writeResponse(out, Server::generateRateLimitJson(retryAfterMs));
+        else
+            Server::parseQuery(in.left(frameLength), out, clientSocket, connection->peerAddress);
+        isHandled = true;
 
-        QJsonObject response;
-        try
+        //deferred queries are recorded with their code once it is known
+        if (Server::isResponseDeferred)
         {
-            response = Server::getChatInfo(chatID, senderID);
-        }
-        catch (const ChatIsNotVisibleException &e)
-        {
-            return Server::generateErrorJson(apiErrorCode::CHAT_IS_NOT_VISIBLE);
+            connection->isDeferred = true;
+            connection->deferredQuery = in.left(frameLength);
+            connection->deferredAtNs = startedNs;
+            in.remove(0, frameLength);
+            break;
         }
 
-        return response;
+        if (this->capture != nullptr)
+            this->capture->record(connection->id, in.left(frameLength), Server::lastResponseError);
+        in.remove(0, frameLength);
     }
 
-    else if (method == "chat.set.property")
+    if (frameLength > Server::config.maxQuerySize ||
+        (frameLength < 0 && in.size() > Server::config.maxQuerySize))
     {
-        apiErrorCode apiErr = apiErrorCode::NULL_ERROR;
-        QString property, value;
-        QJsonObject chatInfo;
-        size_t chatID;
-
-        if (!params.contains("chat_id"))
-            apiErr = NO_CHAT_ID;
-
-        else if (params["chat_id"].toInt() < 0)
-            apiErr = INCORRECT_VALUE;
+        in.clear();
+        Server::writeError(out, QUERY_IS_TOO_BIG);
+        clientSocket->write(out);
+        clientSocket->disconnectFromHost();
+        return;
+    }
 
-        else if (!params.contains("property"))
-            apiErr = NO_CHAT_PROPERTY;
+    if (frameLength < 0 && in.trimmed().isEmpty())
+        in.clear();
 
-        else if (!params.contains("value"))
-            apiErr = NO_CHAT_PROPERTY_VALUE;
-        else
-        {
-            property = params["property"].toString();
-            value = params["value"].toString();
-            chatID = params["chat_id"].toInt();
-            chatInfo = Server::getChatInfo(chatID, senderID);
-            if (!chatInfo.contains(property) ||
-                property == "admin" ||
-                property == "members" ||
-                property == "total_messages")
-                apiErr = INCORRECT_VALUE;
-        }
+    //the read timeout runs from the first byte of a query, so trickling
+    //it byte by byte doesnt hold the connection and its buffer. more
+    //bytes of the same query dont move the deadline
+    if (connection->isDeferred)
+        this->timeouts->schedule(connection->id, Server::config.idleTimeout);
+    else if (!in.isEmpty())
+    {
+        if (isHandled || !wasPartial)
+            this->timeouts->schedule(connection->id, Server::config.readTimeout);
+    }
+    else if (isHandled)
+        this->timeouts->schedule(connection->id, Server::config.idleTimeout);
 
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
+    clientSocket->write(out);
+}
 
-        chatInfo[property] = value;
-        QJsonObject response;
-        try
-        {
-            response = Server::setChatInfo(chatID, senderID, chatInfo);
-        }
-        catch (const UserIsNotAdminException &e)
-        {
-            return Server::generateErrorJson(apiErrorCode::USER_NOT_ADMIN);
-        }
+QJsonObject Server::generateErrorJson(const apiErrorCode &err)
+{
+    QJsonObject error;
+    error.insert("error_code", err);
+    error.insert("error_desc", Server::apiErrorCodeDesc(err));
+    return error;
+}
 
-        return response;
-    }
+QJsonObject Server::generateRateLimitJson(const qint64 &retryAfterMs)
+{
+    QJsonObject error = Server::generateErrorJson(RATE_LIMIT_EXCEEDED);
+    error.insert("retry_after", retryAfterMs);
+    return error;
+}
 
-    else if (method == "chat.addmember")
+const QByteArray &Server::encodedError(const apiErrorCode &err)
+{
+    static QHash<int, QByteArray> encodedErrors;
+    auto encoded = encodedErrors.constFind(err);
+    if (encoded == encodedErrors.constEnd())
     {
-        apiErrorCode apiErr = apiErrorCode::NULL_ERROR;
-
-        if (!params.contains("chat_id"))
-            apiErr = NO_CHAT_ID;
-
-        else if (!params.contains("user_id"))
-            apiErr = NO_USER_ID;
+        QByteArray fragment;
+        JsonWriter::write(fragment, Server::generateErrorJson(err));
+        fragment += '\n';
+        encoded = encodedErrors.insert(err, fragment);
+    }
+    return encoded.value();
+}
 
-        else if (params["user_id"].toInt() < 0 ||
-                 params["chat_id"].toInt() < 0)
-            apiErr = INCORRECT_VALUE;
+void Server::writeError(QByteArray &out, const apiErrorCode &err)
+{
+    Server::lastResponseError = err;
+    out += Server::encodedError(err);
+}
 
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
+void Server::writeResponse(QByteArray &out, const QJsonObject &response)
+{
+    Tracer::Span span("serialize", "response");
+    RequestProfile::Scope stage(RequestProfile::SERIALIZE);
+    //every response is one line, so several of them
+    //and pushed events can share a connection
+    if (response.size() == 2 && response.contains("error_desc"))
+        return Server::writeError(out, static_cast<apiErrorCode>(response["error_code"].toInt()));
+
+    Server::lastResponseError = response["error_code"].toInt();
+    JsonWriter::write(out, response);
+    out += '\n';
+}
 
-        try
-        {
-            QJsonObject response = Server::addMemberInChatByUser(
-                        params["chat_id"].toInt(),
-                        senderID,
-                        params["user_id"].toInt());
-            QJsonObject serverMessageResponse = Server::sendMessage(
-                        params["chat_id"].toInt(),
-                        QStringLiteral("%1 was invited in chat").arg(Server::getUsernameByID(params["user_id"].toInt())),
-                        -1,
-                        true);
-            return response;
-        }
-        catch (const UserIsNotMemberOfChatException &e)
-        {
-            return Server::generateErrorJson(USER_NOT_IN_CHAT);
-        }
-        catch (const UserNotFoundException &e)
+void Server::callApiMethod(const ApiParams &params, QByteArray &out, QTcpSocket *clientSocket, const QString &peerAddress)
+{
+    auto apiMethod = Server::apiMethods.find(params.method);
+    if (apiMethod == Server::apiMethods.end())
+        return Server::writeError(out, apiErrorCode::UNKNOWN_ERROR);
+
+    if (!apiMethod->readOnly && Server::isFollower())
+        return Server::writeError(out, apiErrorCode::READ_ONLY_REPLICA);
+
+    ApiRequest request;
+    request.params = params;
+    request.senderID = -1;
+    request.isFromRouter = false;
+    request.socket = clientSocket;
+    request.peerAddress = peerAddress;
+
+    //the token is only looked up in memory before the admission control,
+    //the limits are charged to the user it belongs to, so made up
+    //tokens cant get fresh buckets. without a valid token they are
+    //charged to the address
+    bool isTokenValid = false;
+
+    //the router looks the users of a query up on their own shards,
+    //a sender of another shard comes without a token this shard knows
+    if (params.has(ApiParams::SHARD_SECRET))
+    {
+        if (!PeerAuth::matches(Server::config.shardSecret, params.shardSecret))
+            return Server::writeError(out, apiErrorCode::ACCESS_DENIED);
+        request.isFromRouter = true;
+        for (const auto &i: params.identities)
+            Server::rememberUser(i.first, i.second);
+        if (params.has(ApiParams::SENDER_ID) && params.senderID >= 0)
         {
-            return Server::generateErrorJson(USER_DOES_NOT_EXIST);
+            request.senderID = params.senderID;
+            isTokenValid = true;
         }
     }
 
-    else if (method == "chat.kickmember")
+    if (!isTokenValid && params.has(ApiParams::ACCESS_TOKEN) && params.accessToken.length() == Server::accessTokenLen)
     {
-        apiErrorCode apiErr = apiErrorCode::NULL_ERROR;
-
-        if (!params.contains("chat_id"))
-            apiErr = NO_CHAT_ID;
-
-        else if (!params.contains("user_id"))
-            apiErr = NO_USER_ID;
-
-        else if (params["user_id"].toInt() < 0 ||
-                 params["chat_id"].toInt() < 0)
-            apiErr = INCORRECT_VALUE;
-
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
-
         try
         {
-            QJsonObject response = Server::kickMember(
-                        params["chat_id"].toInt(),
-                        senderID,
-                        params["user_id"].toInt());
-            QJsonObject serverMessageResponse = Server::sendMessage(
-                        params["chat_id"].toInt(),
-                        QStringLiteral("%1 was kicked from chat").arg(Server::getUsernameByID(params["user_id"].toInt())),
-                        -1,
-                        true);
-            return response;
+            Tracer::Span span("token lookup", "request");
+            RequestProfile::Scope stage(RequestProfile::AUTH);
+            request.senderID = Server::getIDFromAccessToken(params.accessToken);
+            isTokenValid = true;
         }
-        catch (const UserIsNotAdminException &e)
+        catch (const UserNotFoundException &e)
         {
-            return Server::generateErrorJson(USER_NOT_ADMIN);
         }
     }
+    request.limiterKey = isTokenValid ? QStringLiteral("user:%1").arg(request.senderID) : request.peerAddress;
 
-    else if (method == "chat.sendmessage")
-    {
-        apiErrorCode apiErr = apiErrorCode::NULL_ERROR;
-        if (!params.contains("chat_id"))
-            apiErr = NO_CHAT_ID;
-        else if (params["chat_id"].toInt() < 0)
-            apiErr = INCORRECT_VALUE;
-        else if (!params.contains("text"))
-            apiErr = NO_MESSAGE_TEXT;
-
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
-
-        return Server::sendMessage(params["chat_id"].toInt(),
-                params["text"].toString(),
-                senderID);
-    }
+    qint64 retryAfterMs;
+    if (!apiMethod->limiter.tryAcquire(request.limiterKey, retryAfterMs))
+        return Server::writeResponse(out, Server::generateRateLimitJson(retryAfterMs));
 
-    else if (method == "chat.getlastmessages")
+    if (apiMethod->needsToken)
     {
-        apiErrorCode apiErr = NULL_ERROR;
+        if (!params.has(ApiParams::ACCESS_TOKEN))
+            return Server::writeError(out, apiErrorCode::NO_ACCESS_TOKEN);
 
-        if (!params.contains("chat_id"))
-            apiErr = NO_CHAT_ID;
-        else if (!params.contains("num"))
-            apiErr = NO_LAST_MESSAGES_NUM;
+        if (!Server::tokenLimiter.tryAcquire(request.limiterKey, retryAfterMs))
+            return Server::writeResponse(out, Server::generateRateLimitJson(retryAfterMs));
 
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
+        if (!isTokenValid)
+            return Server::writeError(out, apiErrorCode::TOKEN_VALIDATION_FAILURE);
 
-        try
-        {
-            QJsonObject response;
-
-            response.insert("chat_id",
-                            params["chat_id"].toInt());
-
-            response.insert("newest_messages",
-                            Server::getNewestMessages(
-                                params["chat_id"].toInt(),
-                                senderID,
-                                params["num"].toInt())
-                           );
-            return response;
-        }
-        catch (const UserIsNotMemberOfChatException &e)
-        {
-            return Server::generateErrorJson(USER_NOT_IN_CHAT);
-        }
+        Server::renewAccessToken(request.senderID);
     }
 
-    else if (method == "chat.create")
-    {
-        apiErrorCode apiErr = apiErrorCode::NULL_ERROR;
-        if (!params.contains("is_visible"))
-            apiErr = NO_CHAT_VISIBILITY;
-        else if (!params.contains("name"))
-            apiErr = NO_CHAT_NAME;
-        else if (!params.contains("members"))
-            apiErr = NO_CHAT_MEMBERS;
-        if (apiErr != NULL_ERROR)
-            return Server::generateErrorJson(apiErr);
-
-        QJsonArray members = params["members"].toArray();
-        return Server::createChat(params["name"].toString(),
-                                  members,
-                                  senderID,
-                                  params["is_visible"].toBool());
-    }
+    apiErrorCode apiErr = Server::validateParams(params, apiMethod->schema);
+    if (apiErr != NULL_ERROR)
+        return Server::writeError(out, apiErr);
 
-    return Server::generateErrorJson(apiErrorCode::UNKNOWN_ERROR);
+    Tracer::Span span("handler", "request");
+    RequestProfile::Scope stage(RequestProfile::HANDLER);
+    apiMethod->handler(request, out);
 }
 
 QString Server::apiErrorCodeDesc(const apiErrorCode &err)
@@ -519,6 +660,26 @@ QString Server::apiErrorCodeDesc(const apiErrorCode &err)
         return "Unknown error";
         break;
 
+   case RATE_LIMIT_EXCEEDED:
+        return "Too many requests, retry after retry_after milliseconds";
+        break;
+
+   case QUERY_IS_TOO_BIG:
+        return "Query is too big";
+        break;
+
+   case SERVER_IS_BUSY:
+        return "Server is busy, try again later";
+        break;
+
+   case READ_ONLY_REPLICA:
+        return "This server is a read-only replica, send the query to the leader";
+        break;
+
+   case ACCESS_DENIED:
+        return "This method is available to the server administrators only";
+        break;
+
     default:
         return "No error description";
         break;
@@ -526,32 +687,171 @@ QString Server::apiErrorCodeDesc(const apiErrorCode &err)
 }
 
 bool Server::validateUser(const size_t &userID, const QString &userPassword)
+{
+    //blocking, api methods verify passwords on the auth pool
+    QString passwordHash = Server::getPasswordHash(userID);
+    return !passwordHash.isEmpty() && PasswordHasher::verify(userPassword, passwordHash);
+}
+
+QString Server::getPasswordHash(const size_t &userID)
 {
     const QString pathToData = "dbase/userlogindata";
-    const size_t fileID = userID / Server::userLoginDataBlockSize;
+    const size_t fileID = Server::userSlot(userID) / Server::userLoginDataBlockSize;
 
-    if (fileID >= static_cast<size_t>(QDir(pathToData).count() - 2))
-        return false;
+    AccountedFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(fileID));
+    if (!dataFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "Unable to open dbase/userlogindata for reading";
+        return QString();
+    }
+    while (!dataFile.atEnd())
+    {
+        QString line = dataFile.readLine();
+        QStringList list = line.split(' ');
+        if (list.size() == 3 && list[0].toULongLong() == userID)
+            return list[2].trimmed();
+    }
+    dataFile.close();
+    return QString();
+}
 
-    QFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(fileID));
+void Server::updPasswordHash(const size_t &userID, const QString &passwordHash)
+{
+    const size_t fileID = Server::userSlot(userID) / Server::userLoginDataBlockSize;
+    AccountedFile dataFile(QStringLiteral("dbase/userlogindata/%1").arg(fileID));
     if (!dataFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open dbase/userlogindata for reading";
-        return false;
+        return;
     }
+    QStringList lines;
     while (!dataFile.atEnd())
     {
         QString line = dataFile.readLine();
         QStringList list = line.split(' ');
-        if (list[0].toUInt() == userID && list[2] == userPassword + "\n")
-            return true;
+        if (list.size() == 3 && list[0].toULongLong() == userID)
+            line = QStringLiteral("%1 %2 %3\n").arg(list[0]).arg(list[1]).arg(passwordHash);
+        lines.append(line);
+    }
+    dataFile.close();
+
+    if (!dataFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Unable to open dbase/userlogindata for writing";
+        return;
     }
+    QTextStream out(&dataFile);
+    for (const QString &i: lines)
+        out << i;
     dataFile.close();
-    return false;
+
+    Server::replicate({{"op",            "user.password"},
+                       {"user_id",       static_cast<double>(userID)},
+                       {"password_hash", passwordHash}});
+}
+
+bool Server::runAuthJob(const std::function<QVariant()>&              job,
+                        const std::function<void(const QVariant&)>&   onDone)
+{
+    if (Server::authJobsPending >= Server::config.authQueueSize)
+        return false;
+
+    ++Server::authJobsPending;
+    Server::authPool->start([job, onDone]()
+    {
+        QVariant result = job();
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [onDone, result]()
+        {
+            --Server::authJobsPending;
+            onDone(result);
+        }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+bool Server::greetRouter(Connection &connection, const QByteArray &query, QByteArray &out)
+{
+    ApiParams params;
+    if (!RequestDecoder::decode(query, params) || params.method != QLatin1String("internal.hello"))
+        return false;
+
+    if (!params.has(ApiParams::SHARD_SECRET) || !PeerAuth::matches(Server::config.shardSecret, params.shardSecret))
+    {
+        Server::writeError(out, ACCESS_DENIED);
+        return true;
+    }
+
+    //a client of the router is held to the cap of its own address
+    if (params.has(ApiParams::CLIENT_ADDRESS) && !params.clientAddress.isEmpty())
+    {
+        if (this->connectionsCount(params.clientAddress) >= Server::config.maxConnectionsPerIP)
+        {
+            Server::writeError(out, SERVER_IS_BUSY);
+            return true;
+        }
+        if (--this->connectionsPerIP[connection.peerAddress] <= 0)
+            this->connectionsPerIP.remove(connection.peerAddress);
+        connection.peerAddress = params.clientAddress;
+        ++this->connectionsPerIP[connection.peerAddress];
+    }
+    else
+        connection.isControl = true;
+
+    connection.isFromRouter = true;
+    connection.isOverLimit = false;
+    Server::writeError(out, NULL_ERROR);
+    return true;
+}
+
+void Server::deferResponse()
+{
+    Server::isResponseDeferred = true;
 }
 
-QJsonObject Server::createUser(const QString &username, const QString &password)
+void Server::writeDeferred(const QPointer<QTcpSocket> &socket, const QString &method, const QByteArray &response)
 {
+    //the connection may have been closed while the job was running
+    if (socket.isNull() || socket->state() != QAbstractSocket::ConnectedState)
+        return;
+    Server::instance->resumeConnection(socket, method, response);
+}
+
+void Server::resumeConnection(QTcpSocket *clientSocket, const QString &method, const QByteArray &response)
+{
+    auto connection = this->connections.find(clientSocket);
+    if (connection == this->connections.end() || !connection->isDeferred)
+        return;
+
+    //measured from the query to its response, hashing included
+    Server::metrics.recordRequest(method, Server::lastResponseError,
+                                  (this->clock.nsecsElapsed() - connection->deferredAtNs) / 1000);
+    if (this->capture != nullptr)
+        this->capture->record(connection->id, connection->deferredQuery, Server::lastResponseError);
+
+    connection->isDeferred = false;
+    connection->deferredQuery.clear();
+    clientSocket->write(response);
+
+    //the queries which came meanwhile
+    this->readQueries(clientSocket);
+}
+
+void Server::rehashPassword(const size_t &userID, const QString &password)
+{
+    const int iterations = Server::config.passwordHashIterations;
+    Server::runAuthJob([password, iterations]()
+    {
+        return QVariant(PasswordHasher::hash(password, iterations));
+    },
+    [userID](const QVariant &passwordHash)
+    {
+        Server::updPasswordHash(userID, passwordHash.toString());
+    });
+}
+
+QJsonObject Server::createUser(const QString &username, const QString &passwordHash, const bool &issueToken)
+{
+    Tracer::Span span("createUser", "storage");
     auto countNumberOfLines = [](QFile &file) //though its reference function doesnt write anything to file
     {
         if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
@@ -569,6 +869,7 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
         return counter;
     };
     QString newUserAccessToken;
+    size_t newUserID = Server::slotUserID(0);
 
     //filling userlogindata
     QString pathToData = "dbase/userlogindata";
@@ -577,21 +878,20 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
     size_t totalFiles = QDir(pathToData).count() - 2;
     if (totalFiles == 0)
     {
-        QFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles));
+        AccountedFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles));
         if (!dataFile.open(QIODevice::WriteOnly))
         {
             qDebug() << "Unable to open dbase/userlogindata for writing";
             return Server::generateErrorJson(UNKNOWN_ERROR);
         }
-        Server::usernames.insert(username, 0);
-        newUserAccessToken = Server::updAccessToken(0)["new_token"].toString();
+        Server::usernames.insert(username, newUserID);
         QTextStream out(&dataFile);
-        out << QStringLiteral("0 %1 %2").arg(username).arg(password) << Qt::endl;
+        out << QStringLiteral("%1 %2 %3").arg(newUserID).arg(username).arg(passwordHash) << Qt::endl;
         dataFile.close();
     }
     else
     {
-        QFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles - 1));
+        AccountedFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles - 1));
         size_t lines = countNumberOfLines(dataFile);
         if (lines == Server::userLoginDataBlockSize)
         {
@@ -603,11 +903,10 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
             qDebug() << "Unable to open dataFile for appending";
             return Server::generateErrorJson(UNKNOWN_ERROR);
         }
-        size_t newUserID = (totalFiles - 1) * Server::userLoginDataBlockSize + lines;
-        newUserAccessToken = Server::updAccessToken(newUserID)["new_token"].toString();
+        newUserID = Server::slotUserID((totalFiles - 1) * Server::userLoginDataBlockSize + lines);
         Server::usernames.insert(username, newUserID);
         QTextStream out(&dataFile);
-        out << QStringLiteral("%1 %2 %3").arg(newUserID).arg(username).arg(password) << Qt::endl;
+        out << QStringLiteral("%1 %2 %3").arg(newUserID).arg(username).arg(passwordHash) << Qt::endl;
         dataFile.close();
     }
 
@@ -619,14 +918,14 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
     totalFiles = QDir(pathToData).count() - 2;
     if (totalFiles == 0)
     {
-        QFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles));
+        AccountedFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles));
         if (!dataFile.open(QIODevice::WriteOnly))
         {
             qDebug() << "Unable to open dbase/userchatmembership for writing";
             return Server::generateErrorJson(UNKNOWN_ERROR);
         }
         QJsonObject userMembership;
-        userMembership.insert("id", QJsonValue::fromVariant(0));
+        userMembership.insert("id", QJsonValue::fromVariant(newUserID));
         userMembership.insert("chats", QJsonValue::fromVariant(QJsonArray()));
         QJsonArray arr;
         arr.append(userMembership);
@@ -637,7 +936,7 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
     }
     else
     {
-        QFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles - 1));
+        AccountedFile dataFile(QStringLiteral("%1/%2").arg(pathToData).arg(totalFiles - 1));
         if (!dataFile.open(QIODevice::ReadOnly | QIODevice::Text))
         {
             qDebug() << "Unable to open userchatmembership file for reading";
@@ -656,7 +955,6 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
                 qDebug() << "Unable to open dbase/userchatmembership for writing";
                 return Server::generateErrorJson(UNKNOWN_ERROR);
             }
-            size_t newUserID = (totalFiles - 1) * Server::userLoginDataBlockSize + lines;
             QJsonObject userMembership;
             userMembership.insert("id", QJsonValue::fromVariant(newUserID));
             userMembership.insert("chats", QJsonValue::fromVariant(QJsonArray()));
@@ -669,7 +967,6 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
         }
         else
         {
-            size_t newUserID = (totalFiles - 1) * Server::userLoginDataBlockSize + lines;
             QJsonObject userMembership;
             userMembership.insert("id", QJsonValue::fromVariant(newUserID));
             userMembership.insert("chats", QJsonValue::fromVariant(QJsonArray()));
@@ -685,6 +982,14 @@ QJsonObject Server::createUser(const QString &username, const QString &password)
         }
     }
 
+    //the token is issued only after the user is in the log,
+    //so followers never get a token of a user they dont have
+    Server::replicate({{"op",            "user.create"},
+                       {"username",      username},
+                       {"password_hash", passwordHash}});
+    if (issueToken)
+        newUserAccessToken = Server::updAccessToken(newUserID)["new_token"].toString();
+
     //in response we store only access token
     QJsonObject response;
     response.insert("new_token", QJsonValue::fromVariant(newUserAccessToken));
@@ -710,82 +1015,162 @@ size_t Server::getIDFromUsername(const QString &username)
 QString Server::generateAccessToken()
 {
     const QString alphabet = "QWERTYUIOPASDFGHJKLZXCVBNMqwertyuiopasdfghjklzxcvbnm.-0123456789_=/|";
-    QString ans;
-    for (size_t i = 0; i < Server::accessTokenLen; ++i)
+    //on a shard the token starts with the index of the shard,
+    //the router finds the user of a token by it
+    QString ans = Server::shardName.isEmpty() ? QString() : ConsistentHashRing::tokenPrefix(Server::config.shardIndex);
+    while (ans.length() < int(Server::accessTokenLen))
         ans += alphabet[QRandomGenerator::global()->generate() % alphabet.length()];
     return ans;
 }
 
 QJsonObject Server::updAccessToken(const size_t &senderID)
 {
-    QDir().mkdir("dbase");
-    QDir().mkdir("dbase/access_tokens");
-
-    size_t numOfFiles = QDir("dbase/access_tokens").count() - 2;
+    Tracer::Span span("updAccessToken", "storage");
     QString newAccessToken = Server::generateAccessToken();
+    qint64 expiresAt = QDateTime::currentSecsSinceEpoch() + Server::config.tokenTTL;
+    if (!Server::storeAccessToken(senderID, newAccessToken, expiresAt))
+        return Server::generateErrorJson(UNKNOWN_ERROR);
 
-    size_t fileID = senderID / Server::accessTokenDataBlockSize;
-    QFile tokenFile(QStringLiteral("dbase/access_tokens/%1").arg(fileID));
+    QJsonObject response;
+    response.insert("new_token", newAccessToken);
+    //qDebug() << response;
+    return response;
+}
 
-    if (fileID == numOfFiles) //condition to create new block
+bool Server::writeTokenLines(const size_t &fileID, QHash<size_t, QString> changes)
+{
+    //every change is a new line for the user or an empty
+    //string to remove its token, the file is rewritten once
+    AccountedFile tokenFile(QStringLiteral("dbase/access_tokens/%1").arg(fileID));
+    QStringList lines;
+    if (tokenFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
-        if (!tokenFile.open(QIODevice::WriteOnly))
+        while (!tokenFile.atEnd())
         {
-            qDebug() << "Unable to open token file for writing";
-            return Server::generateErrorJson(UNKNOWN_ERROR);
+            QString line = QString(tokenFile.readLine()).trimmed();
+            if (line.isEmpty())
+                continue;
+            auto change = changes.find(line.section(' ', 0, 0).toULongLong());
+            if (change == changes.end())
+            {
+                lines.append(line);
+                continue;
+            }
+            if (!change->isEmpty())
+                lines.append(change.value());
+            changes.erase(change);
         }
-        tokenFile.write(QStringLiteral("%1 %2\n").arg(senderID).arg(newAccessToken).toUtf8());
-        Server::tokens[newAccessToken] = senderID;
-        QJsonObject response;
-        response.insert("new_token", newAccessToken);
         tokenFile.close();
-        return response;
     }
 
-    QStringList updatedTokens;
-    if (!tokenFile.open(QIODevice::ReadOnly | QIODevice::Text))
-    {
-        qDebug() << "Unable to open token file for reading";
-        return Server::generateErrorJson(UNKNOWN_ERROR);
-    }
-    bool updated = false;
-    while (!tokenFile.atEnd())
-    {
-        QString line = tokenFile.readLine();
-        QStringList pairOfValues = line.split(' ');
-        if (pairOfValues[0].toUInt() == senderID)
-        {
-            updated = true;
-            Server::tokens.remove(pairOfValues[1].left(pairOfValues[1].length() - 1));
-            Server::tokens.insert(newAccessToken, senderID);
-            pairOfValues[1] = newAccessToken + "\n";
-        }
-        updatedTokens.append(pairOfValues[0] + " " + pairOfValues[1]);
-    }
-    tokenFile.close();
-
-    if (!updated)
-        updatedTokens.append(QStringLiteral("%1 %2\n").arg(senderID).arg(newAccessToken));
+    for (const QString &i: changes)
+        if (!i.isEmpty())
+            lines.append(i);
 
     if (!tokenFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
     {
         qDebug() << "Unable to open token file for writing";
-        return Server::generateErrorJson(UNKNOWN_ERROR);
+        return false;
     }
     QTextStream out(&tokenFile);
-    for (QString i: updatedTokens)
-        out << i;
-    QJsonObject response;
-    response.insert("new_token", newAccessToken);
+    for (const QString &i: lines)
+        out << i << '\n';
     tokenFile.close();
-    //qDebug() << response;
-    return response;
+    return true;
+}
+
+void Server::setAccessToken(const size_t &userID, const QString &token, const qint64 &expiresAt)
+{
+    auto oldToken = Server::userTokens.find(userID);
+    if (oldToken != Server::userTokens.end())
+        Server::tokens.remove(oldToken->token);
+
+    AccessToken accessToken;
+    accessToken.token = token;
+    accessToken.persistedExpiry = expiresAt;
+    Server::userTokens.insert(userID, accessToken);
+    Server::tokens.insert(token, userID);
+    Server::tokenExpiry->schedule(userID, expiresAt * 1000 - QDateTime::currentMSecsSinceEpoch());
+}
+
+bool Server::storeAccessToken(const size_t &userID, const QString &token, const qint64 &expiresAt)
+{
+    QDir().mkdir("dbase");
+    QDir().mkdir("dbase/access_tokens");
+
+    if (!Server::writeTokenLines(Server::userSlot(userID) / Server::accessTokenDataBlockSize,
+                                 {{userID, QStringLiteral("%1 %2 %3").arg(userID).arg(token).arg(expiresAt)}}))
+        return false;
+
+    Server::setAccessToken(userID, token, expiresAt);
+    Server::replicate({{"op",         "token.set"},
+                       {"user_id",    static_cast<double>(userID)},
+                       {"token",      token},
+                       {"expires_at", static_cast<double>(expiresAt)}});
+    return true;
+}
+
+void Server::renewAccessToken(const size_t &userID)
+{
+    Tracer::Span span("renewAccessToken", "storage");
+    //followers dont write anything the leader didnt, renewals included
+    if (!Server::config.tokenSlidingRenewal || Server::isFollower())
+        return;
+
+    auto accessToken = Server::userTokens.find(userID);
+    if (accessToken == Server::userTokens.end())
+        return;
+
+    const qint64 expiresAt = QDateTime::currentSecsSinceEpoch() + Server::config.tokenTTL;
+    Server::tokenExpiry->schedule(userID, expiresAt * 1000 - QDateTime::currentMSecsSinceEpoch());
+
+    //persisting every renewal would rewrite the tokens file on
+    //every query, so the stored expiry moves once per half of ttl
+    if (expiresAt - accessToken->persistedExpiry > Server::config.tokenTTL / 2)
+        Server::storeAccessToken(userID, accessToken->token, expiresAt);
+}
+
+void Server::slotExpireTokens()
+{
+    Server::expireTokens(Server::tokenExpiry->advance(QDateTime::currentMSecsSinceEpoch()));
+}
+
+void Server::expireTokens(const QVector<quint64> &userIDs)
+{
+    QHash<size_t, QHash<size_t, QString>> removedTokens;
+    QJsonArray expiredIDs;
+    for (quint64 userID: userIDs)
+    {
+        auto accessToken = Server::userTokens.find(userID);
+        if (accessToken == Server::userTokens.end())
+            continue;
+        Server::tokens.remove(accessToken->token);
+        Server::userTokens.erase(accessToken);
+        removedTokens[Server::userSlot(userID) / Server::accessTokenDataBlockSize].insert(userID, QString());
+        expiredIDs.append(static_cast<double>(userID));
+    }
+
+    //one rewrite per tokens file, no matter how many of its tokens expired
+    for (auto i = removedTokens.constBegin(); i != removedTokens.constEnd(); ++i)
+        Server::writeTokenLines(i.key(), i.value());
+
+    if (!expiredIDs.isEmpty())
+        Server::replicate({{"op", "token.expire"}, {"user_ids", expiredIDs}});
 }
 
 QString Server::getUsernameByID(const size_t &userID)
 {
-    const size_t fileID = userID / Server::userLoginDataBlockSize;
-    QFile dataFile(QStringLiteral("dbase/userlogindata/%1").arg(fileID));
+    Tracer::Span span("getUsernameByID", "storage");
+    if (!Server::ownsUser(userID))
+    {
+        auto username = Server::remoteUsernames.constFind(userID);
+        if (username == Server::remoteUsernames.constEnd())
+            throw UserNotFoundException();
+        return username.value();
+    }
+
+    const size_t fileID = Server::userSlot(userID) / Server::userLoginDataBlockSize;
+    AccountedFile dataFile(QStringLiteral("dbase/userlogindata/%1").arg(fileID));
     if (!dataFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open dbase/userlogindata for reading";
@@ -795,21 +1180,270 @@ QString Server::getUsernameByID(const size_t &userID)
     {
         QString line = dataFile.readLine();
         QStringList userDataValues = line.split(' ');
-        if (static_cast<size_t>(userDataValues[0].toInt()) == userID)
+        if (userDataValues.size() > 1 && userDataValues[0].toULongLong() == userID)
             return userDataValues[1];
     }
     dataFile.close();
     throw UserNotFoundException();
 }
 
-QString Server::parseQuery(const QString &query)
+void Server::parseQuery(const QByteArray &query, QByteArray &out, QTcpSocket *clientSocket, const QString &peerAddress)
+{
+    QElapsedTimer timer;
+    timer.start();
+    Server::lastResponseError = NULL_ERROR;
+    Tracer::Request trace("request");
+    RequestProfile::begin();
+
+    ApiParams params;
+    bool decoded;
+    {
+        Tracer::Span span("decode", "request");
+        RequestProfile::Scope stage(RequestProfile::DECODE);
+        decoded = RequestDecoder::decode(query, params);
+    }
+    trace.setArg(params.method);
+    if (!decoded)
+        Server::writeError(out, UNKNOWN_ERROR);
+    else
+    {
+        Tracer::Span span("dispatch", "request");
+        Server::callApiMethod(params, out, clientSocket, peerAddress);
+    }
+
+    //deferred logins are measured when their response is written
+    if (Server::isResponseDeferred)
+    {
+        RequestProfile::end();
+        return;
+    }
+
+    //unknown names share one label, so clients cant grow the table
+    const quint64 durationUs = timer.nsecsElapsed() / 1000;
+    const QString method = Server::apiMethods.contains(params.method) ? params.method : "unknown";
+    Server::metrics.recordRequest(method, Server::lastResponseError, durationUs);
+
+    if (Server::config.slowRequestThreshold > 0 && durationUs >= quint64(Server::config.slowRequestThreshold) * 1000)
+    {
+        QString chat;
+        if (params.has(ApiParams::CHAT_ID))
+            chat = QStringLiteral(" chat_id=%1").arg(params.chatID);
+        else if (params.has(ApiParams::CURRENT_CHAT_ID))
+            chat = QStringLiteral(" chat_id=%1").arg(params.currentChatID);
+        qDebug().noquote() << QStringLiteral("Slow request %1%2 error=%3 total=%4ms %5")
+                              .arg(method).arg(chat).arg(Server::lastResponseError)
+                              .arg(durationUs / 1000.0, 0, 'f', 3).arg(RequestProfile::describe());
+    }
+    RequestProfile::end();
+}
+
+QByteArray Server::metricsText() const
+{
+    QByteArray out;
+    Server::metrics.writeRequests(out);
+
+    Metrics::writeCounter(out, "chatapp_storage_file_opens_total", "Storage files opened", AccountedFile::opens());
+    Metrics::writeCounter(out, "chatapp_storage_read_bytes_total", "Bytes read from the storage files", AccountedFile::bytesRead());
+    Metrics::writeCounter(out, "chatapp_storage_written_bytes_total", "Bytes written to the storage files", AccountedFile::bytesWritten());
+
+    Metrics::writeCounter(out, "chatapp_message_cache_hits_total", "Message blocks served from the cache", Server::messageCache.hits());
+    Metrics::writeCounter(out, "chatapp_message_cache_misses_total", "Message blocks loaded from the storage", Server::messageCache.misses());
+    Metrics::writeGauge(out, "chatapp_message_cache_bytes", "Memory used by the cached messages", Server::messageCache.bytes());
+
+    Metrics::writeGauge(out, "chatapp_connections", "Open client connections", this->connectionsCount());
+    Metrics::writeGauge(out, "chatapp_sessions", "Connections subscribed to events", Server::sessions.sessionsCount());
+    Metrics::writeGauge(out, "chatapp_online_users", "Users with at least one session", Server::sessions.usersCount());
+    Metrics::writeGauge(out, "chatapp_auth_jobs_pending", "Password hashing jobs queued or running", Server::authJobsPending);
+    Metrics::writeGauge(out, "chatapp_access_tokens", "Access tokens in memory", Server::tokens.size());
+    Metrics::writeGauge(out, "chatapp_users", "Registered users", Server::usernames.size());
+
+    if (Server::messageBus != nullptr)
+    {
+        Metrics::writeCounter(out, "chatapp_bus_published_total", "Events published to the peers", Server::messageBus->publishedCount());
+        Metrics::writeCounter(out, "chatapp_bus_batches_total", "Batches sent to the peers", Server::messageBus->batchesCount());
+        Metrics::writeGauge(out, "chatapp_bus_links", "Connected peer links", Server::messageBus->linksCount());
+    }
+    if (Server::replicationLog != nullptr)
+        Metrics::writeGauge(out, "chatapp_replication_last_seq", "Last entry of the replication log", Server::replicationLog->lastSeq());
+    return out;
+}
+
+QJsonObject Server::statsJson() const
+{
+    QJsonObject stats;
+    stats.insert("uptime", static_cast<double>(this->clock.elapsed() / 1000));
+#if defined(Q_OS_LINUX)
+    //second field of statm is the resident set in pages
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly))
+    {
+        const QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1)
+            stats.insert("rss_bytes", static_cast<double>(fields[1].toLongLong() * sysconf(_SC_PAGESIZE)));
+    }
+#endif
+
+    stats.insert("tokens",          Server::tokens.size());
+    stats.insert("usernames",       Server::usernames.size());
+    stats.insert("connections",     this->connections.size());
+    stats.insert("sessions",        Server::sessions.sessionsCount());
+    stats.insert("online_users",    Server::sessions.usersCount());
+
+    QJsonObject cache;
+    cache.insert("bytes",       Server::messageCache.bytes());
+    cache.insert("max_bytes",   Server::config.messageCacheSize);
+    cache.insert("hits",        static_cast<double>(Server::messageCache.hits()));
+    cache.insert("misses",      static_cast<double>(Server::messageCache.misses()));
+    stats.insert("message_cache", cache);
+
+    //bytes waiting in the sockets and partial queries not yet framed
+    qint64 writeBacklog = 0, readBacklog = 0;
+    for (auto i = this->connections.constBegin(); i != this->connections.constEnd(); ++i)
+    {
+        writeBacklog += i.key()->bytesToWrite();
+        readBacklog += i->in.size();
+    }
+    QJsonObject queues;
+    queues.insert("auth_jobs_pending",      Server::authJobsPending);
+    queues.insert("auth_queue_size",        Server::config.authQueueSize);
+    queues.insert("write_backlog_bytes",    static_cast<double>(writeBacklog));
+    queues.insert("read_backlog_bytes",     static_cast<double>(readBacklog));
+    stats.insert("queues", queues);
+
+    QJsonArray hotChats;
+    for (const QPair<size_t, double> &i: Server::chatActivity.hottest(10, QDateTime::currentMSecsSinceEpoch()))
+        hotChats.append(QJsonObject({{"chat_id",             static_cast<double>(i.first)},
+                                     {"messages_per_minute", qRound(i.second * 100) / 100.0}}));
+    stats.insert("active_chats", Server::chatActivity.chatsCount());
+    stats.insert("hot_chats", hotChats);
+    return stats;
+}
+
+bool Server::ownsShardKey(const QByteArray &key)
+{
+    return Server::shardName.isEmpty() || Server::shardRing.node(key) == Server::shardName;
+}
+
+size_t Server::userSlot(const size_t &userID)
+{
+    return Server::shardName.isEmpty() ? userID : ConsistentHashRing::userSlot(userID);
+}
+
+size_t Server::slotUserID(const size_t &slot)
+{
+    return Server::shardName.isEmpty() ? slot : ConsistentHashRing::shardUserID(slot, Server::config.shardIndex);
+}
+
+bool Server::ownsUser(const size_t &userID)
+{
+    return Server::shardName.isEmpty() || ConsistentHashRing::userShardIndex(userID) == Server::config.shardIndex;
+}
+
+void Server::rememberUser(const size_t &userID, const QString &username)
+{
+    if (Server::ownsUser(userID) || username.isEmpty())
+        return;
+    Server::remoteUsernames.insert(userID, username);
+    Server::remoteUserIDs.insert(username, userID);
+}
+
+QJsonObject Server::remoteIdentities(const QJsonArray &userIDs)
+{
+    //written into the log entries that refer to users of the other
+    //shards, so followers resolve them without the router
+    QJsonObject identities;
+    for (QJsonValue i: userIDs)
+    {
+        const size_t userID = i.toDouble();
+        if (!Server::ownsUser(userID) && Server::remoteUsernames.contains(userID))
+            identities.insert(QString::number(userID), Server::remoteUsernames[userID]);
+    }
+    return identities;
+}
+
+bool Server::isFollower()
+{
+    return Server::config.replicationRole == "follower";
+}
+
+void Server::replicate(const QJsonObject &entry)
+{
+    //followers only log the entries they receive from the leader
+    if (Server::replicationLog != nullptr && !Server::isFollower())
+        Server::replicationLog->append(entry);
+}
+
+bool Server::applyReplicated(const QJsonObject &entry)
 {
-    QJsonObject jsonObj = QJsonDocument::fromJson(query.toUtf8()).object();
-    QString method = jsonObj["method"].toString();
-    QJsonObject jsonParams = jsonObj["params"].toObject();
+    //the storage functions check the same conditions they checked
+    //on the leader, any error means the storages have diverged
+    const QString op = entry["op"].toString();
+    const size_t chatID = entry["chat_id"].toDouble(),
+                 senderID = entry["sender_id"].toDouble(),
+                 userID = entry["user_id"].toDouble();
+    QJsonObject identities = entry["identities"].toObject();
+    for (auto i = identities.constBegin(); i != identities.constEnd(); ++i)
+        Server::rememberUser(i.key().toULongLong(), i.value().toString());
+
+    QJsonObject result = Server::generateErrorJson(NULL_ERROR);
+    try
+    {
+        if (op == "user.create")
+            result = Server::createUser(entry["username"].toString(), entry["password_hash"].toString(), false);
+        else if (op == "user.password")
+            Server::updPasswordHash(userID, entry["password_hash"].toString());
+        else if (op == "token.set")
+        {
+            if (!Server::storeAccessToken(userID, entry["token"].toString(), entry["expires_at"].toDouble()))
+                return false;
+        }
+        else if (op == "token.expire")
+        {
+            QVector<quint64> userIDs;
+            for (QJsonValue i: entry["user_ids"].toArray())
+                userIDs.append(i.toDouble());
+            Server::expireTokens(userIDs);
+        }
+        else if (op == "chat.create")
+            result = Server::createChat(entry["name"].toString(),
+                                        entry["members"].toArray(),
+                                        entry["admin"].toDouble(),
+                                        entry["is_visible"].toBool());
+        else if (op == "chat.set")
+            result = Server::setChatInfo(chatID, senderID, entry["info"].toObject());
+        else if (op == "chat.addmember")
+            result = Server::addMemberInChatByUser(chatID, senderID, userID);
+        else if (op == "chat.kickmember")
+            result = Server::kickMember(chatID, senderID, userID);
+        else if (op == "membership.add")
+            Server::addChatMembership(userID, chatID, entry["name"].toString());
+        else if (op == "message.send")
+        {
+            const bool isSystem = entry["is_system"].toBool();
+            result = Server::sendMessage(chatID,
+                                         entry["text"].toString(),
+                                         isSystem ? -1 : senderID,
+                                         isSystem,
+                                         entry["date"].toString());
+        }
+        else
+        {
+            qDebug() << "Unknown replication entry" << op;
+            return false;
+        }
+    }
+    catch (const QException &e)
+    {
+        qDebug() << "Replication entry" << op << "failed with an exception";
+        return false;
+    }
 
-    QJsonObject response = Server::callApiMethod(method, jsonParams);
-    return QJsonDocument(response).toJson();
+    if (result["error_code"].toInt() != NULL_ERROR)
+    {
+        qDebug() << "Replication entry" << op << "failed:" << result;
+        return false;
+    }
+    return true;
 }
 
 QJsonObject Server::createChat(const QString&             chatName,
@@ -817,15 +1451,22 @@ QJsonObject Server::createChat(const QString&             chatName,
                            const size_t&           adminID,
                            const bool&             isVisible)
 {
-    QDir().mkdir("chats");
-    size_t chatID = QDir("chats").count() - 2;
-    QDir("chats").mkdir(QString::number(chatID));
-
+    Tracer::Span span("createChat", "storage");
+    //members of the other shards are known from the router, a member
+    //listed twice or the admin listed as a member is added once
     QJsonArray membersIDs;
     try
     {
         for (QJsonValue i: membersNames)
-            membersIDs.append(QJsonValue::fromVariant(Server::getIDFromUsername(i.toString())));
+        {
+            auto remoteUserID = Server::remoteUserIDs.constFind(i.toString());
+            QJsonValue memberID = QJsonValue::fromVariant(
+                        Server::usernames.contains(i.toString()) || remoteUserID == Server::remoteUserIDs.constEnd()
+                        ? Server::getIDFromUsername(i.toString())
+                        : remoteUserID.value());
+            if (!membersIDs.contains(memberID) && memberID != QJsonValue::fromVariant(adminID))
+                membersIDs.append(memberID);
+        }
         membersIDs.append(QJsonValue::fromVariant(adminID));
     }
     catch (const UserNotFoundException &e)
@@ -833,6 +1474,23 @@ QJsonObject Server::createChat(const QString&             chatName,
         return Server::generateErrorJson(USER_DOES_NOT_EXIST);
     }
 
+    //the directory is created only for valid chats, so chat ids
+    //are the same on every replica applying the same entries
+    QDir().mkdir("chats");
+    size_t chatID = QDir("chats").count() - 2;
+
+    //shards skip the ids owned by the others, their chat
+    //directories are sparse and new ids follow the biggest one
+    if (!Server::shardName.isEmpty())
+    {
+        chatID = 0;
+        for (const QString &i: QDir("chats").entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+            chatID = qMax<size_t>(chatID, i.toULongLong() + 1);
+        while (!Server::ownsShardKey(ConsistentHashRing::chatKey(chatID)))
+            ++chatID;
+    }
+    QDir("chats").mkdir(QString::number(chatID));
+
     QJsonObject json;
     json.insert("name",             QJsonValue::fromVariant(chatName));
     json.insert("members",          QJsonValue::fromVariant(membersIDs));
@@ -841,16 +1499,39 @@ QJsonObject Server::createChat(const QString&             chatName,
     json.insert("total_messages",   QJsonValue::fromVariant(0));
 
     QJsonDocument jsonDoc(json);
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
     if (!infoFile.open(QFile::WriteOnly))
     {
         qDebug() << "Unable to open chat info file for reading";
         return Server::generateErrorJson(UNKNOWN_ERROR);
     }
     infoFile.write(jsonDoc.toJson());
+    infoFile.close();
 
-    for (QJsonValue i: membersIDs)
-        Server::addChatMembership(i.toInt(), chatID);
+    //the shards of the other members add the chat to their lists
+    //when the router tells them it was created
+    try
+    {
+        for (QJsonValue i: membersIDs)
+            if (Server::ownsUser(i.toDouble()))
+                Server::addChatMembership(i.toDouble(), chatID);
+    }
+    catch (const UserNotFoundException &e)
+    {
+        return Server::generateErrorJson(USER_DOES_NOT_EXIST);
+    }
+    catch (const UserIsAlreadyInChatException &e)
+    {
+        return Server::generateErrorJson(USER_ALREADY_IN_CHAT);
+    }
+
+    //chat ids and member ids are resolved the same way on followers
+    Server::replicate({{"op",         "chat.create"},
+                       {"name",       chatName},
+                       {"members",    membersNames},
+                       {"admin",      static_cast<double>(adminID)},
+                       {"is_visible", isVisible},
+                       {"identities", Server::remoteIdentities(membersIDs)}});
 
     QJsonObject response;
     response.insert("chat_id", QJsonValue::fromVariant(chatID));
@@ -860,8 +1541,10 @@ QJsonObject Server::createChat(const QString&             chatName,
 QJsonObject Server::sendMessage(const size_t&           chatID,
                                 const QString&          messageText,
                                 const size_t&           senderID,
-                                const bool&             isSystem)
+                                const bool&             isSystem,
+                                const QString&          date)
 {
+    Tracer::Span span("sendMessage", "storage");
     if (!isSystem && !Server::isMemberOfChat(senderID, chatID))
     {
         qDebug() << "Can't send message: user" << senderID << "is not member of chat" << chatID;
@@ -869,7 +1552,7 @@ QJsonObject Server::sendMessage(const size_t&           chatID,
     }
     //getting number of messages in total to find id of first message in
     //block and updating it
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
 
     if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
@@ -879,6 +1562,7 @@ QJsonObject Server::sendMessage(const size_t&           chatID,
 
     QJsonObject jsonObj = QJsonDocument::fromJson(QString(infoFile.readAll()).toUtf8()).object();
     infoFile.close();
+    QJsonArray members = jsonObj["members"].toArray();
 
     size_t totalMessages = jsonObj["total_messages"].toInt(),
            fileID = totalMessages / Server::messagesBlockSize;
@@ -896,7 +1580,7 @@ QJsonObject Server::sendMessage(const size_t&           chatID,
     infoFile.close();
 
     //putting a message into a file
-    QFile messagesFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(fileID));
+    AccountedFile messagesFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(fileID));
     if (!messagesFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         if (!messagesFile.open(QIODevice::WriteOnly))
@@ -912,7 +1596,8 @@ QJsonObject Server::sendMessage(const size_t&           chatID,
             return Server::generateErrorJson(UNKNOWN_ERROR);
         }
     }
-    QString formattedDateTime = QStringLiteral("%1 %2").arg(
+    //replicated messages keep the date they got on the leader
+    QString formattedDateTime = !date.isEmpty() ? date : QStringLiteral("%1 %2").arg(
                    QDate::currentDate().toString("dd.MM.yyyy")).arg(
                    QTime::currentTime().toString("hh:mm:ss"));
 
@@ -950,12 +1635,46 @@ QJsonObject Server::sendMessage(const size_t&           chatID,
     messagesFile.write(jsonDoc.toJson());
     messagesFile.close();
 
+    QByteArray encodedMessage;
+    JsonWriter::write(encodedMessage, jsonMessage);
+    Server::messageCache.append(chatID, fileID, encodedMessage);
+
+    QJsonObject entry;
+    entry.insert("op",        "message.send");
+    entry.insert("chat_id",   static_cast<double>(chatID));
+    entry.insert("text",      messageText);
+    entry.insert("is_system", isSystem);
+    entry.insert("date",      formattedDateTime);
+    if (!isSystem)
+    {
+        entry.insert("sender_id", static_cast<double>(senderID));
+        entry.insert("identities", Server::remoteIdentities({static_cast<double>(senderID)}));
+    }
+    Server::replicate(entry);
+
+    //the message is serialized once and the same buffer
+    //is pushed to every online member of the chat
+    QByteArray frame = "{\"event\":\"message.new\",\"chat_id\":";
+    frame += QByteArray::number(static_cast<qulonglong>(chatID));
+    frame += ",\"message\":";
+    frame += encodedMessage;
+    frame += "}\n";
+
+    //a follower on the bus gets the event of the leader through it,
+    //so its replay of the message pushes and publishes nothing
+    if (!Server::isFollower() || Server::messageBus == nullptr)
+        Server::sessions.publish(members, frame);
+    if (Server::messageBus != nullptr && !Server::isFollower())
+        Server::messageBus->publish(QStringLiteral("chat/%1").arg(chatID), members, frame);
+
+    Server::chatActivity.record(chatID, QDateTime::currentMSecsSinceEpoch());
     return Server::generateErrorJson(NULL_ERROR);
 }
 
 bool Server::isMemberOfChat(const size_t &userID, const size_t &chatID)
 {
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    Tracer::Span span("isMemberOfChat", "storage");
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
     if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open chat" << chatID << "info file for reading";
@@ -968,7 +1687,8 @@ bool Server::isMemberOfChat(const size_t &userID, const size_t &chatID)
 
 bool Server::isAdmin(const size_t &userID, const size_t &chatID)
 {
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    Tracer::Span span("isAdmin", "storage");
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
     if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open chat" << chatID << "info file for reading";
@@ -976,7 +1696,7 @@ bool Server::isAdmin(const size_t &userID, const size_t &chatID)
     }
     QJsonObject info = QJsonDocument::fromJson(infoFile.readAll()).object();
     infoFile.close();
-    return (static_cast<size_t>(info["admin"].toInt()) == userID);
+    return (static_cast<size_t>(info["admin"].toDouble()) == userID);
 }
 
 size_t Server::getTotalMessages(const size_t &chatID, const size_t &querySenderID)
@@ -984,7 +1704,7 @@ size_t Server::getTotalMessages(const size_t &chatID, const size_t &querySenderI
     if (!Server::isMemberOfChat(querySenderID, chatID))
         throw UserIsNotMemberOfChatException();
 
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
     if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open info file for reading";
@@ -997,11 +1717,12 @@ size_t Server::getTotalMessages(const size_t &chatID, const size_t &querySenderI
 
 QJsonObject Server::getMessageByID(const size_t &chatID, const size_t &messageID, const size_t &querySenderID)
 {
+    Tracer::Span span("getMessageByID", "storage");
     if (!Server::isMemberOfChat(querySenderID, chatID))
         throw UserIsNotMemberOfChatException();
 
     size_t firstMessageInBlockID = messageID - (messageID % Server::messagesBlockSize);
-    QFile messageFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(firstMessageInBlockID));
+    AccountedFile messageFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(firstMessageInBlockID));
     if (!messageFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open message file for reading";
@@ -1014,12 +1735,13 @@ QJsonObject Server::getMessageByID(const size_t &chatID, const size_t &messageID
 
 QJsonArray Server::getLastBlockOfMessages(const size_t &chatID, const size_t &querySenderID)
 {
+    Tracer::Span span("getLastBlockOfMessages", "storage");
     if (!Server::isMemberOfChat(querySenderID, chatID))
         throw UserIsNotMemberOfChatException();
 
     size_t totalMessages = getTotalMessages(chatID, querySenderID);
     size_t firstMessageInBlockID = (totalMessages - 1) - (totalMessages - 1) % Server::messagesBlockSize;
-    QFile messageFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(firstMessageInBlockID));
+    AccountedFile messageFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(firstMessageInBlockID));
     if (!messageFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open message file for reading";
@@ -1032,7 +1754,8 @@ QJsonArray Server::getLastBlockOfMessages(const size_t &chatID, const size_t &qu
 
 QJsonObject Server::getChatInfo(const size_t &chatID, const size_t &senderID)
 {
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    Tracer::Span span("getChatInfo", "storage");
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
     if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open chat" << chatID << "info file for reading";
@@ -1047,10 +1770,11 @@ QJsonObject Server::getChatInfo(const size_t &chatID, const size_t &senderID)
 
 QJsonObject Server::setChatInfo(const size_t &chatID, const size_t &senderID, const QJsonObject &chatInfo)
 {
+    Tracer::Span span("setChatInfo", "storage");
     if (!Server::isAdmin(senderID, chatID))
         throw UserIsNotAdminException();
 
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
 
     if (!infoFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
     {
@@ -1060,15 +1784,21 @@ QJsonObject Server::setChatInfo(const size_t &chatID, const size_t &senderID, co
 
     infoFile.write(QJsonDocument(chatInfo).toJson());
     infoFile.close();
+
+    Server::replicate({{"op",        "chat.set"},
+                       {"chat_id",   static_cast<double>(chatID)},
+                       {"sender_id", static_cast<double>(senderID)},
+                       {"info",      chatInfo}});
     return Server::generateErrorJson(NULL_ERROR);
 }
 
 QJsonObject Server::addMemberInChatByUser(const size_t &chatID, const size_t &senderID, const size_t &userToAddID)
 {
+    Tracer::Span span("addMemberInChatByUser", "storage");
     if (!Server::isMemberOfChat(senderID, chatID))
         throw UserIsNotMemberOfChatException();
 
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
     if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open chat" << chatID << "info file for reading";
@@ -1093,14 +1823,20 @@ QJsonObject Server::addMemberInChatByUser(const size_t &chatID, const size_t &se
 
     infoFile.write(QJsonDocument(chatInfo).toJson());
     infoFile.close();
+
+    Server::replicate({{"op",        "chat.addmember"},
+                       {"chat_id",   static_cast<double>(chatID)},
+                       {"sender_id", static_cast<double>(senderID)},
+                       {"user_id",   static_cast<double>(userToAddID)}});
     return Server::generateErrorJson(NULL_ERROR);
 }
 
 QJsonObject Server::kickMember(const size_t &chatID, const size_t &senderID, const size_t &userToKickID)
 {
+    Tracer::Span span("kickMember", "storage");
     if (!Server::isAdmin(senderID, chatID))
         throw UserIsNotAdminException();
-    QFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
     if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open chat" << chatID << "info file for reading";
@@ -1115,7 +1851,7 @@ QJsonObject Server::kickMember(const size_t &chatID, const size_t &senderID, con
         return Server::generateErrorJson(USER_NOT_IN_CHAT);
 
     for (int i = 0; i < members.size(); ++i)
-        if (static_cast<size_t>(members[i].toInt()) == userToKickID)
+        if (static_cast<size_t>(members[i].toDouble()) == userToKickID)
         {
             members.removeAt(i);
             break;
@@ -1131,11 +1867,17 @@ QJsonObject Server::kickMember(const size_t &chatID, const size_t &senderID, con
 
     infoFile.write(QJsonDocument(chatInfo).toJson());
     infoFile.close();
+
+    Server::replicate({{"op",        "chat.kickmember"},
+                       {"chat_id",   static_cast<double>(chatID)},
+                       {"sender_id", static_cast<double>(senderID)},
+                       {"user_id",   static_cast<double>(userToKickID)}});
     return Server::generateErrorJson(NULL_ERROR);
 }
 
-void Server::addChatMembership(const size_t &userID, const size_t &chatID)
+void Server::addChatMembership(const size_t &userID, const size_t &chatID, const QString &chatName)
 {
+    Tracer::Span span("addChatMembership", "storage");
     try
     {
         Server::getUsernameByID(userID);
@@ -1144,8 +1886,8 @@ void Server::addChatMembership(const size_t &userID, const size_t &chatID)
     {
         throw UserNotFoundException();
     }
-    size_t fileID = userID / Server::userChatMembershipBlockSize;
-    QFile membershipFile(QStringLiteral("dbase/userchatmembership/%1").arg(fileID));
+    size_t fileID = Server::userSlot(userID) / Server::userChatMembershipBlockSize;
+    AccountedFile membershipFile(QStringLiteral("dbase/userchatmembership/%1").arg(fileID));
     if (!membershipFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open membership file for reading";
@@ -1155,7 +1897,7 @@ void Server::addChatMembership(const size_t &userID, const size_t &chatID)
     QJsonObject jsonObj = QJsonDocument::fromJson(membershipFile.readAll()).object();
     membershipFile.close();
     QJsonArray memberships = jsonObj["membership"].toArray();
-    QJsonObject userData = memberships[userID % Server::userChatMembershipBlockSize].toObject();
+    QJsonObject userData = memberships[Server::userSlot(userID) % Server::userChatMembershipBlockSize].toObject();
     QJsonArray chats = userData["chats"].toArray();
 
     if (chats.contains(QJsonValue::fromVariant(chatID)))
@@ -1163,7 +1905,13 @@ void Server::addChatMembership(const size_t &userID, const size_t &chatID)
 
     chats.append(QJsonValue::fromVariant(chatID));
     userData["chats"] = chats;
-    memberships[userID % Server::userChatMembershipBlockSize] = userData;
+    if (!chatName.isEmpty())
+    {
+        QJsonObject names = userData["names"].toObject();
+        names.insert(QString::number(chatID), chatName);
+        userData["names"] = names;
+    }
+    memberships[Server::userSlot(userID) % Server::userChatMembershipBlockSize] = userData;
     jsonObj["membership"] = memberships;
 
     if (!membershipFile.open(QIODevice::WriteOnly))
@@ -1178,8 +1926,9 @@ void Server::addChatMembership(const size_t &userID, const size_t &chatID)
 
 void Server::deleteChatMembership(const size_t &userID, const size_t &chatID)
 {
-    size_t fileID = userID / Server::userChatMembershipBlockSize;
-    QFile membershipFile(QStringLiteral("dbase/userchatmembership/%1").arg(fileID));
+    Tracer::Span span("deleteChatMembership", "storage");
+    size_t fileID = Server::userSlot(userID) / Server::userChatMembershipBlockSize;
+    AccountedFile membershipFile(QStringLiteral("dbase/userchatmembership/%1").arg(fileID));
     if (!membershipFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open membership file for reading";
@@ -1189,7 +1938,7 @@ void Server::deleteChatMembership(const size_t &userID, const size_t &chatID)
     QJsonObject jsonObj = QJsonDocument::fromJson(membershipFile.readAll()).object();
     membershipFile.close();
     QJsonArray memberships = jsonObj["membership"].toArray();
-    QJsonObject userData = memberships[userID % Server::userChatMembershipBlockSize].toObject();
+    QJsonObject userData = memberships[Server::userSlot(userID) % Server::userChatMembershipBlockSize].toObject();
     QJsonArray chats = userData["chats"].toArray();
 
     if (!chats.contains(QJsonValue::fromVariant(chatID)))
@@ -1203,7 +1952,13 @@ void Server::deleteChatMembership(const size_t &userID, const size_t &chatID)
         }
 
     userData["chats"] = chats;
-    memberships[userID % Server::userChatMembershipBlockSize] = userData;
+    QJsonObject names = userData["names"].toObject();
+    if (names.contains(QString::number(chatID)))
+    {
+        names.remove(QString::number(chatID));
+        userData["names"] = names;
+    }
+    memberships[Server::userSlot(userID) % Server::userChatMembershipBlockSize] = userData;
     jsonObj["membership"] = memberships;
 
     if (!membershipFile.open(QIODevice::WriteOnly))
@@ -1218,8 +1973,9 @@ void Server::deleteChatMembership(const size_t &userID, const size_t &chatID)
 
 QJsonArray Server::getChatMembership(const size_t &userID)
 {
-    size_t fileID = userID / Server::userChatMembershipBlockSize;
-    QFile membershipFile(QStringLiteral("dbase/userchatmembership/%1").arg(fileID));
+    Tracer::Span span("getChatMembership", "storage");
+    size_t fileID = Server::userSlot(userID) / Server::userChatMembershipBlockSize;
+    AccountedFile membershipFile(QStringLiteral("dbase/userchatmembership/%1").arg(fileID));
     if (!membershipFile.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Unable to open membership file for reading";
@@ -1229,12 +1985,16 @@ QJsonArray Server::getChatMembership(const size_t &userID)
     QJsonObject jsonObj = QJsonDocument::fromJson(membershipFile.readAll()).object();
     membershipFile.close();
     QJsonArray memberships = jsonObj["membership"].toArray();
-    QJsonObject userData = memberships[userID % Server::userChatMembershipBlockSize].toObject();
+    QJsonObject userData = memberships[Server::userSlot(userID) % Server::userChatMembershipBlockSize].toObject();
     QJsonArray chats = userData["chats"].toArray();
+    QJsonObject names = userData["names"].toObject();
     QJsonArray response;
     for (QJsonValue i: chats)
     {
-        QJsonValue chatName = Server::getChatInfo(i.toInt(), userID)["name"];
+        //chats of the other shards have the name they were joined with
+        const size_t chatID = i.toDouble();
+        const QString key = QString::number(chatID);
+        QJsonValue chatName = names.contains(key) ? names.value(key) : Server::getChatInfo(chatID, userID).value("name");
 
         QJsonObject obj;
         obj.insert("id", i);
@@ -1244,30 +2004,92 @@ QJsonArray Server::getChatMembership(const size_t &userID)
     return response;
 }
 
-QJsonArray Server::getNewestMessages(const size_t &chatID,
-                                     const size_t &querySenderID,
-                                     int          messagesNum)
+QJsonObject Server::getMemberChatInfo(const size_t &chatID, const size_t &querySenderID)
 {
-    if (messagesNum <= 0)
+    Tracer::Span span("getMemberChatInfo", "storage");
+    AccountedFile infoFile(QStringLiteral("chats/%1/info.json").arg(chatID));
+    if (!infoFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "Unable to open chat" << chatID << "info file for reading";
+        throw UserIsNotMemberOfChatException();
+    }
+    QJsonObject info = QJsonDocument::fromJson(infoFile.readAll()).object();
+    infoFile.close();
+    if (!info["members"].toArray().contains(QJsonValue::fromVariant(querySenderID)))
+        throw UserIsNotMemberOfChatException();
+    return info;
+}
+
+QVector<QByteArray> Server::getMessagesBlock(const size_t &chatID, const size_t &blockID)
+{
+    Tracer::Span span("getMessagesBlock", "storage");
+    QVector<QByteArray> messages = Server::messageCache.block(chatID, blockID);
+    if (!messages.isEmpty())
+        return messages;
+
+    //block is parsed and encoded only once, later reads splice the bytes
+    AccountedFile messageFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(blockID));
+    if (!messageFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "Unable to open message file for reading";
         return {};
+    }
+    QJsonArray jsonArr = QJsonDocument::fromJson(messageFile.readAll()).object()["messages"].toArray();
+    messageFile.close();
 
-    if (!Server::isMemberOfChat(querySenderID, chatID))
-        throw UserIsNotMemberOfChatException();
+    messages.reserve(jsonArr.size());
+    for (QJsonValue i: jsonArr)
+    {
+        QByteArray encodedMessage;
+        JsonWriter::write(encodedMessage, i);
+        messages.append(encodedMessage);
+    }
+    Server::messageCache.insert(chatID, blockID, messages);
+    return messages;
+}
 
-    int fileNum = QDir(QStringLiteral("chats/%1").arg(chatID)).count() - 4;
-    QJsonArray response;
-    for (; messagesNum > 0 && fileNum >= 0; --fileNum)
+void Server::writeMessagesRange(QByteArray      &out,
+                                const size_t    &chatID,
+                                size_t          fromMessageID,
+                                size_t          toMessageID)
+{
+    out += '[';
+    bool first = true;
+    while (fromMessageID < toMessageID)
     {
-        QFile messageFile(QStringLiteral("chats/%1/%2.json").arg(chatID).arg(fileNum));
-        if (!messageFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        const size_t blockID = fromMessageID / Server::messagesBlockSize;
+        QVector<QByteArray> messages = Server::getMessagesBlock(chatID, blockID);
+        const size_t blockEnd = qMin<size_t>(toMessageID, (blockID + 1) * Server::messagesBlockSize);
+        for (size_t i = fromMessageID % Server::messagesBlockSize;
+             i < static_cast<size_t>(messages.size()) && blockID * Server::messagesBlockSize + i < blockEnd;
+             ++i)
         {
-            qDebug() << "Unable to open message file for reading";
-            return {};
+            if (!first)
+                out += ',';
+            first = false;
+            out += messages[i];
         }
-        QJsonArray messages = QJsonDocument::fromJson(messageFile.readAll()).object()["messages"].toArray();
-        messageFile.close();
-        for (int i = messages.size() - 1; messagesNum > 0 && i >= 0; --messagesNum, --i)
-            response.prepend(messages[i]);
+        fromMessageID = blockEnd;
     }
-    return response;
+    out += ']';
+}
+
+void Server::writeNewestMessages(QByteArray     &out,
+                                 const size_t   &chatID,
+                                 const size_t   &querySenderID,
+                                 int            messagesNum,
+                                 qint64         afterMessageID)
+{
+    Tracer::Span span("writeNewestMessages", "storage");
+    if (messagesNum <= 0)
+    {
+        out += "[]";
+        return;
+    }
+
+    size_t totalMessages = Server::getMemberChatInfo(chatID, querySenderID)["total_messages"].toInt();
+    size_t firstMessageID = totalMessages > static_cast<size_t>(messagesNum) ? totalMessages - messagesNum : 0;
+    if (afterMessageID >= 0)
+        firstMessageID = qMax<size_t>(firstMessageID, afterMessageID + 1);
+    Server::writeMessagesRange(out, chatID, firstMessageID, totalMessages);
 }
@@ -4,18 +4,43 @@
 #include <QtCore>
 #include <QTcpServer>
 #include <QTcpSocket>
+#include "serverconfig.h"
+#include "ratelimiter.h"
+#include "timerwheel.h"
+#include "sessionregistry.h"
+#include "jsonwriter.h"
+#include "messagecache.h"
+#include "requestdecoder.h"
+#include "passwordhasher.h"
+#include "peerauth.h"
+#include "replicationlog.h"
+#include "replicationleader.h"
+#include "replicationfollower.h"
+#include "consistenthashring.h"
+#include "messagebus.h"
+#include "metrics.h"
+#include "adminserver.h"
+#include "accountedfile.h"
+#include "tracer.h"
+#include "requestprofile.h"
+#include "trafficcapture.h"
+#include "chatactivity.h"
+#include <functional>
 
 class Server : public QObject
 {
     Q_OBJECT
+    //the benchmarks drive the storage functions without the
+    //qDebug output of the debug hooks below
+    friend class StorageBenchmark;
 public:
-    explicit Server(quint16 port);
+    explicit Server(const ServerConfig &config);
     virtual ~Server();
 
     static void debugCreateUser(const QString &username,
                                 const QString &password)
     {
-        Server::createUser(username, password);
+        Server::createUser(username, PasswordHasher::hash(password, Server::config.passwordHashIterations));
     }
 
     static void debugAddChatMembership(const size_t &userID,
@@ -101,13 +126,127 @@ public:
         qDebug() << Server::getIDFromAccessToken(accessToken);
     }
 
+    int connectionsCount() const;
+    int connectionsCount(const QString &peerAddress) const;
+
+    QByteArray metricsText() const;
+    QJsonObject statsJson() const;
+
 public slots:
     void slotNewConnection();
     void slotReadClient();
+    void slotClientDisconnected();
+    void slotCheckTimeouts();
+    void slotExpireTokens();
+    void slotBusEvent(const QString &topic, const QJsonArray &members, const QByteArray &frame);
 
 private:
+    struct Connection
+    {
+        quint64     id;
+        QString     peerAddress;
+        QByteArray  in;
+        QByteArray  out;
+
+        //a login or sign up waits for its hash job, the queries after
+        //it are held back until its response is written, so responses
+        //stay in the order of the queries
+        bool        isDeferred = false;
+        QByteArray  deferredQuery;
+        qint64      deferredAtNs = 0;
+
+        //the router greets the shard with internal.hello as the first
+        //query of its connections. the connection of a client then has
+        //the address of the client, the limits included, and the control
+        //connection of the router isnt limited by address at all. over
+        //the cap of its address a connection is kept only if it is one
+        bool        isFirstQuery = true;
+        bool        isOverLimit = false;
+        bool        isFromRouter = false;
+        bool        isControl = false;
+    };
+
+    //reserved once per connection, a reserved QByteArray keeps
+    //its capacity when it is resized to zero for the next queries
+    static const int outputBufferSize = 4096;
+
     QTcpServer *server;
-    static QMap<QString, size_t> tokens;
+    QTimer *timeoutsTimer;
+    QTimer *tokenExpiryTimer;
+    AdminServer *admin;
+    TrafficCapture *capture = nullptr;
+    QElapsedTimer clock;
+    TimerWheel *timeouts;
+    quint64 lastConnectionID = 0;
+    QHash<QTcpSocket*, Connection> connections;
+    QHash<quint64, QTcpSocket*> socketsByID;
+    QHash<QString, int> connectionsPerIP;
+
+    void closeConnection(QTcpSocket*);
+    void forgetConnection(QTcpSocket*);
+    void readQueries(QTcpSocket*);
+    bool greetRouter(Connection &connection, const QByteArray &query, QByteArray &out);
+    void resumeConnection(QTcpSocket*, const QString &method, const QByteArray &response);
+
+    static ServerConfig config;
+    static RateLimiter ipLimiter;
+    static RateLimiter tokenLimiter;
+    static SessionRegistry sessions;
+    static QThreadPool *authPool;
+    static int authJobsPending;
+    static MessageCache messageCache;
+    static ChatActivity chatActivity;
+
+    //the running server, for the api methods reporting its connections
+    static Server *instance;
+
+    //every storage mutation is appended to the log as a logical entry,
+    //followers replay them through the same storage functions
+    static ReplicationLog *replicationLog;
+    static ReplicationLeader *replicationLeader;
+    static ReplicationFollower *replicationFollower;
+    static bool isFollower();
+    static void replicate(const QJsonObject &entry);
+    static bool applyReplicated(const QJsonObject &entry);
+
+    //a shard creates only the chats and tokens it owns on the ring,
+    //so the router finds them without asking anyone
+    static ConsistentHashRing shardRing;
+    static QString shardName;
+    static bool ownsShardKey(const QByteArray &key);
+
+    //on shards user ids are global and the storage of a user
+    //is addressed by its slot, unsharded they are the same
+    static size_t userSlot(const size_t &userID);
+    static size_t slotUserID(const size_t &slot);
+    static bool ownsUser(const size_t &userID);
+
+    //users of the other shards met in the queries of the router,
+    //so their names resolve without asking their shards again
+    static QHash<size_t, QString> remoteUsernames;
+    static QHash<QString, size_t> remoteUserIDs;
+    static void rememberUser(const size_t &userID, const QString &username);
+    static QJsonObject remoteIdentities(const QJsonArray &userIDs);
+
+    //new messages reach the sessions on the other nodes through the bus
+    static MessageBus *messageBus;
+
+    //error code of the last response written, for the request metrics
+    static Metrics metrics;
+    static int lastResponseError;
+
+    //set by a handler which queued its response for later
+    static bool isResponseDeferred;
+
+    struct AccessToken
+    {
+        QString     token;
+        qint64      persistedExpiry;
+    };
+
+    static QHash<QString, size_t> tokens;
+    static QHash<size_t, AccessToken> userTokens;
+    static TimerWheel *tokenExpiry;
     static QMap<QString, size_t> usernames;
     static void loadTokensMap();
     static void loadUsernamesMap();
@@ -118,6 +257,14 @@ private:
     static const unsigned userChatMembershipBlockSize = 200;
     static const unsigned accessTokenLen = 100;
 
+    //a resumed session gets at most this many of the missed messages
+    //of a chat, a longer gap is cut to the newest ones
+    static const int maxResumedMessages = 200;
+    static const int maxResumedChats = 1000;
+
+    //largest page of the history a client gets at once
+    static const int maxHistoryPage = 200;
+
     enum apiErrorCode
     {
         NULL_ERROR, // no errors
@@ -144,25 +291,125 @@ private:
         NO_CHAT_VISIBILITY,
         NO_CHAT_NAME,
         NO_CHAT_MEMBERS,
-        UNKNOWN_ERROR
+        UNKNOWN_ERROR,
+        RATE_LIMIT_EXCEEDED,
+        QUERY_IS_TOO_BIG,
+        SERVER_IS_BUSY,
+        READ_ONLY_REPLICA,
+        ACCESS_DENIED
+    };
+
+    //every api method is registered once in a dispatch table
+    //together with a schema of the parameters it requires,
+    //so the lookup is a single hash probe and validation is shared
+    struct ApiParam
+    {
+        ApiParams::Field    field;
+        apiErrorCode        missingError;
+        bool                nonNegative;
+    };
+
+    struct ApiRequest
+    {
+        ApiParams       params;
+        size_t          senderID;
+        QString         peerAddress;
+        QString         limiterKey;
+        bool            isFromRouter;
+        QTcpSocket      *socket;
     };
 
+    typedef void (*ApiHandler)(const ApiRequest&, QByteArray &out);
+
+    struct ApiMethod
+    {
+        ApiHandler          handler;
+        bool                needsToken;
+        bool                readOnly;
+        QVector<ApiParam>   schema;
+        RateLimiter         limiter;
+    };
+
+    static QHash<QString, ApiMethod> apiMethods;
+
+    static void registerApiMethods();
+    static void registerApiMethod(const QString&            name,
+                                  ApiHandler                handler,
+                                  bool                      needsToken,
+                                  bool                      readOnly,
+                                  const QVector<ApiParam>&  schema = {});
+
+    static apiErrorCode validateParams(const ApiParams&          params,
+                                       const QVector<ApiParam>&  schema);
+
+    static void apiChangeAccessToken(const ApiRequest&, QByteArray &out);
+    static void apiCreateUser(const ApiRequest&, QByteArray &out);
+    static void apiGetMyInfo(const ApiRequest&, QByteArray &out);
+    static void apiGetChat(const ApiRequest&, QByteArray &out);
+    static void apiSetChatProperty(const ApiRequest&, QByteArray &out);
+    static void apiAddChatMember(const ApiRequest&, QByteArray &out);
+    static void apiKickChatMember(const ApiRequest&, QByteArray &out);
+    static void apiSendMessage(const ApiRequest&, QByteArray &out);
+    static void apiGetLastMessages(const ApiRequest&, QByteArray &out);
+    static void apiGetHistory(const ApiRequest&, QByteArray &out);
+    static void apiCreateChat(const ApiRequest&, QByteArray &out);
+    static void apiSubscribeEvents(const ApiRequest&, QByteArray &out);
+    static void apiResumeSession(const ApiRequest&, QByteArray &out);
+    static void apiReplicationStatus(const ApiRequest&, QByteArray &out);
+    static void apiServerStats(const ApiRequest&, QByteArray &out);
+    static void apiWhois(const ApiRequest&, QByteArray &out);
+    static void apiAddMembership(const ApiRequest&, QByteArray &out);
+
     static QJsonObject createUser(const QString &username,
-                           const QString &password);
+                                  const QString &passwordHash,
+                                  const bool    &issueToken = true);
+
+    //runs job on the auth pool and onDone with its result back on the
+    //event loop thread, false if too many jobs are already queued
+    static bool runAuthJob(const std::function<QVariant()>&              job,
+                           const std::function<void(const QVariant&)>&   onDone);
+    static void deferResponse();
+    static void writeDeferred(const QPointer<QTcpSocket>&   socket,
+                              const QString&                method,
+                              const QByteArray&             response);
+    static void rehashPassword(const size_t &userID, const QString &password);
 
     static QString apiErrorCodeDesc(const apiErrorCode&);
     static QJsonObject generateErrorJson(const apiErrorCode&);
+    static QJsonObject generateRateLimitJson(const qint64 &retryAfterMs);
+
+    //responses are appended to the output buffer of the connection
+    //in compact form, pure error responses come from pre-encoded cache
+    static void writeResponse(QByteArray &out, const QJsonObject &response);
+    static void writeError(QByteArray &out, const apiErrorCode &err);
+    static const QByteArray &encodedError(const apiErrorCode &err);
 
     static bool validateUser(const size_t&  userID,
                              const QString& userPassword);
+    static QString getPasswordHash(const size_t &userID);
+    static void updPasswordHash(const size_t&   userID,
+                                const QString&  passwordHash);
     static size_t getIDFromAccessToken(const QString&);
     static QJsonObject updAccessToken(const size_t& senderID);
+    static void setAccessToken(const size_t&    userID,
+                               const QString&   token,
+                               const qint64&    expiresAt);
+    static bool storeAccessToken(const size_t&  userID,
+                                 const QString& token,
+                                 const qint64&  expiresAt);
+    static void renewAccessToken(const size_t &userID);
+    static void expireTokens(const QVector<quint64> &userIDs);
+    static bool writeTokenLines(const size_t &fileID,
+                                QHash<size_t, QString> changes);
     static QString generateAccessToken();
 
     static QString getUsernameByID(const size_t&);
     static size_t getIDFromUsername(const QString&);
 
-    static QString parseQuery(const QString&);
+    static void parseQuery(const QByteArray&     query,
+                           QByteArray&           out,
+                           QTcpSocket            *clientSocket,
+                           const QString&        peerAddress);
 
     static QJsonObject createChat(const QString&   chatName,
                     const QJsonArray&       membersIDs,
@@ -172,7 +419,8 @@ private:
     static QJsonObject sendMessage(const size_t&   chatID,
                                    const QString&  message,
                                    const size_t&   senderID,
-                                   const bool&     isSystem=false);
+                                   const bool&     isSystem=false,
+                                   const QString&  date=QString());
 
     static bool isMemberOfChat(const size_t &userID,
                                const size_t &chatID);
@@ -190,9 +438,23 @@ private:
     static QJsonArray getLastBlockOfMessages(const size_t &chatID,
                                              const size_t &querySenderID);
 
-    static QJsonArray getNewestMessages(const size_t &chatID,
-                                        const size_t &querySenderID,
-                                        int          messagesNum);
+    static QJsonObject getMemberChatInfo(const size_t &chatID,
+                                         const size_t &querySenderID);
+
+    static QVector<QByteArray> getMessagesBlock(const size_t &chatID,
+                                                const size_t &blockID);
+
+    static void writeMessagesRange(QByteArray   &out,
+                                   const size_t &chatID,
+                                   size_t       fromMessageID,
+                                   size_t       toMessageID);
+
+    //only the messages after afterMessageID are written if it is set
+    static void writeNewestMessages(QByteArray   &out,
+                                    const size_t &chatID,
+                                    const size_t &querySenderID,
+                                    int          messagesNum,
+                                    qint64       afterMessageID = -1);
 
     static QJsonObject getChatInfo(const size_t &chatID,
                                    const size_t &senderID);
@@ -209,16 +471,21 @@ private:
                                   const size_t& senderID,
                                   const size_t& userToKickID);
 
-    static void addChatMembership(const size_t &userID,
-                                  const size_t &chatID);
+    //the name is kept for the chats of the other shards only,
+    //the local ones are looked up when the list is read
+    static void addChatMembership(const size_t  &userID,
+                                  const size_t  &chatID,
+                                  const QString &chatName = QString());
 
     static void deleteChatMembership(const size_t &userID,
                                      const size_t &chatID);
 
     static QJsonArray getChatMembership(const size_t &userID);
 
-    static QJsonObject callApiMethod(const QString&     method,
-                                     const QJsonObject& params);
+    static void callApiMethod(const ApiParams&   params,
+                              QByteArray&        out,
+                              QTcpSocket         *clientSocket = nullptr,
+                              const QString&     peerAddress = QString());
 
 };
 
@@ -0,0 +1,108 @@
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(qint64 tickMs, int slotsNum, int levelsNum, qint64 startMs)
+{
+    this->tickMs = qMax<qint64>(tickMs, 1);
+    this->startMs = startMs;
+    this->slotsNum = qMax(slotsNum, 2);
+
+    qint64 levelTick = 1;
+    for (int i = 0; i < qMax(levelsNum, 1); ++i)
+    {
+        this->levels.append(QVector<QSet<quint64>>(this->slotsNum));
+        this->levelTicks.append(levelTick);
+        levelTick *= this->slotsNum;
+    }
+}
+
+void TimerWheel::place(quint64 id, qint64 expiryTick)
+{
+    //the level is the lowest one whose turn covers the delay,
+    //longer delays wait in the top level and cascade again
+    const qint64 delta = expiryTick - this->currentTick;
+    int level = 0;
+    while (level < this->levels.size() - 1 &&
+           delta >= this->levelTicks[level] * this->slotsNum)
+        ++level;
+
+    Entry entry;
+    entry.expiryTick = expiryTick;
+    entry.level = level;
+    entry.slot = (expiryTick / this->levelTicks[level]) % this->slotsNum;
+    this->levels[level][entry.slot].insert(id);
+    this->entries.insert(id, entry);
+}
+
+void TimerWheel::schedule(quint64 id, qint64 delayMs)
+{
+    this->cancel(id);
+    const qint64 ticks = qMax<qint64>((delayMs + this->tickMs - 1) / this->tickMs, 1);
+    this->place(id, this->currentTick + ticks);
+}
+
+void TimerWheel::cancel(quint64 id)
+{
+    auto entry = this->entries.find(id);
+    if (entry == this->entries.end())
+        return;
+    this->levels[entry->level][entry->slot].remove(id);
+    this->entries.erase(entry);
+}
+
+bool TimerWheel::contains(quint64 id) const
+{
+    return this->entries.contains(id);
+}
+
+int TimerWheel::size() const
+{
+    return this->entries.size();
+}
+
+qint64 TimerWheel::tickInterval() const
+{
+    return this->tickMs;
+}
+
+QVector<quint64> TimerWheel::advance(qint64 nowMs)
+{
+    QVector<quint64> expired;
+    const qint64 targetTick = (nowMs - this->startMs) / this->tickMs;
+    while (this->currentTick < targetTick)
+    {
+        ++this->currentTick;
+
+        //higher levels whose slot boundary is crossed
+        //are moved down, starting from the top one
+        int topLevel = 0;
+        while (topLevel + 1 < this->levels.size() &&
+               this->currentTick % this->levelTicks[topLevel + 1] == 0)
+            ++topLevel;
+
+        for (int level = topLevel; level > 0; --level)
+        {
+            QSet<quint64> cascaded;
+            cascaded.swap(this->levels[level][(this->currentTick / this->levelTicks[level]) % this->slotsNum]);
+            for (quint64 id: cascaded)
+            {
+                const qint64 expiryTick = this->entries[id].expiryTick;
+                this->entries.remove(id);
+                this->place(id, qMax(expiryTick, this->currentTick));
+            }
+        }
+
+        QSet<quint64> &slot = this->levels[0][this->currentTick % this->slotsNum];
+        for (auto i = slot.begin(); i != slot.end();)
+        {
+            if (this->entries[*i].expiryTick > this->currentTick)
+            {
+                ++i;
+                continue;
+            }
+            expired.append(*i);
+            this->entries.remove(*i);
+            i = slot.erase(i);
+        }
+    }
+    return expired;
+}
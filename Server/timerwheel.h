@@ -0,0 +1,47 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QtCore>
+
+//hierarchical timer wheel: level 0 has a slot per tick, every next
+//level has a slot per full turn of the previous one. scheduling,
+//rescheduling and cancelling are O(1), an entry is moved down a level
+//at most levelsNum - 1 times, so expiring is amortized O(1) per entry
+//no matter how many millions of timeouts are pending
+class TimerWheel
+{
+public:
+    TimerWheel(qint64 tickMs, int slotsNum, int levelsNum = 4, qint64 startMs = 0);
+
+    void schedule(quint64 id, qint64 delayMs);
+    void cancel(quint64 id);
+    bool contains(quint64 id) const;
+    int size() const;
+
+    //moves the wheel to the time of nowMs (milliseconds of
+    //the same clock as startMs) and returns the ids whose
+    //timeouts expired
+    QVector<quint64> advance(qint64 nowMs);
+
+    qint64 tickInterval() const;
+
+private:
+    struct Entry
+    {
+        qint64  expiryTick;
+        int     level;
+        int     slot;
+    };
+
+    qint64 tickMs;
+    qint64 startMs;
+    qint64 currentTick = 0;
+    int slotsNum;
+    QVector<QVector<QSet<quint64>>> levels;
+    QVector<qint64> levelTicks;
+    QHash<quint64, Entry> entries;
+
+    void place(quint64 id, qint64 expiryTick);
+};
+
+#endif // TIMERWHEEL_H
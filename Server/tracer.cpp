@@ -0,0 +1,122 @@
+#include "tracer.h"
+#include "jsonwriter.h"
+
+double Tracer::sampleRate = 0;
+QElapsedTimer Tracer::clock = QElapsedTimer();
+QMutex Tracer::mutex;
+QVector<Tracer::Event> Tracer::events = QVector<Tracer::Event>();
+int Tracer::nextEvent = 0;
+bool Tracer::wrapped = false;
+quint64 Tracer::lastRequestID = 0;
+thread_local quint64 Tracer::currentRequest = 0;
+thread_local const char *Tracer::openSpan = nullptr;
+
+void Tracer::configure(double sampleRate, int capacity)
+{
+    QMutexLocker locker(&Tracer::mutex);
+    Tracer::sampleRate = capacity > 0 ? qBound(0.0, sampleRate, 1.0) : 0;
+    Tracer::events.clear();
+    Tracer::events.resize(qMax(capacity, 0));
+    Tracer::nextEvent = 0;
+    Tracer::wrapped = false;
+    if (!Tracer::clock.isValid())
+        Tracer::clock.start();
+}
+
+Tracer::Request::Request(const char *name)
+{
+    this->name = name;
+    this->startNs = -1;
+    if (Tracer::sampleRate <= 0 || QRandomGenerator::global()->generateDouble() >= Tracer::sampleRate)
+        return;
+    {
+        QMutexLocker locker(&Tracer::mutex);
+        Tracer::currentRequest = ++Tracer::lastRequestID;
+    }
+    this->startNs = Tracer::clock.nsecsElapsed();
+}
+
+Tracer::Request::~Request()
+{
+    if (this->startNs < 0)
+        return;
+    Tracer::record(this->name, "request", this->arg, this->startNs, Tracer::clock.nsecsElapsed());
+    Tracer::currentRequest = 0;
+}
+
+void Tracer::Request::setArg(const QString &arg)
+{
+    if (this->startNs >= 0)
+        this->arg = arg;
+}
+
+Tracer::Span::Span(const char *name, const char *category)
+{
+    this->name = name;
+    this->category = category;
+    this->parent = Tracer::openSpan;
+    Tracer::openSpan = name;
+    this->startNs = Tracer::currentRequest != 0 ? Tracer::clock.nsecsElapsed() : -1;
+}
+
+Tracer::Span::~Span()
+{
+    Tracer::openSpan = this->parent;
+    if (this->startNs >= 0 && Tracer::currentRequest != 0)
+        Tracer::record(this->name, this->category, QString(), this->startNs, Tracer::clock.nsecsElapsed());
+}
+
+const char *Tracer::currentSpan()
+{
+    return Tracer::openSpan;
+}
+
+void Tracer::record(const char *name, const char *category, const QString &arg,
+                    const qint64 &startNs, const qint64 &endNs)
+{
+    QMutexLocker locker(&Tracer::mutex);
+    if (Tracer::events.isEmpty())
+        return;
+    Tracer::events[Tracer::nextEvent] = {name, category, arg, Tracer::currentRequest, startNs, endNs - startNs};
+    if (++Tracer::nextEvent == Tracer::events.size())
+    {
+        Tracer::nextEvent = 0;
+        Tracer::wrapped = true;
+    }
+}
+
+QByteArray Tracer::chromeTrace()
+{
+    QMutexLocker locker(&Tracer::mutex);
+
+    //every request gets its own track, the spans of one request
+    //nest by their timestamps. times are in microseconds
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    const int size = Tracer::wrapped ? Tracer::events.size() : Tracer::nextEvent,
+              first = Tracer::wrapped ? Tracer::nextEvent : 0;
+    for (int i = 0; i < size; ++i)
+    {
+        const Event &event = Tracer::events[(first + i) % Tracer::events.size()];
+        if (i > 0)
+            out += ',';
+        out += "{\"name\":";
+        JsonWriter::writeString(out, QByteArray(event.name));
+        out += ",\"cat\":";
+        JsonWriter::writeString(out, QByteArray(event.category));
+        out += ",\"ph\":\"X\",\"pid\":1,\"tid\":";
+        out += QByteArray::number(event.requestID);
+        out += ",\"ts\":";
+        out += QByteArray::number(event.startNs / 1000.0, 'f', 3);
+        out += ",\"dur\":";
+        out += QByteArray::number(event.durationNs / 1000.0, 'f', 3);
+        if (!event.arg.isEmpty())
+        {
+            out += ",\"args\":{\"method\":";
+            JsonWriter::writeString(out, event.arg);
+            out += '}';
+        }
+        out += '}';
+    }
+    out += "]}\n";
+    return out;
+}
@@ -0,0 +1,79 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QtCore>
+
+//sampled per-request tracing. a Request marks the query handled on
+//the current thread, Spans opened inside a sampled request are kept
+//as complete events in a ring buffer and exported in the chrome trace
+//event format, outside of a sampled request they cost one branch
+class Tracer
+{
+public:
+    class Request
+    {
+    public:
+        explicit Request(const char *name);
+        ~Request();
+
+        //shown in the args of the root event, e.g. the api method
+        void setArg(const QString &arg);
+
+    private:
+        const char *name;
+        QString arg;
+        qint64 startNs;
+    };
+
+    class Span
+    {
+    public:
+        Span(const char *name, const char *category);
+        ~Span();
+
+    private:
+        const char *name;
+        const char *category;
+        const char *parent;
+        qint64 startNs;
+    };
+
+    //rate is the fraction of requests traced, zero disables tracing.
+    //capacity is the number of events kept, the oldest are overwritten
+    static void configure(double sampleRate, int capacity);
+
+    static QByteArray chromeTrace();
+
+    //name of the innermost open span of this thread, traced or not,
+    //so the storage io can be attributed to the function doing it
+    static const char *currentSpan();
+
+private:
+    struct Event
+    {
+        const char  *name;
+        const char  *category;
+        QString     arg;
+        quint64     requestID;
+        qint64      startNs;
+        qint64      durationNs;
+    };
+
+    static double sampleRate;
+    static QElapsedTimer clock;
+    static QMutex mutex;
+    static QVector<Event> events;
+    static int nextEvent;
+    static bool wrapped;
+    static quint64 lastRequestID;
+
+    //zero when the request handled on this thread is not sampled,
+    //so the password hashing pool never records into a request
+    static thread_local quint64 currentRequest;
+    static thread_local const char *openSpan;
+
+    static void record(const char *name, const char *category, const QString &arg,
+                       const qint64 &startNs, const qint64 &endNs);
+};
+
+#endif // TRACER_H
@@ -0,0 +1,87 @@
+#include "trafficcapture.h"
+#include "jsonwriter.h"
+
+const QString TrafficCapture::passwordPlaceholder = "@password";
+const QString TrafficCapture::tokenPrefix = "@token:";
+
+TrafficCapture::TrafficCapture(const std::function<QString(const QString&)> &tokenOwner)
+{
+    this->tokenOwner = tokenOwner;
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    this->file.close();
+}
+
+bool TrafficCapture::open(const QString &path)
+{
+    this->file.setFileName(path);
+    if (!this->file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qDebug() << "Unable to open capture file" << path;
+        return false;
+    }
+    this->clock.start();
+
+    QByteArray header;
+    JsonWriter::write(header, QJsonObject({{"capture", 1},
+                                           {"started", QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs)}}));
+    this->file.write(header + '\n');
+    this->file.flush();
+    return true;
+}
+
+void TrafficCapture::redact(QJsonObject &query)
+{
+    //the credentials are parameters of the query, {"method": .., "params": {..}}
+    if (!query["params"].isObject())
+        return;
+    QJsonObject params = query["params"].toObject();
+
+    if (params.contains("password"))
+        params["password"] = TrafficCapture::passwordPlaceholder;
+    if (params.contains("shard_secret"))
+        params["shard_secret"] = TrafficCapture::passwordPlaceholder;
+
+    if (params.contains("access_token"))
+    {
+        const QString token = params["access_token"].toString();
+        auto owner = this->owners.constFind(token);
+        if (owner == this->owners.constEnd())
+            owner = this->owners.insert(token, this->tokenOwner(token));
+        //unknown tokens are kept out of the capture too
+        params["access_token"] = TrafficCapture::tokenPrefix + owner.value();
+    }
+    query["params"] = params;
+}
+
+void TrafficCapture::record(const quint64 &connectionID, const QByteArray &frame, const int &errorCode)
+{
+    if (!this->file.isOpen())
+        return;
+
+    QJsonObject entry;
+    entry.insert("t", this->clock.elapsed());
+    entry.insert("conn", static_cast<double>(connectionID));
+
+    //frames that are not json objects cant be redacted, only their size is kept
+    QJsonParseError parseError;
+    QJsonDocument query = QJsonDocument::fromJson(frame, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !query.isObject())
+        entry.insert("invalid_size", frame.size());
+    else
+    {
+        QJsonObject redacted = query.object();
+        this->redact(redacted);
+        entry.insert("query", redacted);
+    }
+    if (errorCode >= 0)
+        entry.insert("error_code", errorCode);
+
+    QByteArray line;
+    JsonWriter::write(line, entry);
+    line += '\n';
+    this->file.write(line);
+    this->file.flush();
+}
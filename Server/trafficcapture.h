@@ -0,0 +1,35 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QtCore>
+#include <functional>
+
+//records the query frames received by the server as json lines with
+//their arrival time and connection, so the traffic can be replayed.
+//passwords are replaced by a placeholder and access tokens by the
+//name of their owner, which the replay maps to the tokens it gets
+class TrafficCapture
+{
+public:
+    //tokenOwner returns the username of a token, empty if unknown
+    explicit TrafficCapture(const std::function<QString(const QString&)> &tokenOwner);
+    ~TrafficCapture();
+
+    bool open(const QString &path);
+
+    //error code of the response, or -1 when it is sent later
+    void record(const quint64 &connectionID, const QByteArray &frame, const int &errorCode);
+
+    static const QString passwordPlaceholder;
+    static const QString tokenPrefix;
+
+private:
+    QFile file;
+    QElapsedTimer clock;
+    std::function<QString(const QString&)> tokenOwner;
+    QHash<QString, QString> owners;
+
+    void redact(QJsonObject &query);
+};
+
+#endif // TRAFFICCAPTURE_H
@@ -0,0 +1,20 @@
+QT -= gui
+QT += core testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+# the queries are built by the protocol code of the client,
+# so the tests see the frames the server really receives
+INCLUDEPATH += ../Server ../Client
+
+SOURCES += \
+        ../Client/apiprotocol.cpp \
+        ../Server/jsonwriter.cpp \
+        ../Server/trafficcapture.cpp \
+        trafficcapturetest.cpp
+
+HEADERS += \
+    ../Client/apiprotocol.h \
+    ../Server/jsonwriter.h \
+    ../Server/trafficcapture.h
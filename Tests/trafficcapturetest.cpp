@@ -0,0 +1,117 @@
+#include <QtTest>
+#include "trafficcapture.h"
+#include "apiprotocol.h"
+
+//the captured queries must not keep any credential in plain text
+class TrafficCaptureTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void redactsPassword_data();
+    void redactsPassword();
+    void redactsAccessToken();
+    void redactsUnknownAccessToken();
+
+private:
+    QTemporaryDir *dir = nullptr;
+    TrafficCapture *capture = nullptr;
+
+    static const QString password;
+    static const QString token;
+
+    QString capturePath() const;
+    QList<QJsonObject> capturedQueries() const;
+};
+
+const QString TrafficCaptureTest::password = "hunter2-secret";
+const QString TrafficCaptureTest::token = "live-access-token-0123456789";
+
+QString TrafficCaptureTest::capturePath() const
+{
+    return this->dir->filePath("capture.jsonl");
+}
+
+void TrafficCaptureTest::init()
+{
+    this->dir = new QTemporaryDir;
+    QVERIFY(this->dir->isValid());
+    this->capture = new TrafficCapture([](const QString &token) {
+        return token == TrafficCaptureTest::token ? QString("alice") : QString();
+    });
+    QVERIFY(this->capture->open(this->capturePath()));
+}
+
+void TrafficCaptureTest::cleanup()
+{
+    delete this->capture;
+    delete this->dir;
+}
+
+QList<QJsonObject> TrafficCaptureTest::capturedQueries() const
+{
+    QFile file(this->capturePath());
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+    QByteArray contents = file.readAll();
+    file.close();
+
+    //nothing in the file, not only in the queries, may hold the secrets
+    if (contents.contains(TrafficCaptureTest::password.toUtf8()) || contents.contains(TrafficCaptureTest::token.toUtf8()))
+        return {};
+
+    QList<QJsonObject> queries;
+    for (const QByteArray &line: contents.split('\n'))
+    {
+        QJsonObject entry = QJsonDocument::fromJson(line).object();
+        if (entry.contains("query"))
+            queries.append(entry["query"].toObject());
+    }
+    return queries;
+}
+
+void TrafficCaptureTest::redactsPassword_data()
+{
+    QTest::addColumn<QByteArray>("frame");
+    QTest::newRow("user.create")         << ApiProtocol::createUser("alice", TrafficCaptureTest::password);
+    QTest::newRow("access_token.change") << ApiProtocol::changeAccessToken("alice", TrafficCaptureTest::password);
+}
+
+void TrafficCaptureTest::redactsPassword()
+{
+    QFETCH(QByteArray, frame);
+    this->capture->record(1, frame, 0);
+
+    QList<QJsonObject> queries = this->capturedQueries();
+    QCOMPARE(queries.size(), 1);
+    QJsonObject params = queries.first()["params"].toObject();
+    QCOMPARE(params["password"].toString(), TrafficCapture::passwordPlaceholder);
+    QCOMPARE(params["username"].toString(), QString("alice"));
+}
+
+void TrafficCaptureTest::redactsAccessToken()
+{
+    this->capture->record(1, ApiProtocol::sendMessage(TrafficCaptureTest::token, 3, "hi"), 0);
+
+    QList<QJsonObject> queries = this->capturedQueries();
+    QCOMPARE(queries.size(), 1);
+    QJsonObject params = queries.first()["params"].toObject();
+    QCOMPARE(params["access_token"].toString(), TrafficCapture::tokenPrefix + "alice");
+    QCOMPARE(params["text"].toString(), QString("hi"));
+}
+
+void TrafficCaptureTest::redactsUnknownAccessToken()
+{
+    this->capture->record(1, ApiProtocol::subscribeEvents("stale-" + TrafficCaptureTest::token), 0);
+
+    QList<QJsonObject> queries = this->capturedQueries();
+    QCOMPARE(queries.size(), 1);
+    QCOMPARE(queries.first()["params"].toObject()["access_token"].toString(), TrafficCapture::tokenPrefix);
+}
+
+QTEST_GUILESS_MAIN(TrafficCaptureTest)
+
+#include "trafficcapturetest.moc"